@@ -22,6 +22,10 @@
 #include <sstream>
 #include <fstream>
 #include <iomanip>
+#include <memory>
+#include <algorithm>
+#include <map>
+#include <vector>
 
 using namespace ns3;
 
@@ -52,6 +56,68 @@ void TxTrace (std::string context, Ptr<const Packet> packet)
   g_totalTx++;
 }
 
+// Protocol counters, from the trace sources of EnergyAwareRoutingProtocol
+struct ProtocolStats
+{
+  uint32_t beaconsSent = 0;
+  uint64_t beaconBytes = 0;
+  uint32_t beaconsSkipped = 0;
+  uint64_t summaryVectorBytes = 0;
+  uint32_t dataSent = 0;
+  uint64_t dataBytesSent = 0;
+  uint32_t queueDrops[Epidemic::PacketQueue::DROP_HANDED_OFF + 1] = {};
+  uint32_t energyRejected = 0;
+  uint32_t delivered = 0;
+  Time totalDelay;
+  std::map<uint32_t, Time> depletions; // When each depleted node first ran out of energy
+};
+ProtocolStats g_protocol;
+
+void BeaconSentTrace (Ptr<const Packet> packet)
+{
+  g_protocol.beaconsSent++;
+  g_protocol.beaconBytes += packet->GetSize ();
+}
+
+void BeaconSkippedTrace ()
+{
+  g_protocol.beaconsSkipped++;
+}
+
+void SummaryVectorSentTrace (Ptr<const Packet> packet)
+{
+  g_protocol.summaryVectorBytes += packet->GetSize ();
+}
+
+void DataSentTrace (Ptr<const Packet> packet, Ipv4Address neighbor)
+{
+  g_protocol.dataSent++;
+  g_protocol.dataBytesSent += packet->GetSize ();
+}
+
+void QueueDropTrace (Ptr<const Packet> packet, Epidemic::PacketQueue::DropReason reason)
+{
+  g_protocol.queueDrops[reason]++;
+}
+
+void EnergyRejectedTrace (Ptr<const Packet> packet)
+{
+  g_protocol.energyRejected++;
+}
+
+void DeliveryTrace (Ptr<const Packet> packet, Time delay)
+{
+  g_protocol.delivered++;
+  g_protocol.totalDelay += delay;
+}
+
+void EnergyDepletedTrace (std::string context)
+{
+  // Context is /NodeList/<id>/...
+  uint32_t node = std::stoul (context.substr (std::string ("/NodeList/").size ()));
+  g_protocol.depletions.insert (std::make_pair (node, Simulator::Now ()));
+}
+
 void PrintPdr ()
 {
   double pdr = (g_totalTx > 0) ? ((double)g_totalRx / g_totalTx) : 0.0;
@@ -73,6 +139,7 @@ private:
   NodeContainer m_nodes;
   std::vector<double> m_initialEnergy;
   std::vector<double> m_currentEnergy;
+  std::vector<int> m_colorBands;      // Color band shown for each node, -1 before the first update
   Time m_monitoringInterval;
   EventId m_monitoringEvent;
   ns3::AnimationInterface* m_anim;
@@ -87,6 +154,7 @@ EnergyMonitor::EnergyMonitor (NodeContainer nodes)
 {
   m_initialEnergy.resize (nodes.GetN ());
   m_currentEnergy.resize (nodes.GetN ());
+  m_colorBands.assign (nodes.GetN (), -1);
   
   // Record initial energy levels
   for (uint32_t i = 0; i < nodes.GetN (); ++i)
@@ -179,60 +247,37 @@ EnergyMonitor::UpdateNodeColors ()
   if (!m_anim)
     return;
 
+  // Color coding based on energy level:
+  // Green (100-70%): Fully operational
+  // Yellow (70-40%): Medium energy
+  // Orange (40-20%): Low energy
+  // Red (<20%): Critical energy
+  // Gray (0%): Depleted
+  static const uint8_t colors[][3] = {
+    { 0, 255, 0 }, { 255, 255, 0 }, { 255, 128, 0 }, { 255, 0, 0 }, { 128, 128, 128 }
+  };
+  static const char *labels[] = { "NORMAL", "MEDIUM", "LOW", "CRITICAL", "DEPLETED" };
+
   for (uint32_t i = 0; i < m_nodes.GetN (); ++i)
     {
       double energyPercent = (m_initialEnergy[i] > 0) ?
                              (m_currentEnergy[i] / m_initialEnergy[i]) * 100 : 0;
+      int band = energyPercent >= 70.0 ? 0
+        : energyPercent >= 40.0 ? 1
+        : energyPercent >= 20.0 ? 2
+        : energyPercent > 0.0 ? 3 : 4;
 
-      // Color coding based on energy level:
-      // Green (100-70%): Fully operational
-      // Yellow (70-40%): Medium energy
-      // Orange (40-20%): Low energy
-      // Red (<20%): Critical energy
-      // Gray (0%): Depleted
-
-      uint8_t r, g, b;
-      if (energyPercent >= 70.0)
+      // Every update is a record in the NetAnim trace: only write band changes
+      if (band == m_colorBands[i])
         {
-          // Green to Yellow transition
-          r = static_cast<uint8_t>((100.0 - energyPercent) * 255 / 30.0);
-          g = 255;
-          b = 0;
-        }
-      else if (energyPercent >= 40.0)
-        {
-          // Yellow to Orange transition
-          r = 255;
-          g = static_cast<uint8_t>((energyPercent - 40.0) * 255 / 30.0);
-          b = 0;
-        }
-      else if (energyPercent >= 20.0)
-        {
-          // Orange to Red transition
-          r = 255;
-          g = static_cast<uint8_t>((energyPercent - 20.0) * 128 / 20.0);
-          b = 0;
-        }
-      else if (energyPercent > 0.0)
-        {
-          // Red
-          r = 255;
-          g = 0;
-          b = 0;
-        }
-      else
-        {
-          // Gray - depleted
-          r = 128;
-          g = 128;
-          b = 128;
+          continue;
         }
-
-      m_anim->UpdateNodeColor (i, r, g, b);
+      m_colorBands[i] = band;
+      m_anim->UpdateNodeColor (i, colors[band][0], colors[band][1], colors[band][2]);
 
       // Update node description with current status
       std::ostringstream desc;
-      desc << "Worker " << i << " [" << std::fixed << std::setprecision(1)
+      desc << "Worker " << i << " [" << labels[band] << " " << std::fixed << std::setprecision(1)
            << energyPercent << "%]";
       m_anim->UpdateNodeDescription (i, desc.str ());
     }
@@ -254,6 +299,17 @@ int main (int argc, char *argv[])
   std::string dataRate = "128kbps";  // Increased data rate for faster energy consumption
   uint32_t numCommunicationPairs = 10; // Increased to 10 pairs for more traffic
   std::string audioFilePath = "contrib/epidemic/examples/sample-15s.mp3"; // MP3 file path
+  uint32_t bundleMtu = 0;            // Bytes per contact bundle, 0 disables bundling
+  std::string forwardingMode = "Epidemic"; // Epidemic or SprayAndWait
+  uint32_t sprayCopies = 8;          // Copies per packet in SprayAndWait mode
+  bool custodyTransfer = false;      // Hand buffers over to richer neighbors at low energy
+  double harvestingRate = 0.0;       // Mean harvested power per node (W), 0 disables harvesting
+  std::string traceMode = "netanim"; // netanim (XML), csv (streaming) or none
+  double traceInterval = 30.0;       // Seconds between routing table / energy samples
+  uint32_t packetSampling = 100;     // One CSV packet record per this many packets
+  std::string routingTableFormat = "Text"; // Text, Csv or Json routing info dumps
+  uint32_t run = 1;                  // Run number of the random streams
+  std::string resultsFile = "";      // Summary line appended here, none if empty
 
   CommandLine cmd;
   cmd.AddValue ("nNodes", "Number of rescue workers", nNodes);
@@ -265,7 +321,19 @@ int main (int argc, char *argv[])
   cmd.AddValue ("areaSize", "Size of disaster area in meters", areaSize);
   cmd.AddValue ("numPairs", "Number of communication pairs", numCommunicationPairs);
   cmd.AddValue ("audioFile", "Path to audio file (MP3) to transmit", audioFilePath);
+  cmd.AddValue ("bundleMtu", "Maximum size of a bundle of packets sent in one frame (0 = off)", bundleMtu);
+  cmd.AddValue ("forwardingMode", "Forwarding mode: Epidemic or SprayAndWait", forwardingMode);
+  cmd.AddValue ("sprayCopies", "Copies per packet at full energy in SprayAndWait mode", sprayCopies);
+  cmd.AddValue ("custodyTransfer", "Hand buffers over to richer neighbors at low energy", custodyTransfer);
+  cmd.AddValue ("harvestingRate", "Mean harvested power per node in Watts (0 = off)", harvestingRate);
+  cmd.AddValue ("traceMode", "Trace output: netanim, csv or none", traceMode);
+  cmd.AddValue ("traceInterval", "Seconds between routing table (netanim) or energy (csv) samples", traceInterval);
+  cmd.AddValue ("packetSampling", "One csv packet record per this many packets (0 = none)", packetSampling);
+  cmd.AddValue ("routingTableFormat", "Routing info dumps: Text, or one Csv or Json line per node", routingTableFormat);
+  cmd.AddValue ("run", "Run number: independent random streams per run", run);
+  cmd.AddValue ("resultsFile", "CSV file the summary of the run is appended to", resultsFile);
   cmd.Parse (argc, argv);
+  RngSeedManager::SetRun (run);
   
   // Read and get MP3 file size
   uint64_t audioFileSize = 0;
@@ -387,16 +455,26 @@ int main (int argc, char *argv[])
   energyAwareHelper.SetInitialEnergy (initialEnergy);
   energyAwareHelper.SetEnergyThresholds (0.3, 0.15); // 30% low, 15% critical
   energyAwareHelper.EnableEnergyMonitoring (true);
+  // Solar-assisted nodes: a harvester on each battery
+  energyAwareHelper.SetEnergyHarvestingRate (harvestingRate);
+  energyAwareHelper.InstallEnergyHarvesters (sources);
   
   // Configure epidemic routing parameters
   energyAwareHelper.Set ("HopCount", UintegerValue (10));
   energyAwareHelper.Set ("QueueLength", UintegerValue (50));
   energyAwareHelper.Set ("QueueEntryExpireTime", TimeValue (Seconds (60)));
   energyAwareHelper.Set ("BeaconInterval", TimeValue (Seconds (5)));
+  energyAwareHelper.Set ("BundleMtu", UintegerValue (bundleMtu));
+  energyAwareHelper.Set ("ForwardingMode", StringValue (forwardingMode));
+  energyAwareHelper.Set ("SprayCopies", UintegerValue (sprayCopies));
+  energyAwareHelper.Set ("CustodyTransfer", BooleanValue (custodyTransfer));
+  energyAwareHelper.Set ("RoutingTableFormat", StringValue (routingTableFormat));
 
   InternetStackHelper internet;
   internet.SetRoutingHelper (energyAwareHelper);
   internet.Install (nodes);
+  // Fix the streams of the routing random variables for repeatable runs
+  energyAwareHelper.AssignStreams (nodes, 0);
 
   // Assign IP addresses
   Ipv4AddressHelper ipv4;
@@ -421,6 +499,10 @@ int main (int argc, char *argv[])
       onOff.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=5.0]")); // Short off period
       onOff.SetAttribute ("DataRate", DataRateValue (DataRate (dataRate)));
       onOff.SetAttribute ("PacketSize", UintegerValue (packetSize));
+      // Mix alerts (CS6), voice (EF) and bulk data so that low-energy nodes
+      // have traffic classes to choose from
+      static const uint8_t tos[] = { 0xc0, 0xb8, 0x00 };
+      onOff.SetAttribute ("Tos", UintegerValue (tos[i % 3]));
 
       ApplicationContainer srcApp = onOff.Install (nodes.Get (srcNode));
       srcApp.Start (Seconds (5.0 + i * 2.0)); // Stagger start times
@@ -453,59 +535,119 @@ int main (int argc, char *argv[])
     }
   Simulator::Schedule (Seconds (simulationTime - 5.0), &EnergyMonitor::PrintEnergyStats, &energyMonitor);
 
-  // NetAnim setup for visualization
-  AnimationInterface anim ("emergency-communication-network.xml");
-  anim.SetMobilityPollInterval (Seconds (0.5));
-  anim.EnablePacketMetadata (true);
-
-  // Enable IPv4 route tracking for NetAnim
-  // Note: Epidemic routing uses opportunistic forwarding, not traditional routing tables
-  // This will show energy status and buffer information instead
-  anim.EnableIpv4RouteTracking ("emergency-routing-table.xml", Seconds (0),
-                                Seconds (simulationTime), Seconds (30.0)); // Sample every 30s
+  // NetAnim XML grows with every packet and node update; at a few hundred
+  // nodes the streaming CSV trace keeps trace I/O out of the way
+  std::unique_ptr<AnimationInterface> anim;
+  Ptr<EpidemicCsvTracer> csvTracer;
+  if (traceMode == "netanim")
+    {
+      anim.reset (new AnimationInterface ("emergency-communication-network.xml"));
+      anim->SetMobilityPollInterval (Seconds (0.5));
+      anim->EnablePacketMetadata (true);
+
+      // Enable IPv4 route tracking for NetAnim
+      // Note: Epidemic routing uses opportunistic forwarding, not traditional routing tables
+      // This will show energy status and buffer information instead
+      anim->EnableIpv4RouteTracking ("emergency-routing-table.xml", Seconds (0),
+                                     Seconds (simulationTime), Seconds (traceInterval));
+
+      // Set initial node colors: Green for rescue workers (full energy)
+      // Node size: Larger to represent rescue workers with equipment
+      for (uint32_t i = 0; i < nNodes; ++i)
+        {
+          anim->UpdateNodeColor (i, 0, 255, 0); // Green - full energy
+          anim->UpdateNodeDescription (i, "Rescue Worker " + std::to_string(i) + " [100%]");
+          anim->UpdateNodeSize (i, 5.0, 5.0); // Larger nodes for better visibility
+        }
 
-  // Set initial node colors: Green for rescue workers (full energy)
-  // Node size: Larger to represent rescue workers with equipment
-  for (uint32_t i = 0; i < nNodes; ++i)
+      // Connect animation interface to energy monitor for dynamic color updates
+      energyMonitor.SetAnimationInterface (anim.get ());
+    }
+  else if (traceMode == "csv")
+    {
+      csvTracer = energyAwareHelper.EnableCsvTracing ("emergency-communication-network.csv", nodes,
+                                                      Seconds (traceInterval), packetSampling);
+    }
+  else if (traceMode != "none")
     {
-      anim.UpdateNodeColor (i, 0, 255, 0); // Green - full energy
-      anim.UpdateNodeDescription (i, "Rescue Worker " + std::to_string(i) + " [100%]");
-      anim.UpdateNodeSize (i, 5.0, 5.0); // Larger nodes for better visibility
+      NS_FATAL_ERROR ("Unknown trace mode " << traceMode << ", use netanim, csv or none");
     }
 
-  // Connect animation interface to energy monitor for dynamic color updates
-  energyMonitor.SetAnimationInterface (&anim);
-
-  // Create additional human-readable routing information log
-  AsciiTraceHelper asciiTraceHelper;
-  Ptr<OutputStreamWrapper> routingStream = asciiTraceHelper.CreateFileStream ("epidemic-routing-info.txt");
-  *routingStream->GetStream () << "=================================================================\n";
-  *routingStream->GetStream () << "   ENERGY-AWARE EPIDEMIC ROUTING - PROTOCOL STATUS LOG\n";
-  *routingStream->GetStream () << "=================================================================\n";
-  *routingStream->GetStream () << "Simulation Time: " << simulationTime << " seconds\n";
-  *routingStream->GetStream () << "Number of Nodes: " << nNodes << "\n";
-  *routingStream->GetStream () << "Initial Energy: " << initialEnergy << " Joules\n";
-  *routingStream->GetStream () << "=================================================================\n\n";
-
-  // Schedule periodic routing table dumps (every 60 seconds for readability)
-  for (double t = 60.0; t <= simulationTime; t += 60.0)
+  std::string routingInfoFile = "epidemic-routing-info.txt";
+  if (routingTableFormat == "Csv")
+    {
+      routingInfoFile = "epidemic-routing-info.csv";
+    }
+  else if (routingTableFormat == "Json")
     {
-      Simulator::Schedule (Seconds (t), &Ipv4RoutingHelper::PrintRoutingTableAllAt,
-                          Seconds (t), routingStream, Time::Unit::S);
+      routingInfoFile = "epidemic-routing-info.json";
+    }
+  if (traceMode != "none" && routingTableFormat != "Text")
+    {
+      // One snapshot line per node, cheap enough to dump every sample interval;
+      // generate_graphs.py reads these lines directly
+      AsciiTraceHelper asciiTraceHelper;
+      Ptr<OutputStreamWrapper> routingStream = asciiTraceHelper.CreateFileStream (routingInfoFile);
+      for (double t = traceInterval; t <= simulationTime; t += traceInterval)
+        {
+          Simulator::Schedule (Seconds (t), &Ipv4RoutingHelper::PrintRoutingTableAllAt,
+                              Seconds (t), routingStream, Time::Unit::S);
+        }
+    }
+  else if (traceMode != "none")
+    {
+      // Create additional human-readable routing information log
+      AsciiTraceHelper asciiTraceHelper;
+      Ptr<OutputStreamWrapper> routingStream = asciiTraceHelper.CreateFileStream ("epidemic-routing-info.txt");
+      *routingStream->GetStream () << "=================================================================\n";
+      *routingStream->GetStream () << "   ENERGY-AWARE EPIDEMIC ROUTING - PROTOCOL STATUS LOG\n";
+      *routingStream->GetStream () << "=================================================================\n";
+      *routingStream->GetStream () << "Simulation Time: " << simulationTime << " seconds\n";
+      *routingStream->GetStream () << "Number of Nodes: " << nNodes << "\n";
+      *routingStream->GetStream () << "Initial Energy: " << initialEnergy << " Joules\n";
+      *routingStream->GetStream () << "=================================================================\n\n";
+
+      // Schedule periodic routing table dumps (every 60 seconds for readability)
+      for (double t = 60.0; t <= simulationTime; t += 60.0)
+        {
+          Simulator::Schedule (Seconds (t), &Ipv4RoutingHelper::PrintRoutingTableAllAt,
+                              Seconds (t), routingStream, Time::Unit::S);
+        }
     }
 
   // Connect PDR traces
   Config::Connect ("/NodeList/*/ApplicationList/*/$ns3::PacketSink/Rx", MakeCallback (&RxTrace));
   Config::Connect ("/NodeList/*/ApplicationList/*/$ns3::OnOffApplication/Tx", MakeCallback (&TxTrace));
 
+  // Connect protocol counters
+  std::string protocolPath = "/NodeList/*/$ns3::Epidemic::EnergyAwareRoutingProtocol/";
+  Config::ConnectWithoutContext (protocolPath + "BeaconSent", MakeCallback (&BeaconSentTrace));
+  Config::ConnectWithoutContext (protocolPath + "BeaconSkipped", MakeCallback (&BeaconSkippedTrace));
+  Config::ConnectWithoutContext (protocolPath + "SummaryVectorSent", MakeCallback (&SummaryVectorSentTrace));
+  Config::ConnectWithoutContext (protocolPath + "DataSent", MakeCallback (&DataSentTrace));
+  Config::ConnectWithoutContext (protocolPath + "QueueDrop", MakeCallback (&QueueDropTrace));
+  Config::ConnectWithoutContext (protocolPath + "EnergyRejected", MakeCallback (&EnergyRejectedTrace));
+  Config::ConnectWithoutContext (protocolPath + "Delivery", MakeCallback (&DeliveryTrace));
+  Config::Connect (protocolPath + "EnergyDepleted", MakeCallback (&EnergyDepletedTrace));
+
   // Schedule PDR printing
   Simulator::Schedule (Seconds (10.0), &PrintPdr);
 
   // Simulation execution
   std::cout << "\nStarting Emergency Communication Network simulation..." << std::endl;
-  std::cout << "NetAnim file: emergency-communication-network.xml" << std::endl;
-  std::cout << "Routing table XML: emergency-routing-table.xml" << std::endl;
-  std::cout << "Routing info log: epidemic-routing-info.txt\n" << std::endl;
+  if (anim)
+    {
+      std::cout << "NetAnim file: emergency-communication-network.xml" << std::endl;
+      std::cout << "Routing table XML: emergency-routing-table.xml" << std::endl;
+    }
+  if (csvTracer)
+    {
+      std::cout << "CSV trace: emergency-communication-network.csv" << std::endl;
+    }
+  if (traceMode != "none")
+    {
+      std::cout << "Routing info log: " << routingInfoFile << "\n" << std::endl;
+    }
 
   Simulator::Stop (Seconds (simulationTime));
   Simulator::Run ();
@@ -531,12 +673,92 @@ int main (int argc, char *argv[])
   std::cout << "Total data received: " << totalBytesReceived << " bytes (" 
             << (totalBytesReceived / 1024.0) << " KB)" << std::endl;
 
+  double energyConsumed = 0.0;
+  for (uint32_t i = 0; i < sources.GetN (); ++i)
+    {
+      energyConsumed += sources.Get (i)->GetInitialEnergy () - sources.Get (i)->GetRemainingEnergy ();
+    }
+  std::cout << "\n=== Protocol Overhead ===" << std::endl;
+  std::cout << "Beacons sent: " << g_protocol.beaconsSent
+            << ", skipped for energy: " << g_protocol.beaconsSkipped << std::endl;
+  std::cout << "Summary vector bytes: " << g_protocol.summaryVectorBytes << std::endl;
+  std::cout << "Data packets sent: " << g_protocol.dataSent
+            << " (" << g_protocol.dataBytesSent << " bytes)" << std::endl;
+  std::cout << "Buffer drops:";
+  for (uint32_t r = 0; r <= Epidemic::PacketQueue::DROP_HANDED_OFF; ++r)
+    {
+      std::cout << " " << Epidemic::PacketQueue::GetDropReasonName (static_cast<Epidemic::PacketQueue::DropReason> (r))
+                << " " << g_protocol.queueDrops[r];
+    }
+  std::cout << std::endl;
+  std::cout << "Forwards refused for energy: " << g_protocol.energyRejected << std::endl;
+  std::cout << "Packets delivered: " << g_protocol.delivered;
+  if (g_protocol.delivered > 0)
+    {
+      std::cout << ", mean delay " << (g_protocol.totalDelay / g_protocol.delivered).As (Time::S);
+    }
+  std::cout << std::endl;
+  if (totalBytesReceived > 0)
+    {
+      std::cout << "Energy per delivered byte: " << (energyConsumed / totalBytesReceived)
+                << " J" << std::endl;
+    }
+
+  // Network lifetime: until the first node, and until half of the nodes,
+  // ran out of energy; the simulation time if they did not
+  std::vector<Time> depletions;
+  for (const auto &depletion : g_protocol.depletions)
+    {
+      depletions.push_back (depletion.second);
+    }
+  std::sort (depletions.begin (), depletions.end ());
+  double firstDepletion = depletions.empty () ? simulationTime : depletions.front ().GetSeconds ();
+  double halfDepletion = depletions.size () < (nNodes + 1) / 2 ? simulationTime
+    : depletions[(nNodes + 1) / 2 - 1].GetSeconds ();
+  std::cout << "Depleted nodes: " << depletions.size () << ", first at "
+            << firstDepletion << " s" << std::endl;
+
+  if (!resultsFile.empty ())
+    {
+      // One line per run, aggregated across runs by epidemic-sweep.py
+      std::ifstream existing (resultsFile);
+      bool header = !existing.good () || existing.peek () == std::ifstream::traits_type::eof ();
+      existing.close ();
+      std::ofstream results (resultsFile, std::ios::app);
+      if (header)
+        {
+          results << "nNodes,areaSize,nodeSpeedMin,nodeSpeedMax,initialEnergy,forwardingMode,run,"
+                  << "sent,received,pdr,deliveries,meanDelay,beaconBytes,summaryVectorBytes,"
+                  << "dataBytesSent,bytesReceived,energyConsumed,energyPerByte,"
+                  << "depletedNodes,firstDepletion,halfDepletion\n";
+        }
+      results << nNodes << "," << areaSize << "," << nodeSpeedMin << "," << nodeSpeedMax << ","
+              << initialEnergy << "," << forwardingMode << "," << run << ","
+              << g_totalTx << "," << g_totalRx << ","
+              << (g_totalTx > 0 ? (double) g_totalRx / g_totalTx : 0.0) << ","
+              << g_protocol.delivered << ","
+              << (g_protocol.delivered > 0 ? (g_protocol.totalDelay / g_protocol.delivered).GetSeconds () : 0.0) << ","
+              << g_protocol.beaconBytes << "," << g_protocol.summaryVectorBytes << ","
+              << g_protocol.dataBytesSent << "," << totalBytesReceived << ","
+              << energyConsumed << ","
+              << (totalBytesReceived > 0 ? energyConsumed / totalBytesReceived : 0.0) << ","
+              << depletions.size () << "," << firstDepletion << "," << halfDepletion << "\n";
+      std::cout << "Results appended to " << resultsFile << std::endl;
+    }
+
+  if (csvTracer)
+    {
+      csvTracer->Dispose ();
+    }
   Simulator::Destroy ();
   
   std::cout << "\n================================================" << std::endl;
   std::cout << "  Simulation completed successfully!" << std::endl;
   std::cout << "================================================\n" << std::endl;
-  std::cout << "To visualize, open: emergency-communication-network.xml in NetAnim" << std::endl;
+  if (anim)
+    {
+      std::cout << "To visualize, open: emergency-communication-network.xml in NetAnim" << std::endl;
+    }
   
   return 0;
 }
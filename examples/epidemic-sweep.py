@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Scalability Sweep for Energy-Aware Epidemic Routing
+Runs energy-aware-epidemic-example over a grid of scenarios and seeds in
+parallel and collects one results line per run
+
+Usage (from the ns-3 top level directory):
+    python3 contrib/epidemic/examples/epidemic-sweep.py \\
+        --nodes 20,50,100 --areas 500,1000 --speeds 5:15 --energies 1000 \\
+        --runs 5 --jobs 8 --output sweep-results.csv
+    python3 contrib/epidemic/examples/generate_graphs.py sweep-results.csv
+"""
+
+import argparse
+import itertools
+import os
+import subprocess
+import sys
+import tempfile
+from concurrent.futures import ThreadPoolExecutor
+
+EXAMPLE = 'energy-aware-epidemic-example'
+
+def parse_list(text, convert=float):
+    """Parse a comma separated list of values"""
+    return [convert(value) for value in text.split(',') if value]
+
+def parse_speeds(text):
+    """Parse a comma separated list of min:max speed ranges"""
+    speeds = []
+    for value in text.split(','):
+        low, _, high = value.partition(':')
+        speeds.append((float(low), float(high or low)))
+    return speeds
+
+def build(ns3):
+    """Build the example once, so that the runs do not race to build it"""
+    subprocess.run([ns3, 'build', EXAMPLE], check=True)
+
+def run_scenario(ns3, scenario, extra, results_dir):
+    """Run one scenario and return the results line, or None on failure"""
+    nodes, area, (speed_min, speed_max), energy, run = scenario
+    results = os.path.join(results_dir, f'run-{nodes}-{area}-{speed_min}-{speed_max}-{energy}-{run}.csv')
+    program = (f'{EXAMPLE} --nNodes={nodes} --areaSize={area} '
+               f'--nodeSpeedMin={speed_min} --nodeSpeedMax={speed_max} '
+               f'--initialEnergy={energy} --run={run} --traceMode=none '
+               f'--resultsFile={results} {extra}')
+    log = os.path.join(results_dir, os.path.basename(results)[:-4] + '.log')
+    with open(log, 'w') as out:
+        status = subprocess.run([ns3, 'run', '--no-build', program],
+                                stdout=out, stderr=subprocess.STDOUT).returncode
+    if status != 0 or not os.path.exists(results):
+        print(f"[FAIL] {program} (see {log})")
+        return None
+    with open(results) as f:
+        lines = f.read().splitlines()
+    print(f"[OK] nNodes={nodes} areaSize={area} speed={speed_min}:{speed_max} "
+          f"initialEnergy={energy} run={run}")
+    return lines[0], lines[1]
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--nodes', default='20,50,100', help='node counts')
+    parser.add_argument('--areas', default='500', help='area sizes in m')
+    parser.add_argument('--speeds', default='5:15', help='min:max node speeds in m/s')
+    parser.add_argument('--energies', default='1000', help='initial energies in J')
+    parser.add_argument('--runs', type=int, default=3, help='independent runs per scenario')
+    parser.add_argument('--jobs', type=int, default=os.cpu_count() or 1,
+                        help='simulations run in parallel')
+    parser.add_argument('--extra', default='', help='more arguments for every run')
+    parser.add_argument('--ns3', default='./ns3', help='path to the ns3 script')
+    parser.add_argument('--output', default='sweep-results.csv', help='results file')
+    args = parser.parse_args()
+
+    scenarios = list(itertools.product(parse_list(args.nodes, int), parse_list(args.areas),
+                                       parse_speeds(args.speeds), parse_list(args.energies),
+                                       range(1, args.runs + 1)))
+    print("=" * 60)
+    print(f"Energy-Aware Epidemic Routing - {len(scenarios)} runs, {args.jobs} at a time")
+    print("=" * 60)
+
+    build(args.ns3)
+    results_dir = tempfile.mkdtemp(prefix='epidemic-sweep-')
+    # Each simulation is its own process, threads only wait for them
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        lines = list(pool.map(lambda s: run_scenario(args.ns3, s, args.extra, results_dir),
+                              scenarios))
+
+    done = [line for line in lines if line]
+    if not done:
+        print("Error: no run completed")
+        return 1
+    with open(args.output, 'w') as out:
+        out.write(done[0][0] + '\n')
+        for _, line in done:
+            out.write(line + '\n')
+    print(f"\n{len(done)}/{len(scenarios)} runs written to {args.output}")
+    print(f"Logs kept in {results_dir}")
+    return 0 if len(done) == len(scenarios) else 1
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -7,6 +7,7 @@ Generates graphs from NS-3 simulation results
 import matplotlib.pyplot as plt
 import numpy as np
 import re
+import json
 import sys
 import os
 from collections import defaultdict
@@ -36,6 +37,47 @@ def parse_energy_log(filename):
     
     return times, node_energy
 
+def parse_snapshot_log(filename):
+    """Parse the Csv or Json PrintRoutingTable snapshots of a routing info dump
+
+    Csv lines are "R,time,node,address,remaining_j,energy_ratio,effective_ratio,
+    state,depleted,queue,queue_max,beacon_interval,neighbors,contacts"; Json
+    lines carry the same fields by name.  Other lines are ignored.
+    """
+    fields = ['time', 'node', 'address', 'remaining_j', 'energy_ratio',
+              'effective_ratio', 'state', 'depleted', 'queue', 'queue_max',
+              'beacon_interval', 'neighbors', 'contacts']
+    snapshots = []
+
+    if not os.path.exists(filename):
+        return snapshots
+
+    with open(filename, 'r') as f:
+        for line in f:
+            if line.startswith('R,'):
+                snapshots.append(dict(zip(fields, line.strip().split(',')[1:])))
+            elif line.startswith('{'):
+                try:
+                    snapshots.append(json.loads(line))
+                except ValueError:
+                    pass
+
+    return snapshots
+
+def snapshot_energy(snapshots):
+    """Remaining energy per node at each snapshot time, as parse_energy_log"""
+    samples = defaultdict(dict)
+    for snapshot in snapshots:
+        samples[float(snapshot['time'])][int(snapshot['node'])] = float(snapshot['remaining_j'])
+
+    times = sorted(samples.keys())
+    node_energy = defaultdict(list)
+    for t in times:
+        for node_id, energy in samples[t].items():
+            node_energy[node_id].append(energy)
+
+    return times, node_energy
+
 def parse_pdr_log(filename):
     """Parse packet delivery ratio from log"""
     times = []
@@ -51,6 +93,51 @@ def parse_pdr_log(filename):
     
     return times, pdr_values
 
+def parse_sweep_results(filename):
+    """Parse the results file of epidemic-sweep.py, None if it is not one"""
+    with open(filename, 'r') as f:
+        lines = f.read().splitlines()
+    if not lines or not lines[0].startswith('nNodes,'):
+        return None
+    fields = lines[0].split(',')
+    return [dict(zip(fields, line.split(','))) for line in lines[1:] if line]
+
+def plot_scalability(results, output_file='scalability.png'):
+    """Plot the sweep metrics against the node count, mean and spread over runs"""
+    metrics = [('pdr', 'Packet Delivery Ratio'),
+               ('meanDelay', 'Mean Delivery Delay (s)'),
+               ('overhead', 'Control Bytes per Delivered Byte'),
+               ('halfDepletion', 'Network Lifetime, Half Depleted (s)')]
+    # One line per scenario other than the node count
+    groups = defaultdict(lambda: defaultdict(lambda: defaultdict(list)))
+    for r in results:
+        key = (r['areaSize'], r['nodeSpeedMin'], r['nodeSpeedMax'], r['initialEnergy'],
+               r['forwardingMode'])
+        received = float(r['bytesReceived'])
+        control = float(r['beaconBytes']) + float(r['summaryVectorBytes'])
+        values = dict((m, float(r[m])) for m, _ in metrics if m in r)
+        values['overhead'] = control / received if received > 0 else 0.0
+        for m, _ in metrics:
+            groups[key][m][int(r['nNodes'])].append(values[m])
+
+    fig, axes = plt.subplots(2, 2, figsize=(14, 10))
+    for ax, (m, label) in zip(axes.flat, metrics):
+        for key, series in sorted(groups.items()):
+            nodes = sorted(series[m].keys())
+            means = [np.mean(series[m][n]) for n in nodes]
+            spread = [np.std(series[m][n]) for n in nodes]
+            ax.errorbar(nodes, means, yerr=spread, marker='o', capsize=4, linewidth=2,
+                        label=f'{key[0]} m, {key[1]}-{key[2]} m/s, {key[3]} J, {key[4]}')
+        ax.set_xlabel('Number of Nodes', fontsize=12, fontweight='bold')
+        ax.set_ylabel(label, fontsize=12, fontweight='bold')
+        ax.grid(True, alpha=0.3, linestyle='--')
+    axes.flat[0].legend(fontsize=9)
+    fig.suptitle('Scalability of Energy-Aware Epidemic Routing', fontsize=16, fontweight='bold')
+    fig.tight_layout()
+    fig.savefig(output_file, dpi=300, bbox_inches='tight')
+    print(f"[OK] Graph saved: {output_file}")
+    plt.close(fig)
+
 def plot_energy_consumption(times, node_energy, output_file='energy_consumption.png'):
     """Generate energy consumption graph for all nodes"""
     plt.figure(figsize=(12, 8))
@@ -178,9 +265,21 @@ def main():
     print("Energy-Aware Epidemic Routing - Graph Generation")
     print("=" * 60)
     
-    # Parse log file
+    # A results file of epidemic-sweep.py only makes the scalability graph
+    if os.path.exists(log_file):
+        results = parse_sweep_results(log_file)
+        if results is not None:
+            print(f"\nParsing sweep results: {log_file} ({len(results)} runs)")
+            plot_scalability(results)
+            return
+
+    # Parse log file, preferring routing table snapshots when it has them
     print(f"\nParsing log file: {log_file}")
-    times, node_energy = parse_energy_log(log_file)
+    snapshots = parse_snapshot_log(log_file)
+    if snapshots:
+        times, node_energy = snapshot_energy(snapshots)
+    else:
+        times, node_energy = parse_energy_log(log_file)
     
     if times is None:
         print("Error: Could not parse log file")
@@ -6,9 +6,15 @@
 #include "energy-aware-epidemic-helper.h"
 #include "ns3/energy-aware-epidemic-routing.h"
 #include "ns3/basic-energy-source-helper.h"
+#include "ns3/basic-energy-harvester-helper.h"
 #include "ns3/wifi-radio-energy-model-helper.h"
 #include "ns3/energy-source-container.h"
+#include "ns3/ipv4.h"
+#include "ns3/ipv4-list-routing.h"
 #include "ns3/log.h"
+#include "ns3/string.h"
+#include "ns3/uinteger.h"
+#include <sstream>
 
 namespace ns3 {
 
@@ -18,9 +24,7 @@ EnergyAwareEpidemicHelper::EnergyAwareEpidemicHelper ()
   : Ipv4RoutingHelper (),
     m_initialEnergy (1000.0),
     m_harvestingRate (0.0),
-    m_energyMonitoring (false),
-    m_lowThreshold (0.2),
-    m_criticalThreshold (0.1)
+    m_energyMonitoring (false)
 {
   NS_LOG_FUNCTION (this);
   // Set the factory to create EnergyAwareRoutingProtocol
@@ -44,29 +48,64 @@ EnergyAwareEpidemicHelper::Create (Ptr<Node> node) const
 {
   NS_LOG_FUNCTION (this << node);
 
-  // Create the energy-aware routing protocol
-  Ptr<Epidemic::EnergyAwareRoutingProtocol> agent =
-    m_agentFactory.Create<Epidemic::EnergyAwareRoutingProtocol> ();
+  // InstallWithEnergy may have created and bound the agent already
+  Ptr<Epidemic::EnergyAwareRoutingProtocol> existing =
+    node->GetObject<Epidemic::EnergyAwareRoutingProtocol> ();
+  if (existing)
+    {
+      return existing;
+    }
 
   // Get existing energy source from node (should be installed by example code)
   // Energy sources are stored in an EnergySourceContainer aggregated to the node
+  Ptr<energy::EnergySource> energySource;
   Ptr<energy::EnergySourceContainer> energySourceContainer = node->GetObject<energy::EnergySourceContainer> ();
   if (energySourceContainer && energySourceContainer->GetN () > 0)
     {
       // Get the first energy source from the container
-      Ptr<energy::EnergySource> energySource = energySourceContainer->Get (0);
+      energySource = energySourceContainer->Get (0);
       NS_LOG_DEBUG ("Found existing energy source on node " << node->GetId ());
-      // Set energy source in the routing protocol
-      agent->SetEnergySource (energySource);
     }
   else
     {
       NS_LOG_WARN ("No energy source found on node " << node->GetId ());
     }
+  return CreateAgent (node, energySource);
+}
 
-  // Set energy thresholds
-  agent->SetAttribute ("EnergyThresholdLow", DoubleValue (m_lowThreshold));
-  agent->SetAttribute ("EnergyThresholdCritical", DoubleValue (m_criticalThreshold));
+Ptr<Epidemic::EnergyAwareRoutingProtocol>
+EnergyAwareEpidemicHelper::CreateAgent (Ptr<Node> node, Ptr<energy::EnergySource> source) const
+{
+  NS_LOG_FUNCTION (this << node << source);
+
+  // A node has one agent, whichever of InstallWithEnergy and the internet
+  // stack asks for it first
+  Ptr<Epidemic::EnergyAwareRoutingProtocol> agent =
+    node->GetObject<Epidemic::EnergyAwareRoutingProtocol> ();
+  if (agent)
+    {
+      if (source)
+        {
+          agent->SetEnergySource (source);
+        }
+      return agent;
+    }
+
+  // The energy thresholds are set on the factory, not per agent
+  agent = m_agentFactory.Create<Epidemic::EnergyAwareRoutingProtocol> ();
+  if (source)
+    {
+      agent->SetEnergySource (source);
+    }
+  agent->SetPolicies (m_policies);
+
+  if (m_energyMonitoring)
+    {
+      agent->TraceConnectWithoutContext ("EnergyDepleted",
+                                         MakeBoundCallback (&EnergyAwareEpidemicHelper::EnergyDepletionCallback, node));
+      agent->TraceConnectWithoutContext ("EnergyRecharged",
+                                         MakeBoundCallback (&EnergyAwareEpidemicHelper::EnergyRechargeCallback, node));
+    }
 
   node->AggregateObject (agent);
   return agent;
@@ -86,25 +125,68 @@ EnergyAwareEpidemicHelper::SetEnergyHarvestingRate (double rate)
   m_harvestingRate = rate;
 }
 
-void
-EnergyAwareEpidemicHelper::InstallWithEnergy (NodeContainer nodes)
+energy::EnergyHarvesterContainer
+EnergyAwareEpidemicHelper::InstallEnergyHarvesters (energy::EnergySourceContainer sources) const
 {
   NS_LOG_FUNCTION (this);
-  
-  for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+  if (m_harvestingRate <= 0.0)
     {
-      Ptr<Node> node = *i;
-      
-      // Install energy source
-      Ptr<energy::EnergySource> energySource = InstallEnergySource (node);
-      
-      // Create and install routing protocol
-      Ptr<Ipv4RoutingProtocol> protocol = Create (node);
-      
-      // Note: Energy monitoring is handled via periodic checks in the example code
-      // EnergySource doesn't provide direct callback interfaces - monitoring is done
-      // by querying energy levels periodically
+      return energy::EnergyHarvesterContainer ();
     }
+  std::ostringstream power;
+  power << "ns3::UniformRandomVariable[Min=0.0|Max=" << 2 * m_harvestingRate << "]";
+  BasicEnergyHarvesterHelper harvesterHelper;
+  // A new harvested power every second
+  harvesterHelper.Set ("PeriodicHarvestedPowerUpdateInterval", TimeValue (Seconds (1)));
+  harvesterHelper.Set ("HarvestablePower", StringValue (power.str ()));
+  return harvesterHelper.Install (sources);
+}
+
+energy::EnergySourceContainer
+EnergyAwareEpidemicHelper::InstallEnergySources (NodeContainer nodes) const
+{
+  NS_LOG_FUNCTION (this << nodes.GetN ());
+  BasicEnergySourceHelper basicSourceHelper;
+  basicSourceHelper.Set ("BasicEnergySourceInitialEnergyJ", DoubleValue (m_initialEnergy));
+  energy::EnergySourceContainer sources = basicSourceHelper.Install (nodes);
+  InstallEnergyHarvesters (sources);
+  return sources;
+}
+
+energy::EnergySourceContainer
+EnergyAwareEpidemicHelper::InstallWithEnergy (NodeContainer nodes)
+{
+  NS_LOG_FUNCTION (this << nodes.GetN ());
+  energy::EnergySourceContainer sources = InstallEnergySources (nodes);
+  // One source per node, in node order
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      // Depletion and recharge are reported by the routing protocol, whose
+      // EnergyDepleted and EnergyRecharged traces CreateAgent () connects
+      // when energy monitoring is enabled
+      Ptr<Epidemic::EnergyAwareRoutingProtocol> agent = CreateAgent (nodes.Get (i), sources.Get (i));
+      // Nodes without internet stack get their agent from Create () when
+      // it is installed with this helper as routing helper
+      Ptr<Ipv4> ipv4 = nodes.Get (i)->GetObject<Ipv4> ();
+      if (ipv4 && ipv4->GetRoutingProtocol () != agent)
+        {
+          ipv4->SetRoutingProtocol (agent);
+        }
+    }
+  return sources;
+}
+
+Ptr<EpidemicCsvTracer>
+EnergyAwareEpidemicHelper::EnableCsvTracing (std::string filename, NodeContainer nodes,
+                                             Time interval, uint32_t packetSampling) const
+{
+  NS_LOG_FUNCTION (this << filename << interval << packetSampling);
+  Ptr<EpidemicCsvTracer> tracer = CreateObject<EpidemicCsvTracer> ();
+  tracer->SetAttribute ("SampleInterval", TimeValue (interval));
+  tracer->SetAttribute ("PacketSampling", UintegerValue (packetSampling));
+  tracer->Open (filename);
+  tracer->Install (nodes);
+  return tracer;
 }
 
 void
@@ -118,8 +200,15 @@ void
 EnergyAwareEpidemicHelper::SetEnergyThresholds (double lowThreshold, double criticalThreshold)
 {
   NS_LOG_FUNCTION (this << lowThreshold << criticalThreshold);
-  m_lowThreshold = lowThreshold;
-  m_criticalThreshold = criticalThreshold;
+  m_agentFactory.Set ("EnergyThresholdLow", DoubleValue (lowThreshold));
+  m_agentFactory.Set ("EnergyThresholdCritical", DoubleValue (criticalThreshold));
+}
+
+void
+EnergyAwareEpidemicHelper::SetPolicies (const Epidemic::PolicySet &policies)
+{
+  NS_LOG_FUNCTION (this);
+  m_policies = policies;
 }
 
 void
@@ -129,28 +218,52 @@ EnergyAwareEpidemicHelper::Set (std::string name, const AttributeValue &value)
   m_agentFactory.Set (name, value);
 }
 
-Ptr<energy::EnergySource>
-EnergyAwareEpidemicHelper::InstallEnergySource (Ptr<Node> node) const
+int64_t
+EnergyAwareEpidemicHelper::AssignStreams (NodeContainer c, int64_t stream)
 {
-  NS_LOG_FUNCTION (this << node);
-  
-  // Create basic energy source
-  BasicEnergySourceHelper basicSourceHelper;
-  basicSourceHelper.Set ("BasicEnergySourceInitialEnergyJ", DoubleValue (m_initialEnergy));
-  
-  if (m_harvestingRate > 0.0)
+  NS_LOG_FUNCTION (this << stream);
+  int64_t currentStream = stream;
+  Ptr<Node> node;
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
     {
-      basicSourceHelper.Set ("BasicEnergyHarvestingCurrentA", DoubleValue (m_harvestingRate / 3.3));
+      node = (*i);
+      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+      NS_ASSERT_MSG (ipv4, "Ipv4 not installed on node");
+      Ptr<Ipv4RoutingProtocol> proto = ipv4->GetRoutingProtocol ();
+      NS_ASSERT_MSG (proto, "Ipv4 routing not installed on node");
+      Ptr<Epidemic::EnergyAwareRoutingProtocol> epidemic =
+        DynamicCast<Epidemic::EnergyAwareRoutingProtocol> (proto);
+      if (epidemic)
+        {
+          currentStream += epidemic->AssignStreams (currentStream);
+          continue;
+        }
+      // Epidemic may also be in a list
+      Ptr<Ipv4ListRouting> list = DynamicCast<Ipv4ListRouting> (proto);
+      if (list)
+        {
+          int16_t priority;
+          Ptr<Ipv4RoutingProtocol> listProto;
+          Ptr<Epidemic::EnergyAwareRoutingProtocol> listEpidemic;
+          for (uint32_t j = 0; j < list->GetNRoutingProtocols (); j++)
+            {
+              listProto = list->GetRoutingProtocol (j, priority);
+              listEpidemic = DynamicCast<Epidemic::EnergyAwareRoutingProtocol> (listProto);
+              if (listEpidemic)
+                {
+                  currentStream += listEpidemic->AssignStreams (currentStream);
+                  break;
+                }
+            }
+        }
     }
-  
-  energy::EnergySourceContainer sources = basicSourceHelper.Install (node);
-  return sources.Get (0);
+  return (currentStream - stream);
 }
 
 void
 EnergyAwareEpidemicHelper::EnergyDepletionCallback (Ptr<Node> node)
 {
-  NS_LOG_FUNCTION (this << node);
+  NS_LOG_FUNCTION (node);
   NS_LOG_WARN ("Node " << node->GetId () << " energy depleted at time " 
                << Simulator::Now ().GetSeconds () << " seconds");
 }
@@ -158,7 +271,7 @@ EnergyAwareEpidemicHelper::EnergyDepletionCallback (Ptr<Node> node)
 void
 EnergyAwareEpidemicHelper::EnergyRechargeCallback (Ptr<Node> node)
 {
-  NS_LOG_FUNCTION (this << node);
+  NS_LOG_FUNCTION (node);
   NS_LOG_INFO ("Node " << node->GetId () << " energy recharged at time " 
                << Simulator::Now ().GetSeconds () << " seconds");
 }
@@ -6,6 +6,9 @@
 #ifndef ENERGY_AWARE_EPIDEMIC_HELPER_H
 #define ENERGY_AWARE_EPIDEMIC_HELPER_H
 
+#include "epidemic-csv-tracer.h"
+#include "ns3/energy-aware-epidemic-routing.h"
+#include "ns3/epidemic-policy.h"
 #include "ns3/ipv4-routing-helper.h"
 #include "ns3/energy-module.h"
 #include "ns3/node-container.h"
@@ -39,29 +42,93 @@ public:
 
   /**
    * \brief Set energy harvesting rate
-   * \param rate Energy harvesting rate in Watts
+   *
+   * A positive rate makes InstallWithEnergy () connect a harvester to each
+   * energy source it installs.
+   * \param rate Mean harvested power in Watts
    */
   void SetEnergyHarvestingRate (double rate);
 
+  /**
+   * \brief Connect an energy harvester to each energy source
+   *
+   * Installs a BasicEnergyHarvester whose power is drawn every second
+   * uniformly between 0 and twice the harvesting rate, a coarse model of
+   * a solar panel under passing clouds.
+   * \param sources Energy sources to harvest for
+   * \return The installed harvesters, empty if the harvesting rate is 0
+   */
+  energy::EnergyHarvesterContainer InstallEnergyHarvesters (energy::EnergySourceContainer sources) const;
+
+  /**
+   * \brief Install a BasicEnergySource of the initial energy on each node
+   *
+   * Configures one source helper for the whole container, and connects
+   * the harvesters when the harvesting rate is positive.
+   * \param nodes Container of nodes to install on
+   * \return The installed sources, in the order of \p nodes
+   */
+  energy::EnergySourceContainer InstallEnergySources (NodeContainer nodes) const;
+
   /**
    * \brief Install energy sources and routing protocol
+   *
+   * Installs the sources of all the nodes in one call, then creates the
+   * routing protocols bound to them in a single pass.  On nodes with an
+   * internet stack the protocol becomes the routing protocol of their
+   * Ipv4; on the others Create () hands it over once an InternetStackHelper
+   * is installed with this helper as routing helper.
    * \param nodes Container of nodes to install on
+   * \return The installed sources, in the order of \p nodes
    */
-  void InstallWithEnergy (NodeContainer nodes);
+  energy::EnergySourceContainer InstallWithEnergy (NodeContainer nodes);
 
   /**
    * \brief Enable energy monitoring and logging
+   *
+   * Connects the depletion and recharge notifications of the routing
+   * protocols created afterwards to log messages.
    * \param enable True to enable energy monitoring
    */
   void EnableEnergyMonitoring (bool enable);
 
+  /**
+   * \brief Stream a compact CSV trace of energy and sampled packets
+   *
+   * Call after the internet stack is installed on \p nodes, and keep the
+   * returned tracer until the simulation is destroyed.
+   * \param filename Name of the trace file
+   * \param nodes Nodes to trace
+   * \param interval Period of the energy records
+   * \param packetSampling One packet record out of this many packets, 0 for none
+   * \return The tracer, which writes its remaining records when disposed
+   */
+  Ptr<EpidemicCsvTracer> EnableCsvTracing (std::string filename, NodeContainer nodes,
+                                           Time interval, uint32_t packetSampling) const;
+
   /**
    * \brief Set energy thresholds
+   *
+   * Sets the EnergyThresholdLow and EnergyThresholdCritical attributes of
+   * the protocols created afterwards.
    * \param lowThreshold Low energy threshold (0.0-1.0)
    * \param criticalThreshold Critical energy threshold (0.0-1.0)
    */
   void SetEnergyThresholds (double lowThreshold, double criticalThreshold);
 
+  /**
+   * \brief Set the per-packet policies of the protocols created afterwards
+   *
+   * For example, to benchmark plain flooding against the default energy
+   * aware forwarding:
+   * \code
+   *   helper.SetPolicies (Epidemic::MakePolicySet<Epidemic::FloodForwarding,
+   *                                                Epidemic::UnlimitedEnergyBudget> ());
+   * \endcode
+   * \param policies Forwarding, energy budget and eviction policies
+   */
+  void SetPolicies (const Epidemic::PolicySet &policies);
+
   /**
    * \brief Set attributes by name
    * \param name the name of the attribute to set
@@ -69,32 +136,50 @@ public:
    */
   void Set (std::string name, const AttributeValue &value);
 
+  /**
+   * Assign a fixed random variable stream number to the random variables
+   * used by the energy-aware epidemic routing protocols installed on the
+   * nodes in \p c.  Return the number of streams (possibly zero) that have
+   * been assigned.  The Install() method of the InternetStackHelper should
+   * have previously been called by the user.
+   *
+   * \param c NodeContainer of the set of nodes for which the protocols
+   *          should be modified to use a fixed stream
+   * \param stream first stream index to use
+   * \return the number of stream indices assigned by this helper
+   */
+  int64_t AssignStreams (NodeContainer c, int64_t stream);
+
 private:
   ObjectFactory m_agentFactory;  ///< The factory to create routing objects
   double m_initialEnergy;        ///< Initial energy per node (Joules)
   double m_harvestingRate;       ///< Energy harvesting rate (Watts)
   bool m_energyMonitoring;       ///< Enable energy monitoring
-  double m_lowThreshold;         ///< Low energy threshold
-  double m_criticalThreshold;    ///< Critical energy threshold
+  Epidemic::PolicySet m_policies; ///< Per-packet policies of the created protocols
 
   /**
-   * \brief Install energy source on a node
-   * \param node Node to install energy source on
-   * \return Pointer to installed energy source
+   * \brief Create a routing protocol and aggregate it to a node
+   *
+   * Binds \p source to the protocol already aggregated to \p node instead,
+   * if there is one.
+   * \param node Node of the protocol
+   * \param source Energy source of the node, or 0 if it has none
+   * \return The routing protocol
    */
-  Ptr<energy::EnergySource> InstallEnergySource (Ptr<Node> node) const;
+  Ptr<Epidemic::EnergyAwareRoutingProtocol> CreateAgent (Ptr<Node> node,
+                                                         Ptr<energy::EnergySource> source) const;
 
   /**
-   * \brief Energy depletion callback
+   * \brief Energy depletion callback, sink of the EnergyDepleted trace
    * \param node Node that depleted energy
    */
-  void EnergyDepletionCallback (Ptr<Node> node);
+  static void EnergyDepletionCallback (Ptr<Node> node);
 
   /**
-   * \brief Energy recharge callback
+   * \brief Energy recharge callback, sink of the EnergyRecharged trace
    * \param node Node that recharged energy
    */
-  void EnergyRechargeCallback (Ptr<Node> node);
+  static void EnergyRechargeCallback (Ptr<Node> node);
 };
 
 } // namespace ns3
@@ -0,0 +1,193 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Streaming CSV tracer for Energy-Aware Epidemic Routing Implementation
+ */
+
+#include "epidemic-csv-tracer.h"
+#include "ns3/energy-aware-epidemic-routing.h"
+#include "ns3/energy-source-container.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include <cstdio>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("EpidemicCsvTracer");
+
+NS_OBJECT_ENSURE_REGISTERED (EpidemicCsvTracer);
+
+TypeId
+EpidemicCsvTracer::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::EpidemicCsvTracer")
+    .SetParent<Object> ()
+    .SetGroupName ("Epidemic")
+    .AddConstructor<EpidemicCsvTracer> ()
+    .AddAttribute ("SampleInterval",
+                   "Period of the energy records of every node.",
+                   TimeValue (Seconds (10)),
+                   MakeTimeAccessor (&EpidemicCsvTracer::m_sampleInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("PacketSampling",
+                   "One packet record is written out of this many IPv4 packets "
+                   "sent or received. 0 writes no packet records.",
+                   UintegerValue (100),
+                   MakeUintegerAccessor (&EpidemicCsvTracer::m_packetSampling),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("BufferSize",
+                   "Bytes of records buffered before they are written to the file.",
+                   UintegerValue (64 * 1024),
+                   MakeUintegerAccessor (&EpidemicCsvTracer::m_bufferSize),
+                   MakeUintegerChecker<uint32_t> ());
+  return tid;
+}
+
+EpidemicCsvTracer::EpidemicCsvTracer ()
+  : m_bufferSize (64 * 1024),
+    m_sampleInterval (Seconds (10)),
+    m_packetSampling (100),
+    m_packets (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+EpidemicCsvTracer::~EpidemicCsvTracer ()
+{
+  NS_LOG_FUNCTION (this);
+  Flush ();
+}
+
+void
+EpidemicCsvTracer::Open (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  m_file.open (filename.c_str (), std::ios::out | std::ios::trunc);
+  NS_ABORT_MSG_UNLESS (m_file.is_open (), "Cannot open trace file " << filename);
+  m_buffer.reserve (m_bufferSize + 128);
+  m_buffer += "# E,time_s,node,remaining_j,energy_ratio,effective_ratio,state,depleted\n"
+    "# P,time_s,node,direction,uid,bytes\n";
+}
+
+void
+EpidemicCsvTracer::Install (NodeContainer nodes)
+{
+  NS_LOG_FUNCTION (this << nodes.GetN ());
+  for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+    {
+      m_nodes.Add (*i);
+      Ptr<Ipv4L3Protocol> ipv4 = (*i)->GetObject<Ipv4L3Protocol> ();
+      if (!ipv4 || m_packetSampling == 0)
+        {
+          continue;
+        }
+      ipv4->TraceConnectWithoutContext ("Tx", MakeCallback (&EpidemicCsvTracer::Ipv4Tx, this));
+      ipv4->TraceConnectWithoutContext ("Rx", MakeCallback (&EpidemicCsvTracer::Ipv4Rx, this));
+    }
+  if (!m_sampleEvent.IsPending () && m_sampleInterval.IsStrictlyPositive ())
+    {
+      m_sampleEvent = Simulator::Schedule (Seconds (0), &EpidemicCsvTracer::Sample, this);
+    }
+}
+
+void
+EpidemicCsvTracer::Sample ()
+{
+  NS_LOG_FUNCTION (this);
+  double now = Simulator::Now ().GetSeconds ();
+  char record[160];
+  for (NodeContainer::Iterator i = m_nodes.Begin (); i != m_nodes.End (); ++i)
+    {
+      Ptr<Node> node = *i;
+      double remaining = 0.0;
+      Ptr<energy::EnergySourceContainer> sources = node->GetObject<energy::EnergySourceContainer> ();
+      if (sources && sources->GetN () > 0)
+        {
+          remaining = sources->Get (0)->GetRemainingEnergy ();
+        }
+      // The helper aggregates the routing protocol to its node
+      Ptr<Epidemic::EnergyAwareRoutingProtocol> routing =
+        node->GetObject<Epidemic::EnergyAwareRoutingProtocol> ();
+      int length = routing
+        ? std::snprintf (record, sizeof (record), "E,%.3f,%u,%.4f,%.4f,%.4f,%d,%d\n", now,
+                         node->GetId (), remaining, routing->GetRemainingEnergyRatio (),
+                         routing->GetEffectiveEnergyRatio (), routing->GetEnergyState (),
+                         routing->IsEnergyDepleted ())
+        : std::snprintf (record, sizeof (record), "E,%.3f,%u,%.4f,,,,\n", now,
+                         node->GetId (), remaining);
+      Append (record, length);
+    }
+  m_sampleEvent = Simulator::Schedule (m_sampleInterval, &EpidemicCsvTracer::Sample, this);
+}
+
+void
+EpidemicCsvTracer::PacketTrace (char direction, Ptr<const Packet> packet, Ptr<Ipv4> ipv4,
+                                uint32_t interface)
+{
+  // PacketSampling may be set to 0 after Install connected the traces
+  if (m_packetSampling == 0 || m_packets++ % m_packetSampling != 0)
+    {
+      return;
+    }
+  Ptr<Node> node = ipv4->GetObject<Node> ();
+  char record[96];
+  int length = std::snprintf (record, sizeof (record), "P,%.6f,%u,%c,%llu,%u\n",
+                              Simulator::Now ().GetSeconds (), node ? node->GetId () : 0,
+                              direction, (unsigned long long) packet->GetUid (),
+                              packet->GetSize ());
+  Append (record, length);
+}
+
+void
+EpidemicCsvTracer::Ipv4Tx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  PacketTrace ('t', packet, ipv4, interface);
+}
+
+void
+EpidemicCsvTracer::Ipv4Rx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  PacketTrace ('r', packet, ipv4, interface);
+}
+
+void
+EpidemicCsvTracer::Append (const char *record, int length)
+{
+  if (length <= 0)
+    {
+      return;
+    }
+  m_buffer.append (record, length);
+  if (m_buffer.size () >= m_bufferSize)
+    {
+      Flush ();
+    }
+}
+
+void
+EpidemicCsvTracer::Flush ()
+{
+  NS_LOG_FUNCTION (this << m_buffer.size ());
+  if (m_file.is_open () && !m_buffer.empty ())
+    {
+      m_file.write (m_buffer.data (), m_buffer.size ());
+      m_file.flush ();
+    }
+  m_buffer.clear ();
+}
+
+void
+EpidemicCsvTracer::DoDispose ()
+{
+  NS_LOG_FUNCTION (this);
+  m_sampleEvent.Cancel ();
+  Flush ();
+  m_file.close ();
+  m_nodes = NodeContainer ();
+  Object::DoDispose ();
+}
+
+} // namespace ns3
@@ -0,0 +1,104 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Streaming CSV tracer for Energy-Aware Epidemic Routing
+ */
+
+#ifndef EPIDEMIC_CSV_TRACER_H
+#define EPIDEMIC_CSV_TRACER_H
+
+#include "ns3/object.h"
+#include "ns3/node-container.h"
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include "ns3/ipv4.h"
+#include <fstream>
+#include <string>
+
+namespace ns3 {
+
+/**
+ * \brief Compact streaming trace of an energy-aware epidemic network
+ *
+ * A lightweight alternative to the NetAnim XML traces for large runs.
+ * Records are appended to an in-memory buffer and written to the file
+ * whenever BufferSize bytes have accumulated, so the simulation does one
+ * write per buffer rather than one per event.  The file has two kinds of
+ * comma separated records:
+ *
+ * - \c E,time,node,remaining_j,energy_ratio,effective_ratio,state,depleted
+ *   for every node every SampleInterval;
+ * - \c P,time,node,direction,uid,bytes for one IPv4 packet out of
+ *   PacketSampling sent (\c t) or received (\c r), none if 0.
+ *
+ * The tracer schedules its samples with a pointer to itself: keep a
+ * reference to it for the duration of the simulation.
+ */
+class EpidemicCsvTracer : public Object
+{
+public:
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  EpidemicCsvTracer ();
+  virtual ~EpidemicCsvTracer ();
+
+  /**
+   * \brief Open the trace file and write the record descriptions
+   * \param filename Name of the trace file
+   */
+  void Open (std::string filename);
+
+  /**
+   * \brief Start tracing the nodes
+   *
+   * Connects to the Tx and Rx traces of the IPv4 stack of each node and
+   * schedules the energy samples; call after the internet stack and the
+   * routing protocols are installed.
+   * \param nodes Nodes to trace
+   */
+  void Install (NodeContainer nodes);
+
+  /// Write the buffered records to the file
+  void Flush ();
+
+protected:
+  virtual void DoDispose () override;
+
+private:
+  /// Append an energy record of every node and schedule the next sample
+  void Sample ();
+  /**
+   * \brief Sink of the Tx and Rx traces of Ipv4L3Protocol
+   * \param direction 't' for sent, 'r' for received
+   * \param packet The packet
+   * \param ipv4 The IPv4 stack of the node
+   * \param interface The interface index
+   */
+  void PacketTrace (char direction, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+  /// Sink of the Tx trace of Ipv4L3Protocol
+  void Ipv4Tx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+  /// Sink of the Rx trace of Ipv4L3Protocol
+  void Ipv4Rx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+  /**
+   * \brief Append a record to the buffer, and flush it once full
+   * \param record The record
+   * \param length The record length
+   */
+  void Append (const char *record, int length);
+
+  std::ofstream m_file;       ///< Trace file
+  std::string m_buffer;       ///< Records not yet written
+  uint32_t m_bufferSize;      ///< Buffered bytes that trigger a write
+  Time m_sampleInterval;      ///< Period of the energy records
+  uint32_t m_packetSampling;  ///< One packet record out of this many, 0 for none
+  uint64_t m_packets;         ///< Packets seen by the IPv4 traces
+  NodeContainer m_nodes;      ///< Traced nodes
+  EventId m_sampleEvent;      ///< Next energy sample
+};
+
+} // namespace ns3
+
+#endif /* EPIDEMIC_CSV_TRACER_H */
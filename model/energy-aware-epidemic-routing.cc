@@ -9,19 +9,31 @@
 #include "ns3/uinteger.h"
 #include "ns3/double.h"
 #include "ns3/boolean.h"
+#include "ns3/enum.h"
 #include "ns3/config.h"
 #include "ns3/inet-socket-address.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/udp-socket-factory.h"
 #include "ns3/udp-header.h"
+#include "ns3/udp-l4-protocol.h"
+#include "ns3/pointer.h"
+#include "ns3/string.h"
 #include "ns3/ipv4-route.h"
 #include "ns3/ipv4-routing-table-entry.h"
 #include "ns3/ipv4-l3-protocol.h"
 #include "ns3/socket.h"
 #include "ns3/output-stream-wrapper.h"
+#include "ns3/node.h"
+#include "ns3/abort.h"
+#include "ns3/trace-source-accessor.h"
 #include <iostream>
+#include <sstream>
 #include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
 #include <functional>
+#include <vector>
 
 namespace ns3 {
 
@@ -47,6 +59,12 @@ EnergyAwareRoutingProtocol::GetTypeId (void)
                    UintegerValue (64),
                    MakeUintegerAccessor (&EnergyAwareRoutingProtocol::m_maxQueueLen),
                    MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("DropPolicy","Packet evicted when the queue is full.",
+                   EnumValue (PacketQueue::DROP_OLDEST),
+                   MakeEnumAccessor<PacketQueue::DropPolicy> (&EnergyAwareRoutingProtocol::m_dropPolicy),
+                   MakeEnumChecker (PacketQueue::DROP_OLDEST, "Oldest",
+                                    PacketQueue::DROP_LOWEST_PRIORITY, "LowestPriority",
+                                    PacketQueue::DROP_LARGEST, "Largest"))
     .AddAttribute ("QueueEntryExpireTime","Maximum time a packet can live in "
                    "the epidemic queues since it's generated at the source.",
                    TimeValue (Seconds (100)),
@@ -62,6 +80,22 @@ EnergyAwareRoutingProtocol::GetTypeId (void)
                    TimeValue (Seconds (1)),
                    MakeTimeAccessor (&EnergyAwareRoutingProtocol::m_beaconInterval),
                    MakeTimeChecker ())
+    .AddAttribute ("MinBeaconInterval","Lower bound of the adaptive "
+                   "beacon interval.",
+                   TimeValue (MilliSeconds (500)),
+                   MakeTimeAccessor (&EnergyAwareRoutingProtocol::m_minBeaconInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxBeaconInterval","Upper bound of the adaptive "
+                   "beacon interval. A neighbor is counted while its last "
+                   "beacon is more recent than this.",
+                   TimeValue (Seconds (10)),
+                   MakeTimeAccessor (&EnergyAwareRoutingProtocol::m_maxBeaconInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("TargetNeighbors","Number of neighbors above which the "
+                   "beacon interval grows with the neighbor density. 0 disables it.",
+                   UintegerValue (4),
+                   MakeUintegerAccessor (&EnergyAwareRoutingProtocol::m_targetNeighbors),
+                   MakeUintegerChecker<uint32_t> ())
     .AddAttribute ("BeaconRandomness","Upper bound of the uniform distribution"
                    " random time added to avoid collisions. Measured in milliseconds",
                    UintegerValue (100),
@@ -77,44 +111,248 @@ EnergyAwareRoutingProtocol::GetTypeId (void)
                    DoubleValue (0.1),
                    MakeDoubleAccessor (&EnergyAwareRoutingProtocol::m_energyThresholdCritical),
                    MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("EnergyUpdateInterval",
+                   "Period at which the remaining energy ratio is refreshed when "
+                   "the energy source has no RemainingEnergy trace source.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&EnergyAwareRoutingProtocol::m_energyUpdateInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("HarvestHorizon",
+                   "Energy the node expects to harvest over this horizon, at its "
+                   "current net gain, is added to its energy ratio before the "
+                   "energy thresholds are applied. 0 ignores harvesting.",
+                   TimeValue (Seconds (60)),
+                   MakeTimeAccessor (&EnergyAwareRoutingProtocol::m_harvestHorizon),
+                   MakeTimeChecker ())
+    .AddAttribute ("LowEnergyQueueFactor",
+                   "Fraction of QueueLength kept when energy is low; the "
+                   "square of it is kept when energy is critical.",
+                   DoubleValue (0.5),
+                   MakeDoubleAccessor (&EnergyAwareRoutingProtocol::m_lowEnergyQueueFactor),
+                   MakeDoubleChecker<double> (0.0, 1.0))
     .AddAttribute ("EnergyAwareFloodingFactor",
                    "Factor to reduce flooding when energy is low",
                    DoubleValue (0.5),
                    MakeDoubleAccessor (&EnergyAwareRoutingProtocol::m_energyAwareFloodingFactor),
                    MakeDoubleChecker<double> (0.1, 1.0))
-    .AddAttribute ("SpeechPacketPriority",
-                   "Priority level for speech packets (higher = more priority)",
-                   UintegerValue (10),
-                   MakeUintegerAccessor (&EnergyAwareRoutingProtocol::m_speechPacketPriority),
-                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("CriticalTrafficClass",
+                   "Lowest traffic class still forwarded and buffered when "
+                   "energy is critical.",
+                   EnumValue (EpidemicHeader::VOICE),
+                   MakeEnumAccessor<EpidemicHeader::TrafficClass> (&EnergyAwareRoutingProtocol::m_criticalTrafficClass),
+                   MakeEnumChecker (EpidemicHeader::BULK, "Bulk",
+                                    EpidemicHeader::VOICE, "Voice",
+                                    EpidemicHeader::ALERT, "Alert"))
     .AddAttribute ("CompressionRatio",
-                   "Dynamic compression ratio for multimedia packets",
+                   "Largest compressed to original transmission cost ratio for "
+                   "which a packet originated at low energy is sent compressed.",
                    DoubleValue (0.8),
                    MakeDoubleAccessor (&EnergyAwareRoutingProtocol::m_compressionRatio),
-                   MakeDoubleChecker<double> (0.1, 1.0));
+                   MakeDoubleChecker<double> (0.1, 1.0))
+    .AddAttribute ("DataCodec",
+                   "Codec of bulk and alert payloads originated at low energy. "
+                   "An LzPayloadCodec if not set.",
+                   PointerValue (),
+                   MakePointerAccessor (&EnergyAwareRoutingProtocol::m_dataCodec),
+                   MakePointerChecker<PayloadCodec> ())
+    .AddAttribute ("VoiceCodec",
+                   "Codec of voice payloads originated at low energy. "
+                   "A DownsamplePayloadCodec if not set.",
+                   PointerValue (),
+                   MakePointerAccessor (&EnergyAwareRoutingProtocol::m_voiceCodec),
+                   MakePointerChecker<PayloadCodec> ())
+    .AddAttribute ("SummaryVectorEncoding",
+                   "Encoding of summary vectors in REPLY packets. Replies back "
+                   "always mirror the encoding of the received reply. The "
+                   "encoding is not negotiated: Compact requires every node "
+                   "to understand the compact message types.",
+                   EnumValue (SummaryVectorHeader::PLAIN),
+                   MakeEnumAccessor<SummaryVectorHeader::Encoding> (&EnergyAwareRoutingProtocol::m_summaryVectorEncoding),
+                   MakeEnumChecker (SummaryVectorHeader::PLAIN, "Plain",
+                                    SummaryVectorHeader::COMPACT, "Compact"))
+    .AddAttribute ("BundleMtu",
+                   "Maximum size in bytes of the IP datagram of a frame bundling "
+                   "the packets sent to a neighbor during a contact, IPv4 and UDP "
+                   "headers included. 0 sends every packet on its own.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&EnergyAwareRoutingProtocol::m_bundleMtu),
+                   MakeUintegerChecker<uint32_t> (0, 65535))
+    .AddAttribute ("ForwardingMode",
+                   "Epidemic hands a copy of a packet to every neighbor missing it; "
+                   "SprayAndWait bounds the copies of a packet by SprayCopies.",
+                   EnumValue (EnergyAwareRoutingProtocol::FORWARD_EPIDEMIC),
+                   MakeEnumAccessor<EnergyAwareRoutingProtocol::ForwardingMode> (&EnergyAwareRoutingProtocol::m_forwardingMode),
+                   MakeEnumChecker (EnergyAwareRoutingProtocol::FORWARD_EPIDEMIC, "Epidemic",
+                                    EnergyAwareRoutingProtocol::FORWARD_SPRAY_AND_WAIT, "SprayAndWait"))
+    .AddAttribute ("SprayCopies",
+                   "Copies of a packet originated at full energy in SprayAndWait "
+                   "mode; scaled down with the remaining energy ratio.",
+                   UintegerValue (8),
+                   MakeUintegerAccessor (&EnergyAwareRoutingProtocol::m_sprayCopies),
+                   MakeUintegerChecker<uint16_t> (1))
+    .AddAttribute ("CustodyTransfer",
+                   "At or below EnergyThresholdLow, hand the buffered packets "
+                   "over to the neighbor advertising the most energy in its "
+                   "beacons, and drop them once its summary vector lists them.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&EnergyAwareRoutingProtocol::m_custodyTransfer),
+                   MakeBooleanChecker ())
+    .AddAttribute ("ImmunityListSize",
+                   "Maximum number of delivered packet IDs a node remembers and "
+                   "advertises in its beacons, so that other nodes drop their "
+                   "copies. 0 disables delivery acknowledgements.",
+                   UintegerValue (128),
+                   MakeUintegerAccessor (&EnergyAwareRoutingProtocol::m_immunityListSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("DuplicateFilterSize",
+                   "Bits per generation of the filter of packet IDs a relay "
+                   "took a decision on within QueueEntryExpireTime, which "
+                   "keeps it from buffering them again once evicted. 0 "
+                   "disables the filter.",
+                   UintegerValue (8192),
+                   MakeUintegerAccessor (&EnergyAwareRoutingProtocol::m_duplicateFilterSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("RoutingTableFormat",
+                   "Output of PrintRoutingTable: a Text report, or a one-line "
+                   "Csv or Json snapshot of energy, buffer, beacon interval and "
+                   "contacts meant for frequent dumps and scripts.",
+                   EnumValue (EnergyAwareRoutingProtocol::ROUTING_TABLE_TEXT),
+                   MakeEnumAccessor<EnergyAwareRoutingProtocol::RoutingTableFormat> (&EnergyAwareRoutingProtocol::m_routingTableFormat),
+                   MakeEnumChecker (EnergyAwareRoutingProtocol::ROUTING_TABLE_TEXT, "Text",
+                                    EnergyAwareRoutingProtocol::ROUTING_TABLE_CSV, "Csv",
+                                    EnergyAwareRoutingProtocol::ROUTING_TABLE_JSON, "Json"))
+    .AddAttribute ("DefaultTxCurrent",
+                   "TX current in A used in transmission costs when the energy "
+                   "source has no WifiRadioEnergyModel.",
+                   DoubleValue (0.0174),
+                   MakeDoubleAccessor (&EnergyAwareRoutingProtocol::m_defaultTxCurrent),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("DefaultPhyDataRate",
+                   "PHY data rate used in transmission costs when it cannot be "
+                   "read from the DataMode of the wifi station manager.",
+                   DataRateValue (DataRate ("1Mbps")),
+                   MakeDataRateAccessor (&EnergyAwareRoutingProtocol::m_defaultPhyDataRate),
+                   MakeDataRateChecker ())
+    .AddAttribute ("FrameOverhead",
+                   "Airtime of the PHY preamble, MAC header, interframe spaces "
+                   "and ACK of a frame, used in transmission costs.",
+                   TimeValue (MicroSeconds (500)),
+                   MakeTimeAccessor (&EnergyAwareRoutingProtocol::m_frameOverhead),
+                   MakeTimeChecker ())
+    .AddTraceSource ("EnergyStateChanged",
+                     "The effective energy ratio crossed EnergyThresholdLow "
+                     "or EnergyThresholdCritical.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_energyStateChangedTrace),
+                     "ns3::Epidemic::EnergyAwareRoutingProtocol::EnergyStateChangedCallback")
+    .AddTraceSource ("EnergyDepleted",
+                     "The energy source fell to its low battery threshold; "
+                     "beacons are paused.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_energyDepletedTrace),
+                     "ns3::TracedCallback::Void")
+    .AddTraceSource ("EnergyRecharged",
+                     "The energy source recovered above its high battery "
+                     "threshold; beacons are resumed.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_energyRechargedTrace),
+                     "ns3::TracedCallback::Void")
+    .AddTraceSource ("BeaconSent",
+                     "A beacon was broadcast.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_beaconSentTrace),
+                     "ns3::Packet::TracedCallback")
+    .AddTraceSource ("BeaconSkipped",
+                     "A beacon was skipped at critically low energy.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_beaconSkippedTrace),
+                     "ns3::TracedCallback::Void")
+    .AddTraceSource ("SummaryVectorSent",
+                     "A REPLY or REPLY_BACK summary vector was sent.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_summaryVectorSentTrace),
+                     "ns3::Packet::TracedCallback")
+    .AddTraceSource ("DataSent",
+                     "A buffered packet missing from a summary vector was "
+                     "handed to the neighbor, alone or in a bundle.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_dataSentTrace),
+                     "ns3::Epidemic::EnergyAwareRoutingProtocol::DataSentCallback")
+    .AddTraceSource ("QueueDrop",
+                     "A packet left the buffer without being delivered here.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_queueDropTrace),
+                     "ns3::Epidemic::EnergyAwareRoutingProtocol::QueueDropCallback")
+    .AddTraceSource ("EnergyRejected",
+                     "A packet was not buffered or not sent for lack of energy.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_energyRejectedTrace),
+                     "ns3::Packet::TracedCallback")
+    .AddTraceSource ("Delivery",
+                     "A packet addressed to this node was delivered, with the "
+                     "delay since its origination.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_deliveryTrace),
+                     "ns3::Epidemic::EnergyAwareRoutingProtocol::DeliveryCallback")
+    .AddTraceSource ("CustodyTransfer",
+                     "Buffered packets handed over to a richer neighbor were "
+                     "listed in its summary vector and dropped here.",
+                     MakeTraceSourceAccessor (&EnergyAwareRoutingProtocol::m_custodyTransferTrace),
+                     "ns3::Epidemic::EnergyAwareRoutingProtocol::CustodyTransferCallback");
   return tid;
 }
 
 EnergyAwareRoutingProtocol::EnergyAwareRoutingProtocol ()
   : m_hopCount (0),
     m_maxQueueLen (0),
+    m_dropPolicy (PacketQueue::DROP_OLDEST),
     m_queueEntryExpireTime (Seconds (0)),
     m_beaconInterval (Seconds (0)),
     m_hostRecentPeriod (Seconds (0)),
     m_beaconMaxJitterMs (0),
+    m_minBeaconInterval (MilliSeconds (500)),
+    m_maxBeaconInterval (Seconds (10)),
+    m_targetNeighbors (4),
     m_dataPacketCounter (0),
     m_queue (m_maxQueueLen),
+    m_expiryTimer (Timer::CANCEL_ON_DESTROY),
+    m_beaconTimer (Timer::CANCEL_ON_DESTROY),
+    m_newPacketCount (0),
+    m_packetArrivalRate (0),
     m_energySource (nullptr),
     m_energyThresholdLow (0.2),
     m_energyThresholdCritical (0.1),
+    m_energyRatio (1.0),
+    m_effectiveEnergyRatio (1.0),
+    m_energyState (ENERGY_NORMAL),
+    m_energyUpdateInterval (Seconds (1)),
+    m_energyUpdateTimer (Timer::CANCEL_ON_DESTROY),
+    m_energyTraceConnected (false),
+    m_depletionThreshold (0.0),
+    m_rechargeThreshold (0.0),
+    m_depleted (false),
+    m_harvestHorizon (Seconds (60)),
+    m_netPower (0.0),
+    m_lastRemainingEnergy (0.0),
     m_energyAwareFloodingFactor (0.5),
-    m_speechPacketPriority (10),
-    m_compressionRatio (0.8)
+    m_lowEnergyQueueFactor (0.5),
+    m_criticalTrafficClass (EpidemicHeader::VOICE),
+    m_compressionRatio (0.8),
+    m_defaultTxCurrent (0.0174),
+    m_defaultPhyDataRate (DataRate ("1Mbps")),
+    m_frameOverhead (MicroSeconds (500)),
+    m_summaryVectorEncoding (SummaryVectorHeader::PLAIN),
+    m_bundleMtu (0),
+    m_forwardingMode (FORWARD_EPIDEMIC),
+    m_sprayCopies (8),
+    m_custodyTransfer (false),
+    m_immunityListSize (128),
+    m_duplicateFilterSize (8192),
+    m_routingTableFormat (ROUTING_TABLE_TEXT),
+    m_interfaceCacheValid (false),
+    m_loopbackInterface (-1),
+    m_outputInterface (-1),
+    m_mainInterface (-1)
 {
   NS_LOG_FUNCTION (this);
   m_adaptiveBeaconInterval = m_beaconInterval;
   m_maxHopsEnergyAware = m_hopCount;
   m_beaconJitter = CreateObject<UniformRandomVariable> ();
+  m_forwardingRng = CreateObject<UniformRandomVariable> ();
+  m_queue.SetDropCallback (MakeCallback (&EnergyAwareRoutingProtocol::QueueDropped, this));
+  m_energyUpdateTimer.SetFunction (&EnergyAwareRoutingProtocol::EnergyUpdateTimerExpire, this);
+  m_beaconTimer.SetFunction (&EnergyAwareRoutingProtocol::SendBeacons, this);
+  m_expiryTimer.SetFunction (&EnergyAwareRoutingProtocol::ExpiryTimerExpire, this);
 }
 
 EnergyAwareRoutingProtocol::~EnergyAwareRoutingProtocol ()
@@ -122,57 +360,291 @@ EnergyAwareRoutingProtocol::~EnergyAwareRoutingProtocol ()
   NS_LOG_FUNCTION (this);
 }
 
+int64_t
+EnergyAwareRoutingProtocol::AssignStreams (int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  m_beaconJitter->SetStream (stream);
+  m_forwardingRng->SetStream (stream + 1);
+  return 2;
+}
+
+void
+EnergyAwareRoutingProtocol::SetPolicies (const PolicySet &policies)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (policies.m_forward && policies.m_energyBudget);
+  m_policies = policies;
+  if (m_policies.m_evictionRank)
+    {
+      m_queue.SetEvictionRank (m_policies.m_evictionRank);
+    }
+  else
+    {
+      m_queue.SetDropPolicy (m_dropPolicy);
+    }
+}
+
+const PolicySet &
+EnergyAwareRoutingProtocol::GetPolicies () const
+{
+  return m_policies;
+}
+
+const PacketQueue &
+EnergyAwareRoutingProtocol::GetQueue () const
+{
+  return m_queue;
+}
+
 void
 EnergyAwareRoutingProtocol::SetEnergySource (Ptr<energy::EnergySource> source)
 {
   NS_LOG_FUNCTION (this << source);
+  if (m_energySource && m_energyTraceConnected)
+    {
+      m_energySource->TraceDisconnectWithoutContext
+        ("RemainingEnergy", MakeCallback (&EnergyAwareRoutingProtocol::RemainingEnergyChanged, this));
+    }
   m_energySource = source;
+  m_txCosts.clear ();
+  // Pause beacons where the source stops powering the radio: BasicEnergySource
+  // reports depletion at its low battery threshold and recharge above its
+  // high one; other sources at empty
+  DoubleValue low;
+  DoubleValue high;
+  m_depletionThreshold = source && source->GetAttributeFailSafe ("BasicEnergyLowBatteryThreshold", low)
+    ? low.Get () : 0.0;
+  m_rechargeThreshold = source && source->GetAttributeFailSafe ("BasicEnergyHighBatteryThreshold", high)
+    ? high.Get () : m_depletionThreshold;
+  m_netPower = 0.0;
+  m_lastRemainingEnergy = source ? source->GetRemainingEnergy () : 0.0;
+  m_lastEnergyUpdate = Simulator::Now ();
+  // BasicEnergySource and friends report every energy update through this
+  // trace; other sources are polled every EnergyUpdateInterval
+  m_energyTraceConnected = source && source->TraceConnectWithoutContext
+    ("RemainingEnergy", MakeCallback (&EnergyAwareRoutingProtocol::RemainingEnergyChanged, this));
+  UpdateEnergyRatio ();
+  if (m_ipv4 && !m_energyUpdateTimer.IsRunning ())
+    {
+      EnergyUpdateTimerExpire ();
+    }
 }
 
 double
 EnergyAwareRoutingProtocol::GetRemainingEnergyRatio () const
 {
-  if (!m_energySource)
+  return m_energyRatio;
+}
+
+double
+EnergyAwareRoutingProtocol::GetEffectiveEnergyRatio () const
+{
+  return m_effectiveEnergyRatio;
+}
+
+double
+EnergyAwareRoutingProtocol::GetNetHarvestPower () const
+{
+  return m_netPower;
+}
+
+bool
+EnergyAwareRoutingProtocol::IsEnergyDepleted () const
+{
+  return m_depleted;
+}
+
+EnergyAwareRoutingProtocol::EnergyState
+EnergyAwareRoutingProtocol::GetEnergyState () const
+{
+  return m_energyState;
+}
+
+void
+EnergyAwareRoutingProtocol::UpdateEnergyRatio ()
+{
+  SetRemainingEnergy (m_energySource ? m_energySource->GetRemainingEnergy () : 0);
+}
+
+void
+EnergyAwareRoutingProtocol::RemainingEnergyChanged (double oldValue, double newValue)
+{
+  SetRemainingEnergy (newValue);
+}
+
+void
+EnergyAwareRoutingProtocol::SetRemainingEnergy (double remaining)
+{
+  double ratio = 1.0; // Assume full energy if no energy source
+  if (m_energySource)
     {
-      return 1.0; // Assume full energy if no energy source
+      double initial = m_energySource->GetInitialEnergy ();
+      ratio = initial <= 0 ? 0.0 : remaining / initial;
     }
-  
-  double remaining = m_energySource->GetRemainingEnergy ();
-  double initial = m_energySource->GetInitialEnergy ();
-  
-  if (initial <= 0)
+  m_energyRatio = ratio;
+
+  // Net power of the source, harvest minus consumption, as a moving
+  // average over NET_POWER_TIME_CONSTANT seconds of updates
+  Time now = Simulator::Now ();
+  if (m_energySource && now > m_lastEnergyUpdate)
     {
-      return 0.0;
+      double elapsed = (now - m_lastEnergyUpdate).GetSeconds ();
+      double power = (remaining - m_lastRemainingEnergy) / elapsed;
+      m_netPower += std::min (1.0, elapsed / NET_POWER_TIME_CONSTANT) * (power - m_netPower);
+    }
+  m_lastRemainingEnergy = remaining;
+  m_lastEnergyUpdate = now;
+
+  // A node harvesting more than it spends gets credit for the energy it
+  // will have gained over HarvestHorizon, so it keeps relaying
+  if (m_energySource && m_netPower > 0 && m_energySource->GetInitialEnergy () > 0)
+    {
+      ratio = std::min (1.0, ratio + m_netPower * m_harvestHorizon.GetSeconds ()
+                        / m_energySource->GetInitialEnergy ());
+    }
+  m_effectiveEnergyRatio = ratio;
+
+  if (m_energySource && !m_depleted && m_energyRatio <= m_depletionThreshold)
+    {
+      HandleEnergyDepletion ();
+    }
+  else if (m_depleted && m_energyRatio > m_rechargeThreshold)
+    {
+      HandleEnergyRecharged ();
+    }
+
+  EnergyState state = ENERGY_NORMAL;
+  if (ratio <= m_energyThresholdCritical)
+    {
+      state = ENERGY_CRITICAL;
+    }
+  else if (ratio <= m_energyThresholdLow)
+    {
+      state = ENERGY_LOW;
+    }
+  if (state != m_energyState)
+    {
+      NS_LOG_INFO ("Energy state changed from " << m_energyState << " to " << state
+                   << " at ratio " << ratio);
+      EnergyState oldState = m_energyState;
+      m_energyState = state;
+      HandleLowEnergy ();
+      m_energyStateChangedTrace (oldState, state, ratio);
     }
-  
-  return remaining / initial;
 }
 
-bool
-EnergyAwareRoutingProtocol::ShouldForwardPacket (const EpidemicHeader& header) const
+void
+EnergyAwareRoutingProtocol::HandleEnergyDepletion ()
 {
   NS_LOG_FUNCTION (this);
-  
-  double energyRatio = GetRemainingEnergyRatio ();
-  
-  // Critical energy: only forward high priority packets
-  if (energyRatio <= m_energyThresholdCritical)
+  if (m_depleted)
+    {
+      return;
+    }
+  m_depleted = true;
+  NS_LOG_INFO ("Energy depleted at ratio " << m_energyRatio << ", pausing beacons");
+  if (m_beaconTimer.IsRunning ())
     {
-      // Check if this is a speech packet (high priority)
-      // This is a simplified check - in practice, you'd examine packet content
-      return (header.GetPacketID () % 100) < m_speechPacketPriority;
+      m_beaconTimer.Suspend ();
     }
-  
-  // Low energy: reduce flooding probability
-  if (energyRatio <= m_energyThresholdLow)
+  m_energyDepletedTrace ();
+}
+
+void
+EnergyAwareRoutingProtocol::HandleEnergyRecharged ()
+{
+  NS_LOG_FUNCTION (this);
+  if (!m_depleted)
     {
-      // Use energy-aware flooding factor to reduce transmission probability
-      Ptr<UniformRandomVariable> rand = CreateObject<UniformRandomVariable> ();
-      return rand->GetValue () < m_energyAwareFloodingFactor;
+      return;
     }
-  
-  // Normal energy: forward all packets
-  return true;
+  m_depleted = false;
+  NS_LOG_INFO ("Energy recharged to ratio " << m_energyRatio << ", resuming beacons");
+  if (m_beaconTimer.IsSuspended ())
+    {
+      m_beaconTimer.Resume ();
+    }
+  else if (m_ipv4 && !m_beaconTimer.IsRunning ())
+    {
+      // Depletion found while a beacon was sent leaves no timer to resume
+      m_beaconTimer.Schedule (m_adaptiveBeaconInterval + MilliSeconds
+                              (m_beaconJitter->GetValue ()));
+    }
+  m_energyRechargedTrace ();
+}
+
+void
+EnergyAwareRoutingProtocol::EnergyUpdateTimerExpire ()
+{
+  NS_LOG_FUNCTION (this);
+  if (!m_energySource || m_energyTraceConnected || m_energyUpdateInterval.IsZero ())
+    {
+      return;
+    }
+  UpdateEnergyRatio ();
+  m_energyUpdateTimer.Schedule (m_energyUpdateInterval);
+}
+
+bool
+EnergyAwareRoutingProtocol::Buffer (QueueEntry && entry)
+{
+  NS_LOG_FUNCTION (this << entry.GetPacketID ());
+  bool buffered = m_queue.Enqueue (std::move (entry));
+  ScheduleExpiry ();
+  return buffered;
+}
+
+void
+EnergyAwareRoutingProtocol::ScheduleExpiry ()
+{
+  if (m_queue.GetSize () == 0)
+    {
+      m_expiryTimer.Cancel ();
+      return;
+    }
+  // One event for the whole buffer, at the first expire time: each firing
+  // only touches the packets that expire then
+  Time delay = std::max (m_queue.GetNextExpireTime () - Simulator::Now () + TimeStep (1),
+                         Time (0));
+  if (m_expiryTimer.IsRunning () && m_expiryTimer.GetDelayLeft () <= delay)
+    {
+      return;
+    }
+  m_expiryTimer.Cancel ();
+  m_expiryTimer.Schedule (delay);
+}
+
+void
+EnergyAwareRoutingProtocol::ExpiryTimerExpire ()
+{
+  NS_LOG_FUNCTION (this);
+  m_queue.DropExpiredPackets ();
+  ScheduleExpiry ();
+}
+
+bool
+EnergyAwareRoutingProtocol::ShouldForwardPacket (const EpidemicHeader& header) const
+{
+  NS_LOG_FUNCTION (this);
+  ForwardingContext ctx;
+  ctx.m_energyRatio = GetEffectiveEnergyRatio ();
+  ctx.m_thresholdLow = m_energyThresholdLow;
+  ctx.m_thresholdCritical = m_energyThresholdCritical;
+  ctx.m_floodingFactor = m_energyAwareFloodingFactor;
+  ctx.m_criticalClass = m_criticalTrafficClass;
+  return m_policies.m_forward (ctx, header, *m_forwardingRng);
+}
+
+uint16_t
+EnergyAwareRoutingProtocol::GetInitialCopies () const
+{
+  if (m_forwardingMode != FORWARD_SPRAY_AND_WAIT)
+    {
+      return 0;
+    }
+  double ratio = std::min (std::max (GetEffectiveEnergyRatio (), 0.0), 1.0);
+  return static_cast<uint16_t> (std::max (1.0, std::ceil (m_sprayCopies * ratio)));
 }
 
 void
@@ -180,28 +652,62 @@ EnergyAwareRoutingProtocol::AdaptBeaconInterval ()
 {
   NS_LOG_FUNCTION (this);
   
-  double energyRatio = GetRemainingEnergyRatio ();
+  double energyRatio = GetEffectiveEnergyRatio ();
   
   if (energyRatio <= m_energyThresholdCritical)
     {
-      // Critical energy: increase beacon interval significantly
-      m_adaptiveBeaconInterval = m_beaconInterval * 4;
       m_maxHopsEnergyAware = std::max (1u, m_hopCount / 4);
     }
   else if (energyRatio <= m_energyThresholdLow)
     {
-      // Low energy: increase beacon interval moderately
-      m_adaptiveBeaconInterval = m_beaconInterval * 2;
       m_maxHopsEnergyAware = std::max (1u, m_hopCount / 2);
     }
   else
     {
-      // Normal energy: use default intervals
-      m_adaptiveBeaconInterval = m_beaconInterval;
       m_maxHopsEnergyAware = m_hopCount;
     }
+
+  // Energy: 1 above the low threshold, growing linearly to 4 when empty
+  double energyFactor = 1.0;
+  if (energyRatio < m_energyThresholdLow)
+    {
+      energyFactor += 3.0 * (m_energyThresholdLow - std::max (energyRatio, 0.0))
+        / m_energyThresholdLow;
+    }
+
+  // Density: beyond TargetNeighbors, the neighbors' beacons already give
+  // enough chances to start anti-entropy sessions
+  uint32_t neighbors = m_neighbors.GetSize ();
+  double densityFactor = 1.0;
+  if (m_targetNeighbors > 0 && neighbors > m_targetNeighbors)
+    {
+      densityFactor = static_cast<double> (neighbors) / m_targetNeighbors;
+    }
+
+  // Activity: moving average of the new packets buffered per second
+  Time now = Simulator::Now ();
+  double elapsed = (now - m_lastBeaconTime).GetSeconds ();
+  if (elapsed > 0)
+    {
+      m_packetArrivalRate = 0.3 * (m_newPacketCount / elapsed) + 0.7 * m_packetArrivalRate;
+    }
+  m_newPacketCount = 0;
+  m_lastBeaconTime = now;
+  double perInterval = m_packetArrivalRate * m_beaconInterval.GetSeconds ();
+  double activityFactor = std::min (1.0 + perInterval, 4.0);
+  if (m_queue.GetSize () == 0 && perInterval < 0.1)
+    {
+      // Nothing to give: let the neighbors' beacons start the sessions
+      activityFactor = 0.5;
+    }
+
+  m_adaptiveBeaconInterval = Seconds (m_beaconInterval.GetSeconds ()
+                                      * energyFactor * densityFactor / activityFactor);
+  m_adaptiveBeaconInterval = std::min (std::max (m_adaptiveBeaconInterval, m_minBeaconInterval),
+                                       m_maxBeaconInterval);
   
-  NS_LOG_DEBUG ("Energy ratio: " << energyRatio 
+  NS_LOG_DEBUG ("Energy ratio: " << energyRatio << ", neighbors: " << neighbors
+                << ", arrival rate: " << m_packetArrivalRate
                 << ", Adaptive beacon interval: " << m_adaptiveBeaconInterval.GetSeconds ()
                 << ", Max hops: " << m_maxHopsEnergyAware);
 }
@@ -209,103 +715,763 @@ EnergyAwareRoutingProtocol::AdaptBeaconInterval ()
 void
 EnergyAwareRoutingProtocol::HandleLowEnergy ()
 {
-  NS_LOG_FUNCTION (this);
-  
-  double energyRatio = GetRemainingEnergyRatio ();
-  
-  if (energyRatio <= m_energyThresholdCritical)
+  NS_LOG_FUNCTION (this << m_energyState);
+
+  double energyRatio = GetEffectiveEnergyRatio ();
+  uint32_t capacity = m_maxQueueLen;
+  uint32_t dropped = 0;
+
+  if (m_energyState == ENERGY_CRITICAL)
     {
       NS_LOG_WARN ("Critical energy level reached: " << energyRatio);
       // Purge non-essential packets from queue
-      // This would require extending the PacketQueue class
+      dropped += m_queue.DropPriorityBelow (m_criticalTrafficClass);
+      capacity = static_cast<uint32_t> (m_maxQueueLen * m_lowEnergyQueueFactor
+                                        * m_lowEnergyQueueFactor);
     }
-  else if (energyRatio <= m_energyThresholdLow)
+  else if (m_energyState == ENERGY_LOW)
     {
       NS_LOG_INFO ("Low energy level: " << energyRatio);
-      // Reduce queue size and drop older packets more aggressively
+      capacity = static_cast<uint32_t> (m_maxQueueLen * m_lowEnergyQueueFactor);
     }
+
+  // Fewer buffered packets is less memory and fewer packets to relay;
+  // the buffer grows back to QueueLength once energy recovers
+  capacity = std::max (capacity, std::min (m_maxQueueLen, 1u));
+  dropped += m_queue.Shrink (capacity);
+  NS_LOG_DEBUG ("Buffer capacity set to " << capacity << " packets, "
+                << dropped << " packets dropped");
 }
 
 bool
-EnergyAwareRoutingProtocol::IsEnergyAwareForwarding (const QueueEntry& entry) const
+EnergyAwareRoutingProtocol::IsEnergyAwareForwarding (const QueueEntry& entry, uint32_t frames) const
+{
+  NS_LOG_FUNCTION (this << frames);
+  if (!m_energySource)
+    {
+      return true;
+    }
+
+  // Calculate energy cost for this transmission
+  double transmissionCost = CalculateTransmissionCost (entry.GetSize ()
+                                                       + Ipv4Header ().GetSerializedSize (),
+                                                       frames);
+  // The cached ratio avoids an energy source update per packet
+  double remainingEnergy = GetRemainingEnergyRatio () * m_energySource->GetInitialEnergy ();
+  
+  return m_policies.m_energyBudget (transmissionCost, remainingEnergy,
+                                    m_energySource->GetInitialEnergy ());
+}
+
+uint32_t
+EnergyAwareRoutingProtocol::GetPayloadOffset (const Ipv4Header &ipHeader) const
+{
+  // The UDP header is needed intact at the destination; other transports
+  // are compressed whole by lossless codecs only
+  return ipHeader.GetProtocol () == UdpL4Protocol::PROT_NUMBER
+    ? UdpHeader ().GetSerializedSize () : 0;
+}
+
+Ptr<Packet>
+EnergyAwareRoutingProtocol::OptimizeMultimediaPacket (Ptr<Packet> packet,
+                                                      EpidemicHeader& header,
+                                                      const Ipv4Header &ipHeader)
+{
+  NS_LOG_FUNCTION (this << packet);
+
+  // Compression costs CPU time, only worth it when saving airtime matters
+  if (m_energyState == ENERGY_NORMAL)
+    {
+      return packet;
+    }
+  Ptr<PayloadCodec> codec = header.GetTrafficClass () == EpidemicHeader::VOICE
+    ? m_voiceCodec : m_dataCodec;
+  uint32_t offset = GetPayloadOffset (ipHeader);
+  if (!codec || packet->GetSize () <= offset || (offset == 0 && !codec->IsLossless ()))
+    {
+      return packet;
+    }
+  Ptr<Packet> compressed = codec->Compress (packet, offset);
+  uint32_t originalSize = packet->GetSize () - offset;
+  // The frame overhead is paid anyway, so short payloads gain less
+  if (!compressed || CalculateTransmissionCost (compressed)
+      > CalculateTransmissionCost (packet) * m_compressionRatio)
+    {
+      NS_LOG_DEBUG ("Payload of " << originalSize << " bytes does not compress enough");
+      return packet;
+    }
+  header.SetCodec (codec->GetCodecId ());
+  NS_LOG_DEBUG ("Compressed payload from " << originalSize << " to "
+                << compressed->GetSize () - offset << " bytes with codec "
+                << (uint32_t) codec->GetCodecId () << ", saving "
+                << CalculateTransmissionCost (packet) - CalculateTransmissionCost (compressed)
+                << " J per transmission");
+  return compressed;
+}
+
+Ptr<Packet>
+EnergyAwareRoutingProtocol::RestorePayload (Ptr<Packet> packet, const EpidemicHeader& header,
+                                            const Ipv4Header &ipHeader) const
+{
+  NS_LOG_FUNCTION (this << packet << (uint32_t) header.GetCodec ());
+  Ptr<PayloadCodec> codecs[] = { m_dataCodec, m_voiceCodec };
+  for (uint32_t i = 0; i < 2; ++i)
+    {
+      if (codecs[i] && codecs[i]->GetCodecId () == header.GetCodec ())
+        {
+          return codecs[i]->Decompress (packet, GetPayloadOffset (ipHeader));
+        }
+    }
+  return 0;
+}
+
+double
+EnergyAwareRoutingProtocol::CalculateTransmissionCost (const Ptr<const Packet> packet) const
+{
+  return CalculateTransmissionCost (packet->GetSize () + Ipv4Header ().GetSerializedSize ());
+}
+
+double
+EnergyAwareRoutingProtocol::CalculateTransmissionCost (uint32_t bytes, uint32_t frames) const
+{
+  TxCost cost = GetTxCost (m_interfaceCacheValid ? m_mainInterface : -1);
+  return bytes * cost.m_perByte + frames * cost.m_perFrame;
+}
+
+EnergyAwareRoutingProtocol::TxCost
+EnergyAwareRoutingProtocol::GetTxCost (int32_t interface) const
+{
+  std::map<int32_t, TxCost>::const_iterator cached = m_txCosts.find (interface);
+  if (cached != m_txCosts.end ())
+    {
+      return cached->second;
+    }
+  NS_LOG_FUNCTION (this << interface);
+
+  TxCost cost = { 0, 0 };
+  if (!m_energySource)
+    {
+      return cost;
+    }
+  double current = m_defaultTxCurrent;
+  TypeId radioModel;
+  if (TypeId::LookupByNameFailSafe ("ns3::WifiRadioEnergyModel", &radioModel))
+    {
+      energy::DeviceEnergyModelContainer models = m_energySource->FindDeviceEnergyModels (radioModel);
+      DoubleValue txCurrent;
+      if (models.GetN () > 0 && models.Get (0)->GetAttributeFailSafe ("TxCurrentA", txCurrent))
+        {
+          current = txCurrent.Get ();
+        }
+    }
+
+  // Wifi mode names carry their rate, e.g. DsssRate5_5Mbps or OfdmRate6Mbps
+  double rate = m_defaultPhyDataRate.GetBitRate ();
+  PointerValue manager;
+  StringValue mode;
+  Ptr<NetDevice> device = (m_ipv4 && interface >= 0) ? m_ipv4->GetNetDevice (interface) : 0;
+  if (device && device->GetAttributeFailSafe ("RemoteStationManager", manager)
+      && manager.Get<Object> ()
+      && manager.Get<Object> ()->GetAttributeFailSafe ("DataMode", mode))
+    {
+      std::string name = mode.Get ();
+      std::string::size_type start = name.find ("Rate");
+      std::string::size_type end = name.find ("Mbps");
+      if (start != std::string::npos && end != std::string::npos && end > start + 4)
+        {
+          std::string mbps = name.substr (start + 4, end - start - 4);
+          std::replace (mbps.begin (), mbps.end (), '_', '.');
+          double parsed = std::atof (mbps.c_str ()) * 1e6;
+          rate = parsed > 0 ? parsed : rate;
+        }
+    }
+
+  double power = current * m_energySource->GetSupplyVoltage ();
+  cost.m_perByte = rate > 0 ? power * 8 / rate : 0;
+  cost.m_perFrame = power * m_frameOverhead.GetSeconds ();
+  NS_LOG_DEBUG ("Transmission cost on interface " << interface << ": " << cost.m_perByte
+                << " J/byte and " << cost.m_perFrame << " J/frame at " << rate
+                << " bit/s and " << power << " W");
+  m_txCosts[interface] = cost;
+  return cost;
+}
+
+Ptr<Packet>
+EnergyAwareRoutingProtocol::CreateSummaryVectorPacket (SummaryVectorHeader summary,
+                                                       bool firstNode,
+                                                       SummaryVectorHeader::Encoding encoding) const
+{
+  NS_LOG_FUNCTION (this << summary.Size () << firstNode << encoding);
+  summary.SetEncoding (encoding);
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (summary);
+
+  bool compact = (encoding == SummaryVectorHeader::COMPACT);
+  TypeHeader tHeader;
+  if (firstNode)
+    {
+      tHeader.SetMessageType (compact ? TypeHeader::REPLY_COMPACT : TypeHeader::REPLY);
+    }
+  else
+    {
+      tHeader.SetMessageType (compact ? TypeHeader::REPLY_BACK_COMPACT : TypeHeader::REPLY_BACK);
+    }
+  packet->AddHeader (tHeader);
+  ControlTag tempTag (ControlTag::CONTROL);
+  packet->AddPacketTag (tempTag);
+
+  NS_LOG_DEBUG ("Summary vector with " << summary.Size () << " IDs takes "
+                << packet->GetSize () << " bytes, cost "
+                << CalculateTransmissionCost (packet) << " J");
+  return packet;
+}
+
+void
+EnergyAwareRoutingProtocol::SendBeacons ()
 {
   NS_LOG_FUNCTION (this);
   
-  // Calculate energy cost for this transmission
-  double transmissionCost = CalculateTransmissionCost (entry.GetPacket ());
-  double remainingEnergy = m_energySource ? m_energySource->GetRemainingEnergy () : 1000.0;
+  // Adapt beacon interval based on energy
+  AdaptBeaconInterval ();
+  
+  double energyRatio = GetEffectiveEnergyRatio ();
   
-  // Don't forward if transmission would consume too much remaining energy
-  if (transmissionCost > remainingEnergy * 0.1) // Don't use more than 10% of remaining energy
+  // Skip beacon if energy is critically low
+  if (energyRatio <= m_energyThresholdCritical * 0.5)
     {
-      return false;
+      NS_LOG_DEBUG ("Skipping beacon due to critically low energy: " << energyRatio);
+      m_beaconSkippedTrace ();
+      if (!m_depleted)
+        {
+          m_beaconTimer.Schedule (m_adaptiveBeaconInterval + MilliSeconds
+                                  (m_beaconJitter->GetValue ()));
+        }
+      return;
     }
   
-  return true;
+  NS_LOG_DEBUG ("Sending beacon with adaptive interval: " << m_adaptiveBeaconInterval.GetSeconds ());
+  Ptr<Packet> packet = Create<Packet> ();
+  // Piggyback the delivered packet IDs, so neighbors can drop their copies
+  PurgeImmunity ();
+  if (!m_immunity.empty ())
+    {
+      SummaryVectorHeader immune (m_immunity.size (), SummaryVectorHeader::COMPACT);
+      for (std::map<uint32_t, Time>::const_iterator i = m_immunity.begin ();
+           i != m_immunity.end (); ++i)
+        {
+          immune.Add (i->first);
+        }
+      packet->AddHeader (immune);
+    }
+  // Advertise our energy and buffer room for custody transfers
+  uint32_t size = m_queue.GetSize ();
+  uint32_t maxLen = m_queue.GetMaxQueueLen ();
+  packet->AddHeader (BeaconInfoHeader (energyRatio, maxLen > size ? maxLen - size : 0));
+  TypeHeader tHeader (TypeHeader::BEACON);
+  packet->AddHeader (tHeader);
+  // Tag the packet so RouteOutput and RouteInput treat it as control traffic
+  ControlTag tempTag (ControlTag::CONTROL);
+  packet->AddPacketTag (tempTag);
+  m_beaconSentTrace (packet);
+  BroadcastPacket (packet);
+  
+  // Schedule next beacon with adaptive interval, unless the transmission
+  // depleted the battery: HandleEnergyRecharged restarts the beacons then
+  if (!m_depleted)
+    {
+      m_beaconTimer.Schedule (m_adaptiveBeaconInterval + MilliSeconds
+                              (m_beaconJitter->GetValue ()));
+    }
+}
+
+void
+EnergyAwareRoutingProtocol::RecvEpidemic (Ptr<Socket> socket)
+{
+  NS_LOG_FUNCTION (this << socket);
+  Address sourceAddress;
+  Ptr<Packet> packet = socket->RecvFrom (sourceAddress);
+  InetSocketAddress inetSourceAddr = InetSocketAddress::ConvertFrom (sourceAddress);
+  Ipv4Address sender = inetSourceAddr.GetIpv4 ();
+
+  TypeHeader tHeader (TypeHeader::BEACON);
+  packet->RemoveHeader (tHeader);
+  if (!tHeader.IsValid ())
+    {
+      NS_LOG_DEBUG ("Unknown epidemic message type from " << sender << ", drop");
+      return;
+    }
+
+  switch (tHeader.GetMessageType ())
+    {
+    case TypeHeader::BEACON:
+      {
+        NS_LOG_LOGIC ("Got a beacon from " << sender << " at " << m_mainAddress);
+        m_neighbors.Update (sender);
+        BeaconInfoHeader info;
+        packet->RemoveHeader (info);
+        NeighborInfo &neighbor = m_neighborInfo[sender];
+        neighbor.m_energyRatio = info.GetEnergyRatio ();
+        neighbor.m_freeSpace = info.GetFreeSpace ();
+        neighbor.m_lastSeen = Simulator::Now ();
+        neighbor.m_immune = SummaryVectorHeader ();
+        if (packet->GetSize () > 0)
+          {
+            SummaryVectorHeader immune (0, SummaryVectorHeader::COMPACT);
+            packet->RemoveHeader (immune);
+            neighbor.m_immune = immune;
+            for (SummaryVectorHeader::Iterator i = immune.Begin (); i != immune.End (); ++i)
+              {
+                // Only holders of a copy pass the acknowledgement on, with
+                // the expire time of their copy, so that it dies with the
+                // packet instead of circulating forever
+                const QueueEntry *entry = m_queue.Find (*i);
+                if (entry)
+                  {
+                    AddImmunity (*i, entry->GetExpireTime ());
+                  }
+              }
+          }
+        // Anti-entropy session: the node with the smaller address starts it,
+        // unless the two nodes exchanged summary vectors recently
+        if (m_mainAddress.Get () < sender.Get () && !IsHostContactedRecently (sender))
+          {
+            SendSummaryVector (sender, true, m_summaryVectorEncoding);
+          }
+        break;
+      }
+    case TypeHeader::REPLY:
+    case TypeHeader::REPLY_COMPACT:
+      {
+        NS_LOG_LOGIC ("Got a reply from " << sender);
+        SummaryVectorHeader::Encoding encoding =
+          tHeader.IsMessageType (TypeHeader::REPLY_COMPACT) ? SummaryVectorHeader::COMPACT
+                                                            : SummaryVectorHeader::PLAIN;
+        SummaryVectorHeader packet_SMV (0, encoding);
+        packet->RemoveHeader (packet_SMV);
+        SendDisjointPackets (packet_SMV, sender);
+        // Answer in the encoding the peer used, it is known to understand it
+        SendSummaryVector (sender, false, encoding);
+        break;
+      }
+    case TypeHeader::REPLY_BACK:
+    case TypeHeader::REPLY_BACK_COMPACT:
+      {
+        NS_LOG_LOGIC ("Got a reply back from " << sender);
+        SummaryVectorHeader packet_SMV (0, tHeader.IsMessageType (TypeHeader::REPLY_BACK_COMPACT)
+                                        ? SummaryVectorHeader::COMPACT : SummaryVectorHeader::PLAIN);
+        packet->RemoveHeader (packet_SMV);
+        SendDisjointPackets (packet_SMV, sender);
+        break;
+      }
+    case TypeHeader::BUNDLE:
+      {
+        NS_LOG_LOGIC ("Got a bundle of " << packet->GetSize () << " bytes from " << sender);
+        int32_t iif = m_ipv4->GetInterfaceForDevice (socket->GetBoundNetDevice ());
+        if (iif >= 0)
+          {
+            RecvBundle (packet, iif);
+          }
+        break;
+      }
+    default:
+      break;
+    }
+}
+
+void
+EnergyAwareRoutingProtocol::SendSummaryVector (Ipv4Address dest, bool firstNode,
+                                               SummaryVectorHeader::Encoding encoding)
+{
+  NS_LOG_FUNCTION (this << dest << firstNode << encoding);
+  SummaryVectorHeader summary = m_queue.GetSummaryVector ();
+  // Delivered packets are listed too, so the peer does not send them
+  PurgeImmunity ();
+  for (std::map<uint32_t, Time>::const_iterator i = m_immunity.begin ();
+       i != m_immunity.end (); ++i)
+    {
+      summary.Add (i->first);
+    }
+  Ptr<Packet> packet = CreateSummaryVectorPacket (summary, firstNode, encoding);
+  m_summaryVectorSentTrace (packet);
+  SendPacket (packet, InetSocketAddress (dest, EPIDEMIC_PORT));
+}
+
+void
+EnergyAwareRoutingProtocol::SendDisjointPackets (const SummaryVectorHeader &packet_SMV,
+                                                 Ipv4Address dest)
+{
+  NS_LOG_FUNCTION (this << dest);
+  ConfirmCustody (dest, packet_SMV);
+  SummaryVectorHeader disjoint_vector = m_queue.FindDisjointPackets (packet_SMV);
+  uint32_t custody = GetCustodySpace (dest);
+  if (custody > 0)
+    {
+      // The custodian already holds the packets of its summary vector,
+      // except the delivered ones its beacons list
+      const SummaryVectorHeader &immune = m_neighborInfo[dest].m_immune;
+      uint32_t dropped = 0;
+      for (SummaryVectorHeader::Iterator i = packet_SMV.Begin (); i != packet_SMV.End (); ++i)
+        {
+          if (!immune.Contains (*i) && m_queue.Remove (*i, PacketQueue::DROP_HANDED_OFF))
+            {
+              m_seen.Insert (*i);
+              ++dropped;
+            }
+        }
+      NS_LOG_DEBUG ("Handing the buffer over to " << dest << ", which holds "
+                    << dropped << " of its packets already");
+      if (dropped > 0)
+        {
+          m_custodyTransferTrace (dest, dropped);
+        }
+    }
+  if (disjoint_vector.Size () == 0)
+    {
+      return;
+    }
+  NS_LOG_LOGIC ("Sending " << disjoint_vector.Size () << " disjoint packets to " << dest);
+  // One event for the whole contact rather than one per packet
+  Simulator::ScheduleNow (&EnergyAwareRoutingProtocol::SendPacketBurst, this,
+                          dest, disjoint_vector, custody);
+}
+
+uint32_t
+EnergyAwareRoutingProtocol::GetCustodySpace (Ipv4Address neighbor)
+{
+  NS_LOG_FUNCTION (this << neighbor);
+  double energyRatio = GetEffectiveEnergyRatio ();
+  if (!m_custodyTransfer || energyRatio > m_energyThresholdLow || m_queue.GetSize () == 0)
+    {
+      return 0;
+    }
+  Time now = Simulator::Now ();
+  std::map<Ipv4Address, NeighborInfo>::const_iterator best = m_neighborInfo.end ();
+  for (std::map<Ipv4Address, NeighborInfo>::iterator i = m_neighborInfo.begin ();
+       i != m_neighborInfo.end (); )
+    {
+      if (now - i->second.m_lastSeen > m_maxBeaconInterval)
+        {
+          // Out of range by now
+          m_neighborInfo.erase (i++);
+          continue;
+        }
+      if (i->second.m_freeSpace > 0
+          && (best == m_neighborInfo.end () || i->second.m_energyRatio > best->second.m_energyRatio))
+        {
+          best = i;
+        }
+      ++i;
+    }
+  if (best == m_neighborInfo.end () || best->first != neighbor
+      || best->second.m_energyRatio <= std::max (energyRatio, m_energyThresholdLow))
+    {
+      return 0;
+    }
+  return best->second.m_freeSpace;
+}
+
+void
+EnergyAwareRoutingProtocol::SendPacketBurst (Ipv4Address dest, SummaryVectorHeader packetIds,
+                                             uint32_t custody)
+{
+  NS_LOG_FUNCTION (this << dest << packetIds.Size () << custody);
+  TypeHeader tHeader (TypeHeader::BUNDLE);
+  // BundleMtu bounds the IP datagram, so that a bundle is never fragmented
+  uint32_t overhead = Ipv4Header ().GetSerializedSize () + UdpHeader ().GetSerializedSize ()
+    + tHeader.GetSerializedSize ();
+  Ptr<Packet> bundle = Create<Packet> ();
+  std::vector<uint32_t> handed;
+  for (SummaryVectorHeader::Iterator i = packetIds.Begin (); i != packetIds.End (); ++i)
+    {
+      if (custody > 0 && handed.size () >= custody)
+        {
+          break;
+        }
+      // The packet may have expired or been evicted since the summary vector
+      const QueueEntry *entry = m_queue.Find (*i);
+      if (!entry)
+        {
+          continue;
+        }
+      if (IsMyOwnAddress (entry->GetIpv4Header ().GetDestination ()))
+        {
+          // Delivered here, nothing to send
+          continue;
+        }
+      if (entry->GetHopCount () <= 1 && entry->GetIpv4Header ().GetDestination () != dest)
+        {
+          // Out of hops: a relay would drop it, only its destination takes it
+          continue;
+        }
+      uint32_t itemSize = BundleItemHeader::SERIALIZED_SIZE + entry->GetSize ();
+      if (m_bundleMtu == 0 || overhead + itemSize > m_bundleMtu)
+        {
+          if (SendPacketFromQueue (dest, *entry, custody > 0) && custody > 0)
+            {
+              handed.push_back (*i);
+            }
+          continue;
+        }
+      // The bundle pays for the frame, the packet only for its bytes
+      if (!IsEnergyAwareForwarding (*entry, 0))
+        {
+          NS_LOG_DEBUG ("Leaving packet " << *i << " out of the bundle due to energy constraints");
+          m_energyRejectedTrace (entry->GetPacket ());
+          continue;
+        }
+      Ipv4Header header = entry->GetIpv4Header ();
+      Ptr<Packet> item = custody > 0
+        ? CustodyPacket (*entry) : SprayPacket (*entry, dest);
+      if (!item)
+        {
+          continue;
+        }
+      if (overhead + bundle->GetSize () + itemSize > m_bundleMtu)
+        {
+          SendBundle (bundle, dest);
+          bundle = Create<Packet> ();
+        }
+      m_dataSentTrace (item, dest);
+      item->RemoveAllPacketTags ();
+      item->AddHeader (BundleItemHeader (header, item->GetSize ()));
+      bundle->AddAtEnd (item);
+      if (custody > 0)
+        {
+          handed.push_back (*i);
+        }
+    }
+  SendBundle (bundle, dest);
+  std::map<Ipv4Address, NeighborInfo>::iterator neighbor = m_neighborInfo.find (dest);
+  if (handed.empty () || neighbor == m_neighborInfo.end ())
+    {
+      return;
+    }
+  // Our copies stay until the custodian lists them in its summary vector
+  std::vector<uint32_t> &pending = neighbor->second.m_custodyPending;
+  pending.insert (pending.end (), handed.begin (), handed.end ());
+  NS_LOG_DEBUG ("Handed " << handed.size () << " packets over to " << dest);
+}
+
+void
+EnergyAwareRoutingProtocol::ConfirmCustody (Ipv4Address neighbor,
+                                            const SummaryVectorHeader &packetIds)
+{
+  NS_LOG_FUNCTION (this << neighbor << packetIds.Size ());
+  std::map<Ipv4Address, NeighborInfo>::iterator info = m_neighborInfo.find (neighbor);
+  if (info == m_neighborInfo.end () || info->second.m_custodyPending.empty ())
+    {
+      return;
+    }
+  // Custody passed on: drop our copies and refuse them from now on
+  uint32_t confirmed = 0;
+  std::vector<uint32_t> &pending = info->second.m_custodyPending;
+  for (std::vector<uint32_t>::const_iterator i = pending.begin (); i != pending.end (); ++i)
+    {
+      if (packetIds.Contains (*i) && m_queue.Remove (*i, PacketQueue::DROP_HANDED_OFF))
+        {
+          m_seen.Insert (*i);
+          ++confirmed;
+        }
+    }
+  // The others were lost on the way or evicted: they go out again
+  pending.clear ();
+  if (confirmed > 0)
+    {
+      NS_LOG_DEBUG (neighbor << " took custody of " << confirmed << " packets");
+      m_custodyTransferTrace (neighbor, confirmed);
+    }
+}
+
+Ptr<Packet>
+EnergyAwareRoutingProtocol::CustodyPacket (const QueueEntry &entry) const
+{
+  // The mark makes the custodian buffer it whatever its own policy
+  EpidemicHeader header = entry.GetEpidemicHeader ();
+  header.SetCustody (true);
+  Ptr<Packet> packet = entry.GetPacket () ? entry.GetPacket ()->Copy () : Create<Packet> ();
+  packet->AddHeader (header);
+  return packet;
+}
+
+void
+EnergyAwareRoutingProtocol::SendBundle (Ptr<Packet> bundle, Ipv4Address dest)
+{
+  NS_LOG_FUNCTION (this << bundle->GetSize () << dest);
+  if (bundle->GetSize () == 0)
+    {
+      return;
+    }
+  TypeHeader tHeader (TypeHeader::BUNDLE);
+  bundle->AddHeader (tHeader);
+  ControlTag tempTag (ControlTag::CONTROL);
+  bundle->AddPacketTag (tempTag);
+  NS_LOG_DEBUG ("Sending bundle of " << bundle->GetSize () << " bytes to " << dest);
+  SendPacket (bundle, InetSocketAddress (dest, EPIDEMIC_PORT));
+}
+
+void
+EnergyAwareRoutingProtocol::RecvBundle (Ptr<Packet> bundle, uint32_t iif)
+{
+  NS_LOG_FUNCTION (this << bundle->GetSize () << iif);
+  if (m_lcb.IsNull ())
+    {
+      NS_LOG_DEBUG ("No forwarding callbacks known yet, drop bundle");
+      return;
+    }
+  while (bundle->GetSize () >= BundleItemHeader::SERIALIZED_SIZE)
+    {
+      BundleItemHeader itemHeader;
+      bundle->RemoveHeader (itemHeader);
+      if (itemHeader.GetLength () > bundle->GetSize ())
+        {
+          NS_LOG_DEBUG ("Truncated bundle item, drop the rest of the bundle");
+          return;
+        }
+      Ptr<Packet> item = bundle->CreateFragment (0, itemHeader.GetLength ());
+      bundle->RemoveAtStart (itemHeader.GetLength ());
+      item->RemoveAllPacketTags ();
+      Ipv4Header header = itemHeader.GetIpv4Header ();
+      if (IsMyOwnAddress (header.GetSource ()))
+        {
+          continue;
+        }
+      HandleDataPacket (item, header, iif, m_ucb, m_lcb, m_ecb);
+    }
+}
+
+void
+EnergyAwareRoutingProtocol::AddImmunity (uint32_t packetID, Time expire)
+{
+  NS_LOG_FUNCTION (this << packetID << expire);
+  if (m_immunityListSize == 0)
+    {
+      return;
+    }
+  std::map<uint32_t, Time>::iterator known = m_immunity.find (packetID);
+  if (known != m_immunity.end ())
+    {
+      m_immunityExpiry.erase (std::make_pair (known->second, packetID));
+      m_immunity.erase (known);
+    }
+  else if (m_immunity.size () >= m_immunityListSize)
+    {
+      PurgeImmunity ();
+      if (m_immunity.size () >= m_immunityListSize)
+        {
+          // Forget the ID closest to expiry
+          m_immunity.erase (m_immunityExpiry.begin ()->second);
+          m_immunityExpiry.erase (m_immunityExpiry.begin ());
+        }
+    }
+  m_immunity[packetID] = expire;
+  m_immunityExpiry.insert (std::make_pair (expire, packetID));
+  if (m_queue.Remove (packetID))
+    {
+      NS_LOG_LOGIC ("Dropped delivered packet " << packetID << " from the buffer");
+    }
+}
+
+bool
+EnergyAwareRoutingProtocol::IsImmune (uint32_t packetID) const
+{
+  return m_immunity.find (packetID) != m_immunity.end ();
+}
+
+void
+EnergyAwareRoutingProtocol::PurgeImmunity ()
+{
+  Time now = Simulator::Now ();
+  while (!m_immunityExpiry.empty () && m_immunityExpiry.begin ()->first < now)
+    {
+      m_immunity.erase (m_immunityExpiry.begin ()->second);
+      m_immunityExpiry.erase (m_immunityExpiry.begin ());
+    }
+}
+
+bool
+EnergyAwareRoutingProtocol::IsHostContactedRecently (Ipv4Address hostID)
+{
+  NS_LOG_FUNCTION (this << hostID);
+  if (m_hostContacts.IsRecent (hostID))
+    {
+      return true;
+    }
+  m_hostContacts.Update (hostID);
+  return false;
+}
+
+void
+EnergyAwareRoutingProtocol::SendPacket (Ptr<Packet> p, InetSocketAddress addr)
+{
+  NS_LOG_FUNCTION (this << p << addr.GetIpv4 ());
+  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
+         m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
+    {
+      if (j->second.GetLocal () == m_mainAddress)
+        {
+          NS_LOG_LOGIC ("Packet " << p << " is sent to " << addr.GetIpv4 ());
+          j->first->SendTo (p, 0, addr);
+        }
+    }
+}
+
+void
+EnergyAwareRoutingProtocol::BroadcastPacket (Ptr<Packet> p)
+{
+  NS_LOG_FUNCTION (this << p);
+  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
+         m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
+    {
+      Ipv4InterfaceAddress iface = j->second;
+      Ipv4Address destination;
+      if (iface.GetMask () == Ipv4Mask::GetOnes ())
+        {
+          destination = Ipv4Address ("255.255.255.255");
+        }
+      else
+        {
+          destination = iface.GetBroadcast ();
+        }
+      j->first->SendTo (p->Copy (), 0, InetSocketAddress (destination, EPIDEMIC_PORT));
+    }
 }
 
-void
-EnergyAwareRoutingProtocol::OptimizeMultimediaPacket (Ptr<Packet> packet, 
-                                                      const EpidemicHeader& header)
+bool
+EnergyAwareRoutingProtocol::IsMyOwnAddress (Ipv4Address src)
 {
-  NS_LOG_FUNCTION (this << packet);
-  
-  double energyRatio = GetRemainingEnergyRatio ();
-  
-  // Apply compression based on energy level
-  if (energyRatio <= m_energyThresholdLow)
+  NS_LOG_FUNCTION (this << src);
+  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
+         m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
     {
-      // Simulate packet compression by reducing effective size
-      // In practice, this would involve actual compression algorithms
-      uint32_t originalSize = packet->GetSize ();
-      uint32_t compressedSize = static_cast<uint32_t> (originalSize * m_compressionRatio);
-      
-      NS_LOG_DEBUG ("Compressing multimedia packet from " << originalSize 
-                    << " to " << compressedSize << " bytes");
-      
-      // Note: This is a simulation - actual implementation would compress packet content
+      if (src == j->second.GetLocal ())
+        {
+          return true;
+        }
     }
+  return false;
 }
 
-double
-EnergyAwareRoutingProtocol::CalculateTransmissionCost (const Ptr<const Packet> packet) const
+uint32_t
+EnergyAwareRoutingProtocol::FindLoopbackDevice ()
 {
-  NS_LOG_FUNCTION (this << packet);
-  
-  // Simplified energy cost calculation based on packet size
-  // In practice, this would consider transmission power, distance, etc.
-  uint32_t packetSize = packet->GetSize ();
-  double baseCostPerByte = 0.001; // Joules per byte (example value)
-  
-  return packetSize * baseCostPerByte;
+  UpdateInterfaceCache ();
+  NS_ABORT_MSG_IF (m_loopbackInterface < 0, "No loopback interface found");
+  return m_loopbackInterface;
 }
 
-void
-EnergyAwareRoutingProtocol::SendBeacons ()
+Ptr<Socket>
+EnergyAwareRoutingProtocol::FindSocketWithInterfaceAddress (Ipv4InterfaceAddress addr) const
 {
-  NS_LOG_FUNCTION (this);
-  
-  // Adapt beacon interval based on energy
-  AdaptBeaconInterval ();
-  
-  double energyRatio = GetRemainingEnergyRatio ();
-  
-  // Skip beacon if energy is critically low
-  if (energyRatio <= m_energyThresholdCritical * 0.5)
+  NS_LOG_FUNCTION (this << addr);
+  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
+         m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
     {
-      NS_LOG_DEBUG ("Skipping beacon due to critically low energy: " << energyRatio);
-      m_beaconTimer.Schedule (m_adaptiveBeaconInterval + MilliSeconds
-                              (m_beaconJitter->GetValue ()));
-      return;
+      if (j->second == addr)
+        {
+          return j->first;
+        }
     }
-  
-  // TODO: Implement epidemic beacon sending functionality
-  // This method needs to send summary vectors to neighbors
-  NS_LOG_DEBUG ("Sending beacon with adaptive interval: " << m_adaptiveBeaconInterval.GetSeconds ());
-  
-  // Schedule next beacon with adaptive interval
-  m_beaconTimer.Schedule (m_adaptiveBeaconInterval + MilliSeconds
-                          (m_beaconJitter->GetValue ()));
+  return 0;
 }
 
 bool
@@ -319,103 +1485,296 @@ EnergyAwareRoutingProtocol::RouteInput (Ptr<const Packet> p,
 {
   NS_LOG_FUNCTION (this << p << header);
 
-  if (!m_ipv4 || !m_ipv4->IsUp (m_ipv4->GetInterfaceForDevice (idev)))
+  int32_t iif = m_ipv4 ? m_ipv4->GetInterfaceForDevice (idev) : -1;
+  if (iif < 0 || !m_ipv4->IsUp (iif))
     {
       NS_LOG_DEBUG ("IPv4 not ready or interface down");
       return false;
     }
 
-  // Handle low energy situations
-  HandleLowEnergy ();
-
   Ipv4Address dst = header.GetDestination ();
   Ipv4Address origin = header.GetSource ();
 
-  // Check if packet is for us (local delivery)
-  uint32_t iif = m_ipv4->GetInterfaceForDevice (idev);
-  if (m_ipv4->IsDestinationAddress (dst, iif))
+  // Kept for the data packets that reach us inside bundles
+  if (m_lcb.IsNull ())
     {
-      if (!lcb.IsNull ())
+      m_ucb = ucb;
+      m_lcb = lcb;
+      m_ecb = ecb;
+    }
+
+  // Control packets are handed to the epidemic socket as they are
+  ControlTag tag;
+  if (p->PeekPacketTag (tag) && tag.IsTagType (ControlTag::CONTROL))
+    {
+      if (m_ipv4->IsDestinationAddress (dst, iif) && !lcb.IsNull ())
         {
-          NS_LOG_DEBUG ("Local delivery to " << dst);
           lcb (p, header, iif);
           return true;
         }
-      else
-        {
-          NS_LOG_ERROR ("Local delivery callback is null");
-          return false;
-        }
+      return false;
     }
 
-  // Check if this is a broadcast or multicast
+  // Epidemic routing only buffers unicast data
   if (dst.IsBroadcast () || dst.IsMulticast ())
     {
       NS_LOG_DEBUG ("Received broadcast/multicast packet");
-      // Deliver locally if we should
+      if (m_ipv4->IsDestinationAddress (dst, iif) && !lcb.IsNull ())
+        {
+          lcb (p, header, iif);
+          return true;
+        }
+      return false;
+    }
+
+  if (IsMyOwnAddress (origin))
+    {
+      if (iif != (int32_t) FindLoopbackDevice ())
+        {
+          NS_LOG_LOGIC ("Own packet " << p->GetUid () << " came back from a neighbor, drop");
+          return true;
+        }
+      // Data from the transport layer, routed to the loopback by RouteOutput
       if (m_ipv4->IsDestinationAddress (dst, iif))
         {
-          if (!lcb.IsNull ())
-            {
-              lcb (p, header, iif);
-            }
+          lcb (p, header, iif);
+          return true;
         }
-      // Continue to forward using epidemic routing if needed
+      EpidemicHeader current_Header;
+      uint32_t globalPacketID = (origin.Get () << 16) | m_dataPacketCounter++;
+      current_Header.SetPacketID (globalPacketID);
+      current_Header.SetHopCount (m_hopCount);
+      current_Header.SetTimeStamp (Simulator::Now ());
+      Ptr<Packet> copy = p->Copy ();
+      // The traffic class is decided once, here, and travels with the packet
+      current_Header.SetTrafficClass (EpidemicHeader::ClassifyDscp (header.GetDscp ()));
+      current_Header.SetCopies (GetInitialCopies ());
+      // Fewer bytes to buffer and to send at every hop
+      copy = OptimizeMultimediaPacket (copy, current_Header, header);
+      NS_LOG_LOGIC ("Buffering packet " << globalPacketID << " of class "
+                    << current_Header.GetTrafficClass () << " originated for " << dst);
+      QueueEntry entry (copy, header, ucb, ecb,
+                        Simulator::Now () + m_queueEntryExpireTime, globalPacketID);
+      entry.SetPriority (current_Header.GetTrafficClass ());
+      entry.SetEpidemicHeader (current_Header);
+      ++m_newPacketCount;
+      return Buffer (std::move (entry));
     }
 
-  // Check energy before forwarding
-  double energyRatio = GetRemainingEnergyRatio ();
-  if (energyRatio <= m_energyThresholdCritical * 0.5)
+  return HandleDataPacket (p, header, iif, ucb, lcb, ecb);
+}
+
+bool
+EnergyAwareRoutingProtocol::HandleDataPacket (Ptr<const Packet> p,
+                                              const Ipv4Header &header,
+                                              uint32_t iif,
+                                              const UnicastForwardCallback &ucb,
+                                              const LocalDeliverCallback &lcb,
+                                              const ErrorCallback &ecb)
+{
+  NS_LOG_FUNCTION (this << p << header << iif);
+  Ipv4Address dst = header.GetDestination ();
+  Ipv4Address origin = header.GetSource ();
+
+  // Most packets heard by a relay are copies it already has: check the
+  // leading header fields before copying the packet and parsing the header
+  EpidemicHeader::Fields fields;
+  if (!EpidemicHeader::PeekFields (p, fields))
     {
-      NS_LOG_DEBUG ("Energy critically low (" << energyRatio << "), dropping packet");
+      NS_LOG_DEBUG ("Data packet too short for an epidemic header, drop");
       return false;
     }
+  uint32_t packetID = fields.m_packetID;
+  Time expireTime = fields.m_timeStamp + m_queueEntryExpireTime;
 
-  // For epidemic routing in ad-hoc networks, we forward packets
-  // This is a simplified implementation - just forward the packet
-  NS_LOG_DEBUG ("Forwarding packet from " << origin << " to " << dst);
+  if (m_queue.Find (packetID))
+    {
+      NS_LOG_LOGIC ("Packet " << packetID << " is already buffered, drop");
+      return true;
+    }
+  if (IsImmune (packetID))
+    {
+      NS_LOG_LOGIC ("Packet " << packetID << " is known to be delivered, drop");
+      return true;
+    }
 
-  // Create a route for forwarding
-  Ptr<Ipv4Route> route = Create<Ipv4Route> ();
+  bool local = m_ipv4->IsDestinationAddress (dst, iif);
+  if (!local && (fields.m_hopCount <= 1 || expireTime < Simulator::Now ()))
+    {
+      NS_LOG_LOGIC ("Packet " << packetID << " exhausted its hop count or lifetime, drop");
+      return false;
+    }
+  // The filter may hold false positives: only relays consult it
+  if (!local && !fields.m_custody && m_seen.Contains (packetID))
+    {
+      NS_LOG_LOGIC ("Packet " << packetID << " was relayed or refused recently, drop");
+      return true;
+    }
 
-  // Find an output interface (prefer the one packet came from for now)
-  uint32_t oif = iif;
-  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); ++i)
+  EpidemicHeader current_Header;
+  Ptr<Packet> copy = p->Copy ();
+  copy->RemoveHeader (current_Header);
+  // The custody mark only holds for the transfer
+  current_Header.SetCustody (false);
+
+  // Data packet addressed to this node
+  if (local)
     {
-      if (m_ipv4->IsUp (i) && m_ipv4->GetNAddresses (i) > 0 && i != iif)
+      if (lcb.IsNull ())
         {
-          oif = i;
-          break;
+          NS_LOG_ERROR ("Local delivery callback is null");
+          return false;
+        }
+      NS_LOG_DEBUG ("Local delivery of packet " << packetID << " to " << dst);
+      if (m_immunityListSize > 0)
+        {
+          // Acknowledge it network-wide through our beacons
+          AddImmunity (packetID, expireTime);
         }
+      else
+        {
+          // Keep it buffered so that our summary vector stops neighbors
+          // from sending it again; the stack strips the delivered copy
+          QueueEntry entry (copy->Copy (), header, ucb, ecb, expireTime, packetID);
+          entry.SetPriority (current_Header.GetTrafficClass ());
+          entry.SetEpidemicHeader (current_Header);
+          Buffer (std::move (entry));
+        }
+      if (current_Header.GetCodec () != 0)
+        {
+          copy = RestorePayload (copy, current_Header, header);
+          if (!copy)
+            {
+              NS_LOG_WARN ("Unknown codec " << (uint32_t) current_Header.GetCodec ()
+                           << " for packet " << packetID << ", drop");
+              return true;
+            }
+        }
+      Ipv4Header localHeader = header;
+      localHeader.SetPayloadSize (copy->GetSize ());
+      m_deliveryTrace (copy, Simulator::Now () - fields.m_timeStamp);
+      lcb (copy, localHeader, iif);
+      return true;
     }
 
-  Ipv4InterfaceAddress ifAddr = m_ipv4->GetAddress (oif, 0);
-  route->SetSource (ifAddr.GetLocal ());
-  route->SetDestination (dst);
-  route->SetGateway (dst); // Direct transmission in ad-hoc
-  route->SetOutputDevice (m_ipv4->GetNetDevice (oif));
+  // Relay: take custody of a packet for another node
+  // Check energy before forwarding
+  double energyRatio = GetEffectiveEnergyRatio ();
+  if (energyRatio <= m_energyThresholdCritical * 0.5)
+    {
+      NS_LOG_DEBUG ("Energy critically low (" << energyRatio << "), dropping packet");
+      m_energyRejectedTrace (p);
+      return false;
+    }
+  uint32_t traveledHops = fields.m_hopCount < m_hopCount ? m_hopCount - fields.m_hopCount : 0;
+  // Decided once per lifetime: coming back after an eviction or
+  // another coin toss would only spend energy on the same packet again
+  m_seen.Insert (packetID);
+  // A custodian takes what a node running out of energy hands over
+  if (!fields.m_custody
+      && (traveledHops >= m_maxHopsEnergyAware || !ShouldForwardPacket (current_Header)))
+    {
+      NS_LOG_DEBUG ("Not relaying packet " << packetID << " at energy ratio " << energyRatio);
+      m_energyRejectedTrace (p);
+      return false;
+    }
 
-  // Forward the packet
-  ucb (route, p, header);
+  NS_LOG_DEBUG ("Buffering packet " << packetID << " from " << origin << " to " << dst);
+  // Only the parsed header changes: the payload is buffered as received
+  current_Header.SetHopCount (fields.m_hopCount - 1);
+  QueueEntry entry (copy, header, ucb, ecb, expireTime, packetID);
+  entry.SetPriority (current_Header.GetTrafficClass ());
+  entry.SetEpidemicHeader (current_Header);
+  ++m_newPacketCount;
+  Buffer (std::move (entry));
   return true;
 }
 
-void
-EnergyAwareRoutingProtocol::SendPacketFromQueue (Ipv4Address dst, QueueEntry queueEntry)
+bool
+EnergyAwareRoutingProtocol::SendPacketFromQueue (Ipv4Address dst, const QueueEntry &queueEntry,
+                                                 bool custody)
 {
-  NS_LOG_FUNCTION (this << dst);
+  NS_LOG_FUNCTION (this << dst << queueEntry.GetPacketID ());
   
   // Check energy before sending
   if (!IsEnergyAwareForwarding (queueEntry))
     {
       NS_LOG_DEBUG ("Skipping packet transmission due to energy constraints");
-      return;
+      m_energyRejectedTrace (queueEntry.GetPacket ());
+      return false;
     }
-  
-  // TODO: Implement epidemic packet sending from queue
-  // This method needs to send the packet using the epidemic routing protocol
-  NS_LOG_DEBUG ("Sending packet from queue to " << dst);
-  // Full implementation needed here
+
+  UnicastForwardCallback ucb = queueEntry.GetUnicastForwardCallback ();
+  UpdateInterfaceCache ();
+  if (ucb.IsNull () || m_mainInterface < 0)
+    {
+      NS_LOG_DEBUG ("No way to send packet " << queueEntry.GetPacketID ());
+      return false;
+    }
+
+  Ipv4Header header = queueEntry.GetIpv4Header ();
+  Ptr<const Packet> p = custody
+    ? CustodyPacket (queueEntry) : SprayPacket (queueEntry, dst);
+  if (!p)
+    {
+      return false;
+    }
+  /*
+   *  Since Epidemic routing has a control mechanism to drop packets based
+   *  on hop count, IP TTL dropping mechanism has to be avoided by
+   *  incrementing TTL
+   */
+  header.SetTtl (header.GetTtl () + 1);
+  header.SetPayloadSize (p->GetSize ());
+
+  Ptr<Ipv4Route> rt = GetRoute (header.GetDestination (), dst, m_mainInterface, m_mainInterface);
+  NS_LOG_DEBUG ("Sending packet " << queueEntry.GetPacketID () << " from queue to " << dst);
+  m_dataSentTrace (p, dst);
+  ucb (rt, p, header);
+  return true;
+}
+
+Ptr<Packet>
+EnergyAwareRoutingProtocol::SprayPacket (const QueueEntry &entry, Ipv4Address dest)
+{
+  uint32_t packetID = entry.GetPacketID ();
+  NS_LOG_FUNCTION (this << packetID << dest);
+  Ipv4Address destination = entry.GetIpv4Header ().GetDestination ();
+  if (IsMyOwnAddress (destination))
+    {
+      // Delivered here, only buffered to keep it in our summary vector
+      return 0;
+    }
+  if (m_forwardingMode != FORWARD_SPRAY_AND_WAIT || dest == destination)
+    {
+      // Handing the packet to its destination never costs a copy
+      return entry.GetPacketWithHeader ();
+    }
+  EpidemicHeader header = entry.GetEpidemicHeader ();
+  if (header.GetCopies () == 0)
+    {
+      // No budget: the source forwards epidemically
+      return entry.GetPacketWithHeader ();
+    }
+  uint16_t handed = header.GetCopies () / 2;
+  if (handed == 0)
+    {
+      NS_LOG_LOGIC ("Packet " << packetID << " waits for its destination");
+      return 0;
+    }
+
+  // Binary spray: the buffered entry keeps the other half of the copies.
+  // Both share the payload; the caller may hold the buffered entry itself,
+  // so it is rewritten in place rather than enqueued again
+  Ptr<const Packet> payload = entry.GetPacket ();
+  header.SetCopies (header.GetCopies () - handed);
+  m_queue.SetEpidemicHeader (packetID, header);
+
+  NS_LOG_LOGIC ("Handing " << handed << " copies of packet " << packetID << " to " << dest);
+  header.SetCopies (handed);
+  Ptr<Packet> packet = payload->Copy ();
+  packet->AddHeader (header);
+  return packet;
 }
 
 Ptr<Ipv4Route>
@@ -437,7 +1796,7 @@ EnergyAwareRoutingProtocol::RouteOutput (Ptr<Packet> p, const Ipv4Header &header
   NS_LOG_DEBUG ("RouteOutput: packet from " << src << " to " << dst);
 
   // Check energy before creating route
-  double energyRatio = GetRemainingEnergyRatio ();
+  double energyRatio = GetEffectiveEnergyRatio ();
   if (energyRatio <= m_energyThresholdCritical * 0.5)
     {
       NS_LOG_WARN ("Energy critically low (" << energyRatio << "), cannot route");
@@ -446,65 +1805,100 @@ EnergyAwareRoutingProtocol::RouteOutput (Ptr<Packet> p, const Ipv4Header &header
     }
 
   // Find the output interface
-  uint32_t interface = 0;
-  bool interfaceFound = false;
-
-  if (oif)
-    {
-      int32_t ifIndex = m_ipv4->GetInterfaceForDevice (oif);
-      if (ifIndex >= 0)
-        {
-          interface = static_cast<uint32_t> (ifIndex);
-          interfaceFound = true;
-        }
-    }
-
-  // If no interface specified, find first available non-loopback interface
-  if (!interfaceFound)
+  UpdateInterfaceCache ();
+  int32_t interface = oif ? m_ipv4->GetInterfaceForDevice (oif) : -1;
+  if (interface < 0)
     {
-      for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); ++i)
-        {
-          // Skip loopback interface (usually interface 0)
-          if (i == 0 && m_ipv4->GetNInterfaces () > 1)
-            continue;
-
-          if (m_ipv4->IsUp (i) && m_ipv4->GetNAddresses (i) > 0)
-            {
-              interface = i;
-              interfaceFound = true;
-              NS_LOG_DEBUG ("Selected interface " << i << " for routing");
-              break;
-            }
-        }
+      // First available non-loopback interface
+      interface = m_outputInterface;
     }
-
-  if (!interfaceFound)
+  if (interface < 0 || m_ipv4->GetNAddresses (interface) == 0)
     {
       NS_LOG_WARN ("No valid interface found");
       sockerr = Socket::ERROR_NOROUTETOHOST;
       return nullptr;
     }
 
-  // Check if destination is local
-  if (m_ipv4->IsDestinationAddress (dst, interface))
+  // Control packets and broadcasts go straight to the neighbors.  Data
+  // packets are looped back to RouteInput, which adds the epidemic header
+  // and stores them until a neighbor asks for them
+  ControlTag tag;
+  bool isControl = p && p->PeekPacketTag (tag) && tag.IsTagType (ControlTag::CONTROL);
+  bool direct = isControl || dst.IsBroadcast () || dst.IsMulticast ();
+  if (!direct && m_loopbackInterface < 0)
     {
-      NS_LOG_DEBUG ("Destination " << dst << " is local");
-      sockerr = Socket::ERROR_NOTERROR;
+      NS_LOG_WARN ("No loopback interface found");
+      sockerr = Socket::ERROR_NOROUTETOHOST;
       return nullptr;
     }
+  // Direct delivery in ad-hoc network
+  Ptr<Ipv4Route> route = GetRoute (dst, dst, interface, direct ? interface : m_loopbackInterface);
 
-  // Create route for epidemic routing
-  Ptr<Ipv4Route> route = Create<Ipv4Route> ();
+  sockerr = Socket::ERROR_NOTERROR;
+  NS_LOG_DEBUG ("Route: " << route->GetSource () << " -> " << dst
+                << " via " << (direct ? "interface " : "loopback, interface ") << interface);
+  return route;
+}
 
-  Ipv4InterfaceAddress ifAddr = m_ipv4->GetAddress (interface, 0);
-  route->SetSource (ifAddr.GetLocal ());
-  route->SetDestination (dst);
-  route->SetGateway (dst); // Direct delivery in ad-hoc network
-  route->SetOutputDevice (m_ipv4->GetNetDevice (interface));
+void
+EnergyAwareRoutingProtocol::InvalidateRouteCache ()
+{
+  NS_LOG_FUNCTION (this);
+  m_interfaceCacheValid = false;
+  m_routeCache.clear ();
+  m_txCosts.clear ();
+}
 
-  sockerr = Socket::ERROR_NOTERROR;
-  NS_LOG_DEBUG ("Created route: " << route->GetSource () << " -> " << dst
-                << " via interface " << interface);
+void
+EnergyAwareRoutingProtocol::UpdateInterfaceCache ()
+{
+  if (m_interfaceCacheValid)
+    {
+      return;
+    }
+  NS_LOG_FUNCTION (this);
+  m_loopbackInterface = -1;
+  m_outputInterface = -1;
+  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); ++i)
+    {
+      if (m_ipv4->GetNAddresses (i) == 0)
+        {
+          continue;
+        }
+      if (m_ipv4->GetAddress (i, 0).GetLocal () == Ipv4Address::GetLoopback ())
+        {
+          m_loopbackInterface = i;
+        }
+      else if (m_outputInterface < 0 && m_ipv4->IsUp (i))
+        {
+          m_outputInterface = i;
+        }
+    }
+  m_mainInterface = m_mainAddress == Ipv4Address ()
+    ? -1 : m_ipv4->GetInterfaceForAddress (m_mainAddress);
+  m_interfaceCacheValid = true;
+}
+
+Ptr<Ipv4Route>
+EnergyAwareRoutingProtocol::GetRoute (Ipv4Address destination, Ipv4Address gateway,
+                                      uint32_t sourceInterface, uint32_t outputInterface)
+{
+  RouteKey key (destination.Get (), gateway.Get (), sourceInterface, outputInterface);
+  std::map<RouteKey, Ptr<Ipv4Route> >::const_iterator i = m_routeCache.find (key);
+  if (i != m_routeCache.end ())
+    {
+      return i->second;
+    }
+  if (m_routeCache.size () >= ROUTE_CACHE_SIZE)
+    {
+      m_routeCache.clear ();
+    }
+  Ptr<Ipv4Route> route = Create<Ipv4Route> ();
+  route->SetSource (m_ipv4->GetAddress (sourceInterface, 0).GetLocal ());
+  route->SetDestination (destination);
+  route->SetGateway (gateway);
+  route->SetOutputDevice (m_ipv4->GetNetDevice (outputInterface));
+  m_routeCache.insert (std::make_pair (key, route));
   return route;
 }
 
@@ -513,6 +1907,11 @@ EnergyAwareRoutingProtocol::PrintRoutingTable (Ptr<OutputStreamWrapper> stream,
 {
   NS_LOG_FUNCTION (this << stream);
   std::ostream* os = stream->GetStream ();
+  if (m_routingTableFormat != ROUTING_TABLE_TEXT)
+    {
+      PrintSnapshot (*os, unit);
+      return;
+    }
 
   // Print header
   *os << "================================================================\n";
@@ -524,6 +1923,9 @@ EnergyAwareRoutingProtocol::PrintRoutingTable (Ptr<OutputStreamWrapper> stream,
   double energyRatio = GetRemainingEnergyRatio ();
   *os << "Energy Status:\n";
   *os << "  Remaining Energy Ratio: " << (energyRatio * 100) << "%\n";
+  *os << "  Net Harvest Power: " << m_netPower << " W, Effective Energy Ratio: "
+      << (GetEffectiveEnergyRatio () * 100) << "%"
+      << (m_depleted ? ", depleted, beacons paused" : "") << "\n";
 
   if (energyRatio > 0.7)
     *os << "  Energy Level: NORMAL (Green)\n";
@@ -537,35 +1939,48 @@ EnergyAwareRoutingProtocol::PrintRoutingTable (Ptr<OutputStreamWrapper> stream,
     *os << "  Energy Level: DEPLETED (Gray)\n";
 
   *os << "  Adaptive Beacon Interval: " << m_adaptiveBeaconInterval.As (unit) << "\n";
+  *os << "  Neighbors: " << m_neighbors.GetSize ()
+      << ", New Packets Per Second: " << m_packetArrivalRate << "\n";
   *os << "  Max Hops (Energy-Aware): " << m_maxHopsEnergyAware << "\n";
 
   // Print queue status
   *os << "\nPacket Buffer Status:\n";
   *os << "  Queue Size: " << m_queue.GetSize () << "/" << m_maxQueueLen << " packets\n";
+  *os << "  By Class: bulk " << m_queue.GetSize (EpidemicHeader::BULK)
+      << ", voice " << m_queue.GetSize (EpidemicHeader::VOICE)
+      << ", alert " << m_queue.GetSize (EpidemicHeader::ALERT) << "\n";
   *os << "  Queue Timeout: " << m_queueEntryExpireTime.As (unit) << "\n";
+  *os << "  Delivered Packets Remembered: " << m_immunity.size () << "/"
+      << m_immunityListSize << "\n";
+  *os << "  Duplicate Filter: " << m_seen.GetCount () << " IDs in the current generation, "
+      << m_seen.GetSize () << " bits\n";
 
   // Print recent host contacts
   *os << "\nRecent Node Contacts:\n";
-  if (m_hostContactTime.empty ())
+  if (m_hostContacts.GetSize () == 0)
     {
       *os << "  No recent contacts\n";
     }
   else
     {
-      for (auto it = m_hostContactTime.begin (); it != m_hostContactTime.end (); ++it)
-        {
-          Time lastContact = it->second;
-          Time timeSince = Simulator::Now () - lastContact;
-          *os << "  Node " << it->first << " - Last contact: "
-              << timeSince.As (unit) << " ago\n";
-        }
+      m_hostContacts.Print (*os, unit);
     }
+  *os << "  Contact Table Memory: " << m_hostContacts.GetMemoryUsage () << " bytes ("
+      << m_hostContacts.GetCapacity () << " slots)\n";
 
   // Print epidemic routing parameters
   *os << "\nRouting Protocol Parameters:\n";
   *os << "  Max Hop Count: " << m_hopCount << "\n";
   *os << "  Beacon Interval: " << m_beaconInterval.As (unit) << "\n";
   *os << "  Host Recent Period: " << m_hostRecentPeriod.As (unit) << "\n";
+  if (m_forwardingMode == FORWARD_SPRAY_AND_WAIT)
+    {
+      *os << "  Forwarding: Spray-and-Wait, " << m_sprayCopies << " copies\n";
+    }
+  else
+    {
+      *os << "  Forwarding: Epidemic\n";
+    }
 
   // Print network interfaces
   *os << "\nNetwork Interfaces:\n";
@@ -590,32 +2005,130 @@ EnergyAwareRoutingProtocol::PrintRoutingTable (Ptr<OutputStreamWrapper> stream,
   *os << "================================================================\n\n";
 }
 
+void
+EnergyAwareRoutingProtocol::PrintSnapshot (std::ostream &os, Time::Unit unit) const
+{
+  Ptr<Node> node = m_ipv4 ? m_ipv4->GetObject<Node> () : 0;
+  std::ostringstream address;
+  address << m_mainAddress;
+  const char *format = m_routingTableFormat == ROUTING_TABLE_JSON
+    ? "{\"time\":%.6g,\"node\":%u,\"address\":\"%s\",\"remaining_j\":%.6g,"
+      "\"energy_ratio\":%.4f,\"effective_ratio\":%.4f,\"state\":%d,\"depleted\":%d,"
+      "\"queue\":%u,\"queue_max\":%u,\"beacon_interval\":%.6g,\"neighbors\":%u,"
+      "\"contacts\":%u}\n"
+    : "R,%.6g,%u,%s,%.6g,%.4f,%.4f,%d,%d,%u,%u,%.6g,%u,%u\n";
+  char line[384];
+  int length = std::snprintf (line, sizeof (line), format,
+                              Simulator::Now ().ToDouble (unit), node ? node->GetId () : 0,
+                              address.str ().c_str (), m_lastRemainingEnergy,
+                              GetRemainingEnergyRatio (), GetEffectiveEnergyRatio (),
+                              m_energyState, m_depleted, m_queue.GetSize (), m_maxQueueLen,
+                              m_adaptiveBeaconInterval.ToDouble (unit), m_neighbors.GetSize (),
+                              m_hostContacts.GetSize ());
+  if (length > 0)
+    {
+      os.write (line, std::min<int> (length, sizeof (line) - 1));
+    }
+}
+
+void
+EnergyAwareRoutingProtocol::QueueDropped (const QueueEntry &entry, PacketQueue::DropReason reason)
+{
+  NS_LOG_FUNCTION (this << entry.GetPacketID () << PacketQueue::GetDropReasonName (reason));
+  m_queueDropTrace (entry.GetPacket (), reason);
+}
+
+void
+EnergyAwareRoutingProtocol::CreateSocket (uint32_t interface)
+{
+  NS_LOG_FUNCTION (this << interface);
+  if (m_ipv4->GetNAddresses (interface) == 0)
+    {
+      return;
+    }
+  if (m_ipv4->GetNAddresses (interface) > 1)
+    {
+      NS_LOG_WARN ("Epidemic does not work with more then one address per each interface.");
+    }
+  Ipv4InterfaceAddress iface = m_ipv4->GetAddress (interface, 0);
+  if (iface.GetLocal () == Ipv4Address::GetLoopback () || FindSocketWithInterfaceAddress (iface))
+    {
+      return;
+    }
+  if (m_mainAddress == Ipv4Address ())
+    {
+      m_mainAddress = iface.GetLocal ();
+    }
+
+  // Create a socket to listen only on this interface
+  Ptr<Socket> socket = Socket::CreateSocket (m_ipv4->GetObject<Node> (),
+                                             UdpSocketFactory::GetTypeId ());
+  NS_ASSERT (socket != 0);
+  socket->SetRecvCallback (MakeCallback (&EnergyAwareRoutingProtocol::RecvEpidemic, this));
+  socket->BindToNetDevice (m_ipv4->GetNetDevice (interface));
+  socket->Bind (InetSocketAddress (Ipv4Address::GetAny (), EPIDEMIC_PORT));
+  socket->SetAllowBroadcast (true);
+  socket->SetIpTtl (1);
+  m_socketAddresses.insert (std::make_pair (socket, iface));
+}
+
 void
 EnergyAwareRoutingProtocol::NotifyInterfaceUp (uint32_t interface)
 {
   NS_LOG_FUNCTION (this << interface);
-  // TODO: Handle interface up event
+  InvalidateRouteCache ();
+  CreateSocket (interface);
 }
 
 void
 EnergyAwareRoutingProtocol::NotifyInterfaceDown (uint32_t interface)
 {
   NS_LOG_FUNCTION (this << interface);
-  // TODO: Handle interface down event
+  InvalidateRouteCache ();
+  if (m_ipv4->GetNAddresses (interface) == 0)
+    {
+      return;
+    }
+  Ptr<Socket> socket = FindSocketWithInterfaceAddress (m_ipv4->GetAddress (interface, 0));
+  if (socket)
+    {
+      socket->Close ();
+      m_socketAddresses.erase (socket);
+    }
 }
 
 void
 EnergyAwareRoutingProtocol::NotifyAddAddress (uint32_t interface, Ipv4InterfaceAddress address)
 {
   NS_LOG_FUNCTION (this << interface << address);
-  // TODO: Handle address addition
+  InvalidateRouteCache ();
+  if (m_ipv4->IsUp (interface))
+    {
+      CreateSocket (interface);
+    }
 }
 
 void
 EnergyAwareRoutingProtocol::NotifyRemoveAddress (uint32_t interface, Ipv4InterfaceAddress address)
 {
   NS_LOG_FUNCTION (this << interface << address);
-  // TODO: Handle address removal
+  InvalidateRouteCache ();
+  Ptr<Socket> socket = FindSocketWithInterfaceAddress (address);
+  if (socket)
+    {
+      socket->Close ();
+      m_socketAddresses.erase (socket);
+    }
+  if (address.GetLocal () == m_mainAddress)
+    {
+      m_mainAddress = m_socketAddresses.empty () ? Ipv4Address ()
+        : m_socketAddresses.begin ()->second.GetLocal ();
+    }
+  // The interface may still have another address to listen on
+  if (m_ipv4->IsUp (interface))
+    {
+      CreateSocket (interface);
+    }
 }
 
 void
@@ -623,7 +2136,84 @@ EnergyAwareRoutingProtocol::SetIpv4 (Ptr<Ipv4> ipv4)
 {
   NS_LOG_FUNCTION (this << ipv4);
   m_ipv4 = ipv4;
-  // TODO: Initialize routing protocol with IPv4
+  InvalidateRouteCache ();
+  Simulator::ScheduleNow (&EnergyAwareRoutingProtocol::Start, this);
+}
+
+void
+EnergyAwareRoutingProtocol::Start ()
+{
+  NS_LOG_FUNCTION (this);
+  // Attributes are only known once the object is configured
+  m_queue.SetMaxQueueLen (m_maxQueueLen);
+  m_queue.SetDropPolicy (m_dropPolicy);
+  if (m_policies.m_evictionRank)
+    {
+      m_queue.SetEvictionRank (m_policies.m_evictionRank);
+    }
+  m_hostContacts.SetPeriod (m_hostRecentPeriod);
+  m_seen.SetSize (m_duplicateFilterSize);
+  m_seen.SetPeriod (m_queueEntryExpireTime);
+  m_neighbors.SetPeriod (m_maxBeaconInterval);
+  m_lastBeaconTime = Simulator::Now ();
+  m_adaptiveBeaconInterval = m_beaconInterval;
+  m_maxHopsEnergyAware = m_hopCount;
+  m_beaconJitter->SetAttribute ("Max", DoubleValue (m_beaconMaxJitterMs));
+  if (!m_dataCodec)
+    {
+      m_dataCodec = CreateObject<LzPayloadCodec> ();
+    }
+  if (!m_voiceCodec)
+    {
+      m_voiceCodec = CreateObject<DownsamplePayloadCodec> ();
+    }
+  // Thresholds may have changed since the energy source was set
+  UpdateEnergyRatio ();
+  HandleLowEnergy ();
+  // SetEnergySource may have started the polling already
+  if (!m_energyUpdateTimer.IsRunning ())
+    {
+      EnergyUpdateTimerExpire ();
+    }
+  // A depleted node beacons again once HandleEnergyRecharged runs, which
+  // may also have restarted the beacons already
+  if (!m_depleted && !m_beaconTimer.IsRunning ())
+    {
+      m_beaconTimer.Schedule (m_beaconInterval + MilliSeconds (m_beaconJitter->GetValue ()));
+    }
+}
+
+void
+EnergyAwareRoutingProtocol::DoDispose ()
+{
+  NS_LOG_FUNCTION (this);
+  m_beaconTimer.Cancel ();
+  m_energyUpdateTimer.Cancel ();
+  m_expiryTimer.Cancel ();
+  if (m_energySource && m_energyTraceConnected)
+    {
+      m_energySource->TraceDisconnectWithoutContext
+        ("RemainingEnergy", MakeCallback (&EnergyAwareRoutingProtocol::RemainingEnergyChanged, this));
+      m_energyTraceConnected = false;
+    }
+  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::iterator iter =
+         m_socketAddresses.begin (); iter != m_socketAddresses.end (); ++iter)
+    {
+      iter->first->Close ();
+    }
+  m_socketAddresses.clear ();
+  m_routeCache.clear ();
+  m_txCosts.clear ();
+  m_immunity.clear ();
+  m_immunityExpiry.clear ();
+  m_ucb = UnicastForwardCallback ();
+  m_lcb = LocalDeliverCallback ();
+  m_ecb = ErrorCallback ();
+  m_energySource = 0;
+  m_dataCodec = 0;
+  m_voiceCodec = 0;
+  m_ipv4 = 0;
+  Ipv4RoutingProtocol::DoDispose ();
 }
 
 } // namespace Epidemic
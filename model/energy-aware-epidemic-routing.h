@@ -7,8 +7,12 @@
 #ifndef ENERGY_AWARE_EPIDEMIC_ROUTING_H
 #define ENERGY_AWARE_EPIDEMIC_ROUTING_H
 
+#include "epidemic-contact-table.h"
+#include "epidemic-duplicate-filter.h"
 #include "epidemic-packet-queue.h"
 #include "epidemic-packet.h"
+#include "epidemic-payload-codec.h"
+#include "epidemic-policy.h"
 #include "epidemic-tag.h"
 #include "ns3/energy-module.h"
 #include "ns3/device-energy-model.h"
@@ -16,8 +20,14 @@
 #include "ns3/ipv4-interface.h"
 #include "ns3/ipv4-l3-protocol.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/data-rate.h"
 #include "ns3/timer.h"
 #include "ns3/socket.h"
+#include "ns3/traced-callback.h"
+#include <map>
+#include <set>
+#include <tuple>
+#include <vector>
 
 namespace ns3 {
 namespace Epidemic {
@@ -35,6 +45,68 @@ class EnergyAwareRoutingProtocol : public Ipv4RoutingProtocol
 {
 public:
   static TypeId GetTypeId (void);
+
+  /// Energy level of the node relative to the configured thresholds
+  enum EnergyState
+  {
+    ENERGY_NORMAL,   //!< Above EnergyThresholdLow
+    ENERGY_LOW,      //!< At or below EnergyThresholdLow
+    ENERGY_CRITICAL, //!< At or below EnergyThresholdCritical
+  };
+
+  /// How many copies of a packet a node hands out
+  enum ForwardingMode
+  {
+    FORWARD_EPIDEMIC,       //!< A copy to every neighbor missing the packet
+    FORWARD_SPRAY_AND_WAIT, //!< Binary spray-and-wait with a per-packet copy budget
+  };
+
+  /// Output of PrintRoutingTable
+  enum RoutingTableFormat
+  {
+    ROUTING_TABLE_TEXT, //!< Human-readable report of about 40 lines
+    ROUTING_TABLE_CSV,  //!< One comma separated line
+    ROUTING_TABLE_JSON, //!< One JSON object on a line
+  };
+
+  /**
+   * TracedCallback signature for energy state changes.
+   *
+   * \param [in] oldState The previous energy state.
+   * \param [in] newState The new energy state.
+   * \param [in] ratio The effective energy ratio that caused the change.
+   */
+  typedef void (* EnergyStateChangedCallback)
+    (EnergyState oldState, EnergyState newState, double ratio);
+  /**
+   * TracedCallback signature for data packets handed to a neighbor.
+   *
+   * \param [in] packet The packet, starting with its EpidemicHeader.
+   * \param [in] neighbor The neighbor the packet is sent to.
+   */
+  typedef void (* DataSentCallback) (Ptr<const Packet> packet, Ipv4Address neighbor);
+  /**
+   * TracedCallback signature for packets dropped from the buffer.
+   *
+   * \param [in] packet The buffered packet, without its EpidemicHeader.
+   * \param [in] reason Why the packet was dropped.
+   */
+  typedef void (* QueueDropCallback) (Ptr<const Packet> packet, PacketQueue::DropReason reason);
+  /**
+   * TracedCallback signature for packets delivered to this node.
+   *
+   * \param [in] packet The packet, without its EpidemicHeader.
+   * \param [in] delay Time since the packet was originated.
+   */
+  typedef void (* DeliveryCallback) (Ptr<const Packet> packet, Time delay);
+  /**
+   * TracedCallback signature for buffers handed over to a neighbor.
+   *
+   * \param [in] neighbor The neighbor taking custody of the packets.
+   * \param [in] packets The number of packets its summary vector listed,
+   *  dropped here.
+   */
+  typedef void (* CustodyTransferCallback) (Ipv4Address neighbor, uint32_t packets);
   
   EnergyAwareRoutingProtocol ();
   virtual ~EnergyAwareRoutingProtocol ();
@@ -53,12 +125,136 @@ public:
   virtual void NotifyRemoveAddress (uint32_t interface, Ipv4InterfaceAddress address) override;
   virtual void SetIpv4 (Ptr<Ipv4> ipv4) override;
 
+  /**
+   * Assign a fixed random variable stream number to the random variables
+   * used by this model.  Return the number of streams (possibly zero) that
+   * have been assigned.
+   *
+   * \param stream first stream index to use
+   * \return the number of stream indices assigned by this model
+   */
+  int64_t AssignStreams (int64_t stream);
+
   // Energy-aware routing methods
   void SetEnergySource (Ptr<energy::EnergySource> source);
+  /**
+   * \brief Set the forwarding, energy budget and eviction policies.
+   *
+   * Normally called by EnergyAwareEpidemicHelper at install time.  An
+   * eviction policy of the set replaces the DropPolicy attribute.
+   * \param policies the policy set, see MakePolicySet.
+   */
+  void SetPolicies (const PolicySet &policies);
+  /// \return the forwarding, energy budget and eviction policies.
+  const PolicySet & GetPolicies () const;
+  /// \return the buffer of packets carried for their destinations.
+  const PacketQueue & GetQueue () const;
+  /**
+   * \brief Get the cached remaining energy ratio.
+   *
+   * The ratio is refreshed from the energy source by UpdateEnergyRatio,
+   * so this is cheap enough for the per-packet path.
+   * \return remaining energy over initial energy, 1 without energy source.
+   */
   double GetRemainingEnergyRatio () const;
+  /**
+   * \brief Get the energy ratio the energy thresholds are applied to.
+   *
+   * The remaining energy ratio, plus the energy the node gains over
+   * HarvestHorizon at its net harvest power when that power is positive,
+   * capped at 1.  A node harvesting more than it spends thus keeps
+   * relaying and beaconing as a full node would.
+   * \return the harvest-credited energy ratio.
+   */
+  double GetEffectiveEnergyRatio () const;
+  /**
+   * \return the moving average of harvested minus consumed power of the
+   *  energy source in W, positive while the battery charges.
+   */
+  double GetNetHarvestPower () const;
+  /// \return true between an energy depletion and the following recharge
+  bool IsEnergyDepleted () const;
+  /// \return the energy state matching the effective energy ratio
+  EnergyState GetEnergyState () const;
+  /**
+   * \brief Pause the beacons, the radio is no longer powered.
+   *
+   * Called when the remaining energy ratio falls to the low battery
+   * threshold of the energy source, at which a BasicEnergySource notifies
+   * its devices of the depletion; fires EnergyDepleted.
+   */
+  void HandleEnergyDepletion ();
+  /**
+   * \brief Resume the beacons paused by HandleEnergyDepletion ().
+   *
+   * Called when the remaining energy ratio recovers above the high battery
+   * threshold of the energy source; fires EnergyRecharged.  Schedules the
+   * next beacon anew when the depletion was found while a beacon was sent,
+   * which leaves no timer to resume.
+   */
+  void HandleEnergyRecharged ();
   bool ShouldForwardPacket (const EpidemicHeader& header) const;
+  /**
+   * \brief Get the copy budget of a packet originated now.
+   *
+   * In spray-and-wait mode the budget is SprayCopies scaled by the
+   * remaining energy ratio, and at least one copy, so a node low on
+   * energy recruits fewer relays for its packets.
+   * \return the number of copies, 0 (no limit) in epidemic mode.
+   */
+  uint16_t GetInitialCopies () const;
+  /**
+   * \brief Get the room for a custody transfer to \p neighbor.
+   *
+   * With CustodyTransfer, a node at or below EnergyThresholdLow hands its
+   * buffer over to the neighbor whose beacons advertise the highest energy
+   * ratio and some free space, provided that ratio is above both its own
+   * and EnergyThresholdLow.  Neighbors not heard for MaxBeaconInterval
+   * are forgotten.
+   * \param neighbor the neighbor of the anti-entropy session.
+   * \return the free space \p neighbor advertised, or 0 if no custody is
+   *  transferred to it.
+   */
+  uint32_t GetCustodySpace (Ipv4Address neighbor);
+  /**
+   * \brief Compute the next beacon interval.
+   *
+   * BeaconInterval is scaled up continuously as energy falls below
+   * EnergyThresholdLow (up to 4x when empty) and as the neighbor count
+   * exceeds TargetNeighbors, and scaled down with the rate of new packets
+   * to exchange (up to 4x).  A node with an empty buffer and no new packets
+   * beacons at half the rate.  The result is clamped to
+   * [MinBeaconInterval, MaxBeaconInterval].
+   */
   void AdaptBeaconInterval ();
+  /**
+   * \brief Resize the buffer for the current energy state.
+   *
+   * Called once per energy state change.  The buffer is shrunk by
+   * LowEnergyQueueFactor when energy is low, and by its square when energy
+   * is critical, evicting the lowest classes and oldest packets first;
+   * packets below CriticalTrafficClass are dropped at critical energy.
+   */
   void HandleLowEnergy ();
+  /**
+   * \brief Energy drawn from the battery by a transmission.
+   *
+   * The radio draws its TX current, read from the TxCurrentA attribute of
+   * the WifiRadioEnergyModel of the energy source, at the supply voltage of
+   * the source, for the airtime of the bytes at the PHY data rate, read
+   * from the DataMode of the station manager of the device, plus
+   * FrameOverhead per frame.  DefaultTxCurrent and DefaultPhyDataRate
+   * stand in for what cannot be read.  The per-byte and per-frame costs
+   * are cached per interface until the interfaces or the energy source
+   * change.
+   * \param bytes the number of bytes sent.
+   * \param frames the number of frames they are sent in.
+   * \return the energy in J, 0 without energy source.
+   */
+  double CalculateTransmissionCost (uint32_t bytes, uint32_t frames = 1) const;
+
+protected:
+  virtual void DoDispose () override;
 
 private:
   // Core epidemic routing members
@@ -66,51 +262,363 @@ private:
   Ipv4Address m_mainAddress;                  ///< Main IP address for the current node
   uint32_t m_hopCount;                        ///< Number of times a packet is resent
   uint32_t m_maxQueueLen;                     ///< Maximum number of packets a queue can hold
+  PacketQueue::DropPolicy m_dropPolicy;       ///< Packet selected for eviction when the queue is full
   Time m_queueEntryExpireTime;                ///< Time after which packet expires in queue
   Time m_beaconInterval;                      ///< Time for sending periodic beacon packets
   Time m_hostRecentPeriod;                    ///< Time for host recent period
   uint32_t m_beaconMaxJitterMs;               ///< Upper bound of random time added to beacon interval
+  Time m_minBeaconInterval;                   ///< Lower bound of the adaptive beacon interval
+  Time m_maxBeaconInterval;                   ///< Upper bound of the adaptive beacon interval
+  uint32_t m_targetNeighbors;                 ///< Neighbor count above which beacons slow down
   uint16_t m_dataPacketCounter;               ///< Local counter for data packets
   Ptr<Ipv4> m_ipv4;                          ///< Pointer to Ipv4 for current node
   std::map<Ptr<Socket>, Ipv4InterfaceAddress> m_socketAddresses; ///< Map between sockets and IP addresses
   PacketQueue m_queue;                        ///< Queue associated with a node
+  Timer m_expiryTimer;                        ///< Timer dropping the next expiring packets
   Timer m_beaconTimer;                        ///< Timer for sending beacons
   Ptr<UniformRandomVariable> m_beaconJitter;  ///< Random variable for beacon jitter
-  typedef std::map<Ipv4Address, Time> HostContactMap; ///< Type to connect host address to recent contact time
-  HostContactMap m_hostContactTime;           ///< Hash table to store recent contact time for nodes
+  HostContactTable m_hostContacts;            ///< Hash table to store recent contact time for nodes
+  HostContactTable m_neighbors;               ///< Neighbors heard beaconing within MaxBeaconInterval
+  uint32_t m_newPacketCount;                  ///< Packets buffered since the last beacon
+  double m_packetArrivalRate;                 ///< Moving average of packets buffered per second
+  Time m_lastBeaconTime;                      ///< Time of the last beacon interval update
 
   // Energy management
   Ptr<energy::EnergySource> m_energySource;
   double m_energyThresholdLow;     ///< Low energy threshold (0.2 = 20%)
   double m_energyThresholdCritical; ///< Critical energy threshold (0.1 = 10%)
+  double m_energyRatio;             ///< Cached remaining energy ratio
+  double m_effectiveEnergyRatio;    ///< Cached energy ratio credited with harvesting
+  EnergyState m_energyState;        ///< Energy state matching m_effectiveEnergyRatio
+  Time m_energyUpdateInterval;      ///< Polling period when the source has no RemainingEnergy trace
+  Timer m_energyUpdateTimer;        ///< Timer polling the energy source
+  bool m_energyTraceConnected;      ///< Whether the RemainingEnergy trace feeds the cache
+  /// Fired when the energy ratio crosses a threshold
+  TracedCallback<EnergyState, EnergyState, double> m_energyStateChangedTrace;
+
+  // Energy harvesting
+  static constexpr double NET_POWER_TIME_CONSTANT = 10.0; ///< Net power averaging period in s
+  double m_depletionThreshold;      ///< Energy ratio at which the source is depleted
+  double m_rechargeThreshold;       ///< Energy ratio above which the source is recharged
+  bool m_depleted;                  ///< Whether beacons are paused for depletion
+  Time m_harvestHorizon;            ///< Horizon of the harvested energy credited to the ratio
+  double m_netPower;                ///< Moving average of the net power of the source in W
+  double m_lastRemainingEnergy;     ///< Remaining energy at the last update in J
+  Time m_lastEnergyUpdate;          ///< Time of the last energy update
+  TracedCallback<> m_energyDepletedTrace;  ///< Fired when beacons are paused
+  TracedCallback<> m_energyRechargedTrace; ///< Fired when beacons are resumed
+
+  // Instrumentation
+  TracedCallback<Ptr<const Packet> > m_beaconSentTrace;        ///< Fired per beacon sent
+  TracedCallback<> m_beaconSkippedTrace;                       ///< Fired per beacon skipped for energy
+  TracedCallback<Ptr<const Packet> > m_summaryVectorSentTrace; ///< Fired per REPLY or REPLY_BACK sent
+  TracedCallback<Ptr<const Packet>, Ipv4Address> m_dataSentTrace; ///< Fired per buffered packet sent
+  TracedCallback<Ptr<const Packet>, PacketQueue::DropReason> m_queueDropTrace; ///< Fired per buffer drop
+  TracedCallback<Ptr<const Packet> > m_energyRejectedTrace;    ///< Fired per forward refused for energy
+  TracedCallback<Ptr<const Packet>, Time> m_deliveryTrace;     ///< Fired per packet delivered here
+  TracedCallback<Ipv4Address, uint32_t> m_custodyTransferTrace; ///< Fired per custody transfer
   
   // Adaptive parameters
   double m_energyAwareFloodingFactor; ///< Flooding reduction factor based on energy
+  double m_lowEnergyQueueFactor;      ///< Fraction of the buffer kept at low energy
+  Ptr<UniformRandomVariable> m_forwardingRng; ///< Random variable for probabilistic forwarding
   Time m_adaptiveBeaconInterval;      ///< Dynamic beacon interval
   uint32_t m_maxHopsEnergyAware;      ///< Reduced hop count for low energy
   
   // Multimedia optimization
-  uint32_t m_speechPacketPriority;    ///< Priority for speech packets
-  double m_compressionRatio;          ///< Dynamic compression ratio
+  EpidemicHeader::TrafficClass m_criticalTrafficClass; ///< Lowest class kept at critical energy
+  double m_compressionRatio;          ///< Largest compressed to original payload size ratio worth sending
+  Ptr<PayloadCodec> m_dataCodec;      ///< Codec of bulk and alert payloads
+  Ptr<PayloadCodec> m_voiceCodec;     ///< Codec of voice payloads
+
+  // Transmission cost model
+  double m_defaultTxCurrent;           ///< TX current when no radio energy model gives it, in A
+  DataRate m_defaultPhyDataRate;       ///< PHY rate when the device does not give it
+  Time m_frameOverhead;                ///< Airtime of preamble, MAC header, IFS and ACK per frame
+  /// Energy per byte and per frame, in J, of transmissions on an interface
+  struct TxCost
+  {
+    double m_perByte;  ///< Energy per byte
+    double m_perFrame; ///< Energy per frame
+  };
+  mutable std::map<int32_t, TxCost> m_txCosts; ///< Cached transmission costs by interface
+
+  // Control overhead
+  SummaryVectorHeader::Encoding m_summaryVectorEncoding; ///< Encoding used for REPLY packets
+  uint32_t m_bundleMtu;               ///< Maximum BUNDLE datagram size, 0 disables bundling
+
+  // Forwarding mode
+  ForwardingMode m_forwardingMode;     ///< Epidemic or spray-and-wait forwarding
+  uint16_t m_sprayCopies;              ///< Copy budget of a packet originated at full energy
+
+  // Custody transfer
+  bool m_custodyTransfer;              ///< Hand the buffer over to richer neighbors at low energy
+  /// Energy and buffer room a neighbor advertised in its last beacon
+  struct NeighborInfo
+  {
+    double m_energyRatio;                   ///< Effective energy ratio of the neighbor
+    uint16_t m_freeSpace;                   ///< Packets the neighbor can still buffer
+    Time m_lastSeen;                        ///< Time of its last beacon
+    SummaryVectorHeader m_immune;           ///< Delivered IDs its last beacon listed
+    std::vector<uint32_t> m_custodyPending; ///< Handed over, not yet in its summary vector
+  };
+  std::map<Ipv4Address, NeighborInfo> m_neighborInfo; ///< Neighbors heard within MaxBeaconInterval
+
+  // Delivery acknowledgements
+  uint32_t m_immunityListSize;         ///< Maximum number of delivered IDs remembered, 0 disables
+  std::map<uint32_t, Time> m_immunity; ///< Delivered packet IDs and when to forget them
+  std::set<std::pair<Time, uint32_t> > m_immunityExpiry; ///< m_immunity ordered by expire time
+
+  // Duplicate suppression
+  uint32_t m_duplicateFilterSize;      ///< Bits per generation of m_seen, 0 disables
+  DuplicateFilter m_seen;              ///< IDs of packets relayed or refused recently
+
+  // Routing table output
+  RoutingTableFormat m_routingTableFormat; ///< Text report or one-line snapshot
+
+  // Per-packet decisions
+  PolicySet m_policies;                ///< Forwarding, energy budget and eviction policies
+
+  // Forwarding callbacks of the IP layer, for packets unpacked from bundles
+  UnicastForwardCallback m_ucb;        ///< Unicast forward callback
+  LocalDeliverCallback m_lcb;          ///< Local delivery callback
+  ErrorCallback m_ecb;                 ///< Error callback
+
+  // Route cache, rebuilt when interfaces or addresses change
+  bool m_interfaceCacheValid;          ///< Whether the cached interface indexes are up to date
+  int32_t m_loopbackInterface;         ///< Loopback interface, -1 if none
+  int32_t m_outputInterface;           ///< First up non-loopback interface, -1 if none
+  int32_t m_mainInterface;             ///< Interface of m_mainAddress, -1 if none
+  /// Destination, gateway, source interface and output interface of a route
+  typedef std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> RouteKey;
+  std::map<RouteKey, Ptr<Ipv4Route> > m_routeCache; ///< Routes handed out so far
+  static const uint32_t ROUTE_CACHE_SIZE = 256;      ///< Route cache is flushed beyond this size
   
+  /**
+   * \brief Print a one-line snapshot of the node state.
+   *
+   * The line is formatted into a single buffer and written at once, so
+   * that periodic dumps of large networks stay cheap.
+   * \param os the output stream
+   * \param unit the time unit of the time and beacon interval fields
+   */
+  void PrintSnapshot (std::ostream &os, Time::Unit unit) const;
+  /**
+   * \brief Drop callback of m_queue, fires QueueDrop.
+   * \param entry the dropped entry.
+   * \param reason why it was dropped.
+   */
+  void QueueDropped (const QueueEntry &entry, PacketQueue::DropReason reason);
+
   // Core epidemic routing methods
   void Start ();
   void RecvEpidemic (Ptr<Socket> socket);
-  void SendDisjointPackets (SummaryVectorHeader packet_SMV, Ipv4Address dest);
+  void SendDisjointPackets (const SummaryVectorHeader &packet_SMV, Ipv4Address dest);
+  /**
+   * \brief Send all buffered packets listed in \p packetIds to \p dest
+   *  as one burst, from a single scheduled event.
+   * \param dest the neighbor taking part in the anti-entropy session.
+   * \param packetIds the IDs of the buffered packets to send.
+   * \param custody 0 to send copies, else the most packets to hand over
+   *  to \p dest whole, kept until its summary vector lists them.
+   */
+  void SendPacketBurst (Ipv4Address dest, SummaryVectorHeader packetIds, uint32_t custody);
+  /**
+   * \brief Drop the packets handed over to \p neighbor that it now holds.
+   *
+   * Packets handed over stay buffered until the next summary vector of
+   * their custodian lists them: the frame may be lost, or the custodian
+   * may evict them.  The others are handed over again.
+   * \param neighbor the custodian.
+   * \param packetIds the summary vector of \p neighbor.
+   */
+  void ConfirmCustody (Ipv4Address neighbor, const SummaryVectorHeader &packetIds);
+  /**
+   * \brief Get a buffered packet, marked for a custody transfer.
+   * \param entry the buffered packet.
+   * \return the packet with its EpidemicHeader.
+   */
+  Ptr<Packet> CustodyPacket (const QueueEntry &entry) const;
+  /**
+   * \brief Send a BUNDLE frame built by SendPacketBurst.
+   * \param bundle the concatenated bundle items.
+   * \param dest the neighbor to send the bundle to.
+   */
+  void SendBundle (Ptr<Packet> bundle, Ipv4Address dest);
+  /**
+   * \brief Unpack a received BUNDLE frame and handle each data packet.
+   * \param bundle the bundle items, without the TypeHeader.
+   * \param iif the interface the bundle was received on.
+   */
+  void RecvBundle (Ptr<Packet> bundle, uint32_t iif);
+  /**
+   * \brief Buffer, deliver or drop a data packet received from a neighbor.
+   * \param p the packet, starting with its EpidemicHeader.
+   * \param header the IPv4 header of the packet.
+   * \param iif the input interface.
+   * \param ucb unicast forward callback stored with the buffered packet.
+   * \param lcb local delivery callback.
+   * \param ecb error callback stored with the buffered packet.
+   * \return true if the packet was consumed.
+   */
+  bool HandleDataPacket (Ptr<const Packet> p, const Ipv4Header &header, uint32_t iif,
+                         const UnicastForwardCallback &ucb,
+                         const LocalDeliverCallback &lcb,
+                         const ErrorCallback &ecb);
   void SendBeacons ();
+  /**
+   * \brief Record that a packet reached its destination.
+   *
+   * The packet is dropped from the buffer, advertised in beacons and
+   * summary vectors, and refused from then on.  When the list is full
+   * the ID that would be forgotten first makes room.
+   * \param packetID the global packet ID.
+   * \param expire when the packet expires anyway and can be forgotten.
+   */
+  void AddImmunity (uint32_t packetID, Time expire);
+  /**
+   * \param packetID a global packet ID.
+   * \return true if the packet is known to be delivered.
+   */
+  bool IsImmune (uint32_t packetID) const;
+  /// Forget the delivered packets that expired anyway
+  void PurgeImmunity ();
   uint32_t FindOutputDeviceForAddress (Ipv4Address dst);
   uint32_t FindLoopbackDevice ();
   void SendPacket (Ptr<Packet> p, InetSocketAddress addr);
   bool IsMyOwnAddress (Ipv4Address src);
   void BroadcastPacket (Ptr<Packet> p);
-  void SendSummaryVector (Ipv4Address dest, bool firstNode);
+  void SendSummaryVector (Ipv4Address dest, bool firstNode,
+                          SummaryVectorHeader::Encoding encoding);
+  /**
+   * \brief Build a tagged REPLY / REPLY_BACK control packet.
+   * \param summary the summary vector to carry.
+   * \param firstNode true for a REPLY, false for a REPLY_BACK.
+   * \param encoding the summary vector wire encoding.
+   * \return the control packet.
+   */
+  Ptr<Packet> CreateSummaryVectorPacket (SummaryVectorHeader summary, bool firstNode,
+                                         SummaryVectorHeader::Encoding encoding) const;
   Ptr<Socket> FindSocketWithInterfaceAddress (Ipv4InterfaceAddress iface) const;
-  void SendPacketFromQueue (Ipv4Address dst, QueueEntry queueEntry);
+  /**
+   * \brief Send a buffered packet to a neighbor on its own.
+   * \param dst the neighbor.
+   * \param queueEntry the buffered packet.
+   * \param custody true to hand the packet over whole, with all its
+   *  spray-and-wait copies.
+   * \return true if the packet was sent.
+   */
+  bool SendPacketFromQueue (Ipv4Address dst, const QueueEntry &queueEntry, bool custody = false);
+  /**
+   * \brief Get the copy of a buffered packet to send to \p dest.
+   *
+   * In spray-and-wait mode, half of the copies of the packet are handed
+   * over to \p dest and the buffered packet keeps the rest.  A packet
+   * with a single copy left is only sent to its destination.  A packet
+   * delivered here is never sent, whatever the mode.
+   * \param entry the buffered packet, updated in the queue.
+   * \param dest the neighbor the packet is sent to.
+   * \return the packet to send, or 0 if it must not be sent to \p dest.
+   */
+  Ptr<Packet> SprayPacket (const QueueEntry &entry, Ipv4Address dest);
+  /**
+   * \brief Open the epidemic control socket on an interface.
+   * \param interface the interface index.
+   */
+  void CreateSocket (uint32_t interface);
   bool IsHostContactedRecently (Ipv4Address hostID);
+  /// Forget the cached interfaces and routes
+  void InvalidateRouteCache ();
+  /// Refresh the cached interface indexes if they were invalidated
+  void UpdateInterfaceCache ();
+  /**
+   * \brief Get a cached route, or create and cache it.
+   * \param destination the route destination.
+   * \param gateway the next hop.
+   * \param sourceInterface the interface whose address is the route source.
+   * \param outputInterface the interface the route sends packets through.
+   * \return the route.
+   */
+  Ptr<Ipv4Route> GetRoute (Ipv4Address destination, Ipv4Address gateway,
+                           uint32_t sourceInterface, uint32_t outputInterface);
   
+  /// Refresh the cached energy ratio from the energy source
+  void UpdateEnergyRatio ();
+  /**
+   * \brief Refresh the cached energy ratio and fire the state change trace.
+   * \param remaining the remaining energy of the energy source in J.
+   */
+  void SetRemainingEnergy (double remaining);
+  /**
+   * \brief Sink of the energy source RemainingEnergy trace.
+   * \param oldValue previous remaining energy in J.
+   * \param newValue current remaining energy in J.
+   */
+  void RemainingEnergyChanged (double oldValue, double newValue);
+  /// Poll the energy source, for sources without a RemainingEnergy trace
+  void EnergyUpdateTimerExpire ();
+  /**
+   * \brief Buffer a packet and make sure its expiry is scheduled.
+   * \param entry the queue entry, moved into the buffer.
+   * \return true if the entry is buffered.
+   */
+  bool Buffer (QueueEntry && entry);
+  /**
+   * \brief Schedule the expiry timer at the earliest expire time of the
+   *  buffer, unless it is already due by then.
+   */
+  void ScheduleExpiry ();
+  /// Drop the expired packets and schedule the next expiry
+  void ExpiryTimerExpire ();
+
   // Energy-aware packet handling
-  bool IsEnergyAwareForwarding (const QueueEntry& entry) const;
-  void OptimizeMultimediaPacket (Ptr<Packet> packet, const EpidemicHeader& header);
+  /**
+   * \brief Check that sending a buffered packet is affordable.
+   * \param entry the buffered packet.
+   * \param frames the frames the packet costs: 1 on its own, 0 in a
+   *  bundle that already pays for its frame.
+   * \return false if the energy budget policy refuses the transmission,
+   *  by default if it would take more than 10% of the remaining energy.
+   */
+  bool IsEnergyAwareForwarding (const QueueEntry& entry, uint32_t frames = 1) const;
+  /**
+   * \brief Get the cost model of transmissions on an interface.
+   * \param interface the interface index, or -1 if unknown.
+   * \return the cached or newly computed cost model.
+   */
+  TxCost GetTxCost (int32_t interface) const;
+  /**
+   * \brief Compress the payload of a packet originated at low energy.
+   *
+   * Voice payloads go through VoiceCodec and other payloads through
+   * DataCodec.  The compressed payload is kept if it is at most
+   * CompressionRatio of the original, and the codec ID is set in
+   * \p header.
+   * \param packet the packet from the transport layer.
+   * \param header the epidemic header of the packet, updated.
+   * \param ipHeader the IPv4 header of the packet.
+   * \return the packet to buffer, compressed or not.
+   */
+  Ptr<Packet> OptimizeMultimediaPacket (Ptr<Packet> packet, EpidemicHeader& header,
+                                        const Ipv4Header &ipHeader);
+  /**
+   * \brief Restore the payload of a packet compressed by its source.
+   * \param packet the packet, without its epidemic header.
+   * \param header the epidemic header of the packet.
+   * \param ipHeader the IPv4 header of the packet.
+   * \return the restored packet, or 0 if the codec is unknown.
+   */
+  Ptr<Packet> RestorePayload (Ptr<Packet> packet, const EpidemicHeader& header,
+                              const Ipv4Header &ipHeader) const;
+  /**
+   * \param ipHeader the IPv4 header of a packet.
+   * \return the size of the transport header codecs leave alone.
+   */
+  uint32_t GetPayloadOffset (const Ipv4Header &ipHeader) const;
+  /**
+   * \param packet an IP payload sent in one frame.
+   * \return the energy of its transmission in J, IP header included.
+   */
   double CalculateTransmissionCost (const Ptr<const Packet> packet) const;
 };
 
@@ -0,0 +1,190 @@
+#include "epidemic-contact-table.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+
+
+/**
+ * \file
+ * \ingroup epidemic
+ * ns3::Epidemic::HostContactTable implementation.
+ */
+
+
+namespace ns3 {
+NS_LOG_COMPONENT_DEFINE ("EpidemicContactTable");
+
+namespace Epidemic {
+
+/// Smallest number of slots of a HostContactTable
+static const uint32_t MIN_CAPACITY = 16;
+
+
+HostContactTable::HostContactTable (Time period)
+  : m_used (0),
+    m_period (period)
+{
+  NS_LOG_FUNCTION (this << period);
+  Slot empty = { 0, Time () };
+  m_slots.assign (MIN_CAPACITY, empty);
+}
+
+uint32_t
+HostContactTable::Hash (uint32_t address) const
+{
+  // Fibonacci hashing; hosts of a subnet differ in the low address bits
+  uint32_t h = address * 2654435761u;
+  return (h ^ (h >> 16)) & (m_slots.size () - 1);
+}
+
+bool
+HostContactTable::IsExpired (const Slot & slot) const
+{
+  return (Simulator::Now () - slot.m_lastContact) >= m_period;
+}
+
+bool
+HostContactTable::IsRecent (Ipv4Address host) const
+{
+  NS_LOG_FUNCTION (this << host);
+  uint32_t address = host.Get ();
+  uint32_t mask = m_slots.size () - 1;
+  for (uint32_t i = Hash (address); m_slots[i].m_address != 0; i = (i + 1) & mask)
+    {
+      if (m_slots[i].m_address == address)
+        {
+          return !IsExpired (m_slots[i]);
+        }
+    }
+  return false;
+}
+
+void
+HostContactTable::Update (Ipv4Address host)
+{
+  NS_LOG_FUNCTION (this << host);
+  uint32_t address = host.Get ();
+  if (address == 0)
+    {
+      return;
+    }
+  uint32_t mask = m_slots.size () - 1;
+  int64_t reuse = -1;
+  uint32_t i = Hash (address);
+  for (; m_slots[i].m_address != 0; i = (i + 1) & mask)
+    {
+      if (m_slots[i].m_address == address)
+        {
+          m_slots[i].m_lastContact = Simulator::Now ();
+          return;
+        }
+      if (reuse < 0 && IsExpired (m_slots[i]))
+        {
+          reuse = i;
+        }
+    }
+  if (reuse >= 0)
+    {
+      // Take over the slot of an expired contact
+      m_slots[reuse].m_address = address;
+      m_slots[reuse].m_lastContact = Simulator::Now ();
+      return;
+    }
+  if ((m_used + 1) * 4 > m_slots.size () * 3)
+    {
+      // Keep the load at most one half after the rebuild
+      uint32_t live = GetSize () + 1;
+      uint32_t capacity = MIN_CAPACITY;
+      while (live * 2 > capacity)
+        {
+          capacity *= 2;
+        }
+      Rehash (capacity);
+      Update (host);
+      return;
+    }
+  m_slots[i].m_address = address;
+  m_slots[i].m_lastContact = Simulator::Now ();
+  ++m_used;
+}
+
+void
+HostContactTable::Rehash (uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << capacity);
+  std::vector<Slot> old;
+  old.swap (m_slots);
+  Slot empty = { 0, Time () };
+  m_slots.assign (capacity, empty);
+  m_used = 0;
+  uint32_t mask = capacity - 1;
+  for (std::vector<Slot>::const_iterator j = old.begin (); j != old.end (); ++j)
+    {
+      if (j->m_address == 0 || IsExpired (*j))
+        {
+          continue;
+        }
+      uint32_t i = Hash (j->m_address);
+      while (m_slots[i].m_address != 0)
+        {
+          i = (i + 1) & mask;
+        }
+      m_slots[i] = *j;
+      ++m_used;
+    }
+}
+
+uint32_t
+HostContactTable::GetSize () const
+{
+  uint32_t size = 0;
+  for (std::vector<Slot>::const_iterator i = m_slots.begin (); i != m_slots.end (); ++i)
+    {
+      if (i->m_address != 0 && !IsExpired (*i))
+        {
+          ++size;
+        }
+    }
+  return size;
+}
+
+uint32_t
+HostContactTable::GetCapacity () const
+{
+  return m_slots.size ();
+}
+
+uint32_t
+HostContactTable::GetMemoryUsage () const
+{
+  return sizeof (*this) + m_slots.capacity () * sizeof (Slot);
+}
+
+Time
+HostContactTable::GetPeriod () const
+{
+  return m_period;
+}
+
+void
+HostContactTable::SetPeriod (Time period)
+{
+  NS_LOG_FUNCTION (this << period);
+  m_period = period;
+}
+
+void
+HostContactTable::Print (std::ostream &os, Time::Unit unit) const
+{
+  for (std::vector<Slot>::const_iterator i = m_slots.begin (); i != m_slots.end (); ++i)
+    {
+      if (i->m_address != 0 && !IsExpired (*i))
+        {
+          Time timeSince = Simulator::Now () - i->m_lastContact;
+          os << "  Node " << Ipv4Address (i->m_address) << " - Last contact: "
+             << timeSince.As (unit) << " ago\n";
+        }
+    }
+}
+
+} //end namespace epidemic
+} //end namespace ns3
@@ -0,0 +1,95 @@
+#ifndef EPIDEMIC_CONTACT_TABLE_H
+#define EPIDEMIC_CONTACT_TABLE_H
+
+
+#include <vector>
+#include <ostream>
+#include "ns3/ipv4-address.h"
+#include "ns3/nstime.h"
+
+
+/**
+ * \file
+ * \ingroup epidemic
+ * ns3::Epidemic::HostContactTable declaration.
+ */
+
+namespace ns3 {
+namespace Epidemic {
+
+/**
+ * \ingroup epidemic
+ * \brief Recent contact times of neighbor hosts.
+ *
+ * A flat open addressing table (linear probing) mapping a host address to
+ * the time of the last anti-entropy session with it.  A contact older than
+ * the host recent period is expired: lookups ignore it and inserts reuse
+ * its slot.  When the table fills up it is rebuilt without the expired
+ * contacts, and only grows if the live contacts still need the room, so its
+ * size follows the number of hosts met within one period rather than the
+ * number of hosts ever met.
+ */
+class HostContactTable
+{
+public:
+  /**
+   * \brief Constructor for HostContactTable
+   * \param period the host recent period
+   */
+  HostContactTable (Time period = Seconds (10));
+  /**
+   * \brief Check whether \p host was contacted within the period.
+   * \param host the host address
+   * \returns true if the last contact with \p host is recent
+   */
+  bool IsRecent (Ipv4Address host) const;
+  /**
+   * \brief Record a contact with \p host now.
+   * \param host the host address
+   */
+  void Update (Ipv4Address host);
+  /// \returns the number of hosts contacted within the period
+  uint32_t GetSize () const;
+  /// \returns the number of slots of the table
+  uint32_t GetCapacity () const;
+  /// \returns the memory used by the table, in bytes
+  uint32_t GetMemoryUsage () const;
+  /// \returns the host recent period
+  Time GetPeriod () const;
+  /**
+   * \brief Set the host recent period.
+   * \param period the host recent period
+   */
+  void SetPeriod (Time period);
+  /**
+   * \brief Print the hosts contacted within the period.
+   * \param os the output stream
+   * \param unit the time unit of the contact ages
+   */
+  void Print (std::ostream &os, Time::Unit unit = Time::S) const;
+
+private:
+  /// A table slot; an address of 0.0.0.0 marks an empty slot
+  struct Slot
+  {
+    uint32_t m_address;  ///< Host address
+    Time m_lastContact;  ///< Time of the last contact
+  };
+  /// Probe start for \p address
+  uint32_t Hash (uint32_t address) const;
+  /// \returns true if the contact in \p slot is older than the period
+  bool IsExpired (const Slot & slot) const;
+  /// Rebuild the table with \p capacity slots, dropping expired contacts
+  void Rehash (uint32_t capacity);
+
+  /// Table slots, the size is a power of two
+  std::vector<Slot> m_slots;
+  /// Number of non-empty slots, expired or not
+  uint32_t m_used;
+  /// Host recent period
+  Time m_period;
+};
+
+} //end namespace epidemic
+} //end namespace ns3
+#endif
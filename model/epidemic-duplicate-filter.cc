@@ -0,0 +1,177 @@
+#include "epidemic-duplicate-filter.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include <algorithm>
+
+
+/**
+ * \file
+ * \ingroup epidemic
+ * ns3::Epidemic::DuplicateFilter implementation.
+ */
+
+
+namespace ns3 {
+NS_LOG_COMPONENT_DEFINE ("EpidemicDuplicateFilter");
+
+namespace Epidemic {
+
+DuplicateFilter::DuplicateFilter (uint32_t bits, Time period)
+  : m_bits (0),
+    m_count (0),
+    m_period (period)
+{
+  NS_LOG_FUNCTION (this << bits << period);
+  SetSize (bits);
+}
+
+void
+DuplicateFilter::GetPositions (uint32_t packetID, uint32_t positions[HASH_COUNT]) const
+{
+  // 64 bit mix of the ID, then double hashing: position i is h1 + i * h2.
+  // IDs of a source only differ in their low 16 bits
+  uint64_t h = packetID * 0x9e3779b97f4a7c15ull;
+  h ^= h >> 32;
+  h *= 0xd6e8feb86659fd93ull;
+  h ^= h >> 32;
+  uint32_t h1 = h & 0xffffffff;
+  uint32_t h2 = (h >> 32) | 1;
+  for (uint32_t i = 0; i < HASH_COUNT; ++i)
+    {
+      positions[i] = (h1 + i * h2) % m_bits;
+    }
+}
+
+bool
+DuplicateFilter::Test (const std::vector<uint64_t> & generation,
+                       const uint32_t positions[HASH_COUNT])
+{
+  for (uint32_t i = 0; i < HASH_COUNT; ++i)
+    {
+      if (!(generation[positions[i] / 64] & (1ull << (positions[i] % 64))))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+bool
+DuplicateFilter::Contains (uint32_t packetID) const
+{
+  NS_LOG_FUNCTION (this << packetID);
+  if (m_bits == 0)
+    {
+      return false;
+    }
+  Time age = Simulator::Now () - m_start;
+  if (age >= m_period + m_period)
+    {
+      // Both generations are older than the period
+      return false;
+    }
+  uint32_t positions[HASH_COUNT];
+  GetPositions (packetID, positions);
+  if (Test (m_current, positions))
+    {
+      return true;
+    }
+  // The previous generation is dropped at the next rotation
+  return age < m_period && Test (m_previous, positions);
+}
+
+void
+DuplicateFilter::Insert (uint32_t packetID)
+{
+  NS_LOG_FUNCTION (this << packetID);
+  if (m_bits == 0)
+    {
+      return;
+    }
+  Rotate ();
+  uint32_t positions[HASH_COUNT];
+  GetPositions (packetID, positions);
+  for (uint32_t i = 0; i < HASH_COUNT; ++i)
+    {
+      m_current[positions[i] / 64] |= 1ull << (positions[i] % 64);
+    }
+  ++m_count;
+}
+
+void
+DuplicateFilter::Rotate ()
+{
+  Time age = Simulator::Now () - m_start;
+  if (age < m_period && m_count < m_bits / BITS_PER_ID)
+    {
+      return;
+    }
+  NS_LOG_LOGIC ("New generation after " << m_count << " IDs in " << age.As (Time::S));
+  if (age >= m_period + m_period)
+    {
+      std::fill (m_previous.begin (), m_previous.end (), 0);
+    }
+  else
+    {
+      m_previous.swap (m_current);
+    }
+  std::fill (m_current.begin (), m_current.end (), 0);
+  m_count = 0;
+  m_start = Simulator::Now ();
+}
+
+void
+DuplicateFilter::Clear ()
+{
+  NS_LOG_FUNCTION (this);
+  std::fill (m_current.begin (), m_current.end (), 0);
+  std::fill (m_previous.begin (), m_previous.end (), 0);
+  m_count = 0;
+  m_start = Simulator::Now ();
+}
+
+uint32_t
+DuplicateFilter::GetSize () const
+{
+  return m_bits;
+}
+
+void
+DuplicateFilter::SetSize (uint32_t bits)
+{
+  NS_LOG_FUNCTION (this << bits);
+  uint32_t words = (bits + 63) / 64;
+  m_bits = words * 64;
+  m_current.assign (words, 0);
+  m_previous.assign (words, 0);
+  m_count = 0;
+  m_start = Simulator::Now ();
+}
+
+Time
+DuplicateFilter::GetPeriod () const
+{
+  return m_period;
+}
+
+void
+DuplicateFilter::SetPeriod (Time period)
+{
+  NS_LOG_FUNCTION (this << period);
+  m_period = period;
+}
+
+uint32_t
+DuplicateFilter::GetCount () const
+{
+  return m_count;
+}
+
+uint32_t
+DuplicateFilter::GetMemoryUsage () const
+{
+  return sizeof (*this) + (m_current.capacity () + m_previous.capacity ()) * sizeof (uint64_t);
+}
+
+} //end namespace epidemic
+} //end namespace ns3
@@ -0,0 +1,107 @@
+#ifndef EPIDEMIC_DUPLICATE_FILTER_H
+#define EPIDEMIC_DUPLICATE_FILTER_H
+
+
+#include <vector>
+#include "ns3/nstime.h"
+
+
+/**
+ * \file
+ * \ingroup epidemic
+ * ns3::Epidemic::DuplicateFilter declaration.
+ */
+
+namespace ns3 {
+namespace Epidemic {
+
+/**
+ * \ingroup epidemic
+ * \brief Packet IDs seen within the last period.
+ *
+ * A rotating Bloom filter of two generations of the same size.  IDs are
+ * inserted in the current generation and looked up in both; once the
+ * current generation is a period old, or holds as many IDs as keep the
+ * false positive rate under about 0.5%, it becomes the previous
+ * generation and the oldest one is cleared.  An ID is thus remembered for
+ * at least one period, or until that many IDs have been inserted after it,
+ * and forgotten after two, in a fixed amount of memory.
+ *
+ * A lookup may wrongly report an ID as seen, never the reverse, so the
+ * filter is only fit to suppress redundant relaying.
+ */
+class DuplicateFilter
+{
+public:
+  /**
+   * \brief Constructor for DuplicateFilter
+   * \param bits the bits per generation, 0 disables the filter
+   * \param period the period an ID is remembered for
+   */
+  DuplicateFilter (uint32_t bits = 0, Time period = Seconds (10));
+  /**
+   * \brief Check whether \p packetID was inserted recently.
+   * \param packetID the global packet ID
+   * \returns true if \p packetID is (probably) in the filter
+   */
+  bool Contains (uint32_t packetID) const;
+  /**
+   * \brief Remember \p packetID.
+   * \param packetID the global packet ID
+   */
+  void Insert (uint32_t packetID);
+  /// Forget all IDs
+  void Clear ();
+  /// \returns the bits per generation, 0 if disabled
+  uint32_t GetSize () const;
+  /**
+   * \brief Set the bits per generation and forget all IDs.
+   * \param bits the bits per generation, rounded up to a multiple of 64
+   */
+  void SetSize (uint32_t bits);
+  /// \returns the period an ID is remembered for
+  Time GetPeriod () const;
+  /**
+   * \brief Set the period an ID is remembered for.
+   * \param period the period
+   */
+  void SetPeriod (Time period);
+  /// \returns the number of IDs inserted in the current generation
+  uint32_t GetCount () const;
+  /// \returns the memory used by the filter, in bytes
+  uint32_t GetMemoryUsage () const;
+
+private:
+  /// Number of bits set per ID
+  static const uint32_t HASH_COUNT = 4;
+  /// IDs per generation are at most the bits over this
+  static const uint32_t BITS_PER_ID = 16;
+  /**
+   * \brief Bit positions of \p packetID.
+   * \param packetID the global packet ID
+   * \param positions receives HASH_COUNT bit positions
+   */
+  void GetPositions (uint32_t packetID, uint32_t positions[HASH_COUNT]) const;
+  /// \returns true if all bits of \p positions are set in \p generation
+  static bool Test (const std::vector<uint64_t> & generation,
+                    const uint32_t positions[HASH_COUNT]);
+  /// Start a new generation if the current one is full or a period old
+  void Rotate ();
+
+  /// IDs inserted during the current generation
+  std::vector<uint64_t> m_current;
+  /// IDs inserted during the previous generation
+  std::vector<uint64_t> m_previous;
+  /// Bits per generation
+  uint32_t m_bits;
+  /// IDs inserted in the current generation
+  uint32_t m_count;
+  /// Start time of the current generation
+  Time m_start;
+  /// Period an ID is remembered for
+  Time m_period;
+};
+
+} //end namespace epidemic
+} //end namespace ns3
+#endif
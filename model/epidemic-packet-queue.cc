@@ -5,6 +5,7 @@
 #include "ns3/socket.h"
 #include "ns3/log.h"
 #include "epidemic-packet.h"
+#include "epidemic-policy.h"
 
 using namespace std;
 
@@ -29,7 +30,8 @@ QueueEntry::QueueEntry (void)
     m_ucb (UnicastForwardCallback ()),
     m_ecb (ErrorCallback ()),
     m_expire (Simulator::Now ()),
-    m_packetID (0)
+    m_packetID (0),
+    m_priority (0)
 {
 }
 
@@ -44,7 +46,8 @@ QueueEntry::QueueEntry (Ptr<const Packet> pa,
     m_ucb (ucb),
     m_ecb (ecb),
     m_expire (exp),
-    m_packetID (packetID)
+    m_packetID (packetID),
+    m_priority (0)
 {
 }
 
@@ -94,6 +97,34 @@ QueueEntry::SetPacket (Ptr<const Packet> p)
   m_packet = p;
 }
 
+const EpidemicHeader &
+QueueEntry::GetEpidemicHeader () const
+{
+  return m_epidemicHeader;
+}
+
+void
+QueueEntry::SetEpidemicHeader (const EpidemicHeader &header)
+{
+  NS_LOG_FUNCTION (this << header);
+  m_epidemicHeader = header;
+}
+
+Ptr<Packet>
+QueueEntry::GetPacketWithHeader () const
+{
+  // The copy shares the payload bytes; only the header is written
+  Ptr<Packet> packet = m_packet ? m_packet->Copy () : Create<Packet> ();
+  packet->AddHeader (m_epidemicHeader);
+  return packet;
+}
+
+uint32_t
+QueueEntry::GetSize () const
+{
+  return (m_packet ? m_packet->GetSize () : 0) + m_epidemicHeader.GetSerializedSize ();
+}
+
 Ipv4Header
 QueueEntry::GetIpv4Header () const
 {
@@ -133,42 +164,268 @@ QueueEntry::SetPacketID (uint32_t id)
   m_packetID = id;
 }
 
+uint8_t
+QueueEntry::GetPriority () const
+{
+  return m_priority;
+}
+
+void
+QueueEntry::SetPriority (uint8_t priority)
+{
+  NS_LOG_FUNCTION (this << (uint32_t) priority);
+  m_priority = priority;
+}
+
+uint32_t
+QueueEntry::GetHopCount () const
+{
+  return m_epidemicHeader.GetHopCount ();
+}
+
+void
+QueueEntry::SetHopCount (uint32_t hopCount)
+{
+  NS_LOG_FUNCTION (this << hopCount);
+  m_epidemicHeader.SetHopCount (hopCount);
+}
+
+Time
+QueueEntry::GetTimeStamp () const
+{
+  return m_epidemicHeader.GetTimeStamp ();
+}
 
+void
+QueueEntry::SetTimeStamp (Time timeStamp)
+{
+  NS_LOG_FUNCTION (this << timeStamp);
+  m_epidemicHeader.SetTimeStamp (timeStamp);
+}
+
+
+
+/// Smallest number of buckets of the packet ID table
+static const uint32_t MIN_ID_BUCKETS = 16;
 
 PacketQueue::PacketQueue (uint32_t maxLen)
+  : m_size (0),
+    m_maxLen (maxLen),
+    m_dropPolicy (DROP_OLDEST),
+    m_evictionRank (&OldestFirstEviction::Rank)
 {
   NS_LOG_FUNCTION (this << maxLen);
-  m_maxLen = maxLen;
+  IdBucket empty = { 0, NO_SLOT };
+  m_ids.assign (MIN_ID_BUCKETS, empty);
+}
+
+uint32_t
+PacketQueue::FindBucket (uint32_t packetID) const
+{
+  // Fibonacci hashing; IDs of a source differ in the low bits
+  uint32_t h = packetID * 2654435761u;
+  uint32_t mask = m_ids.size () - 1;
+  uint32_t i = (h ^ (h >> 16)) & mask;
+  while (m_ids[i].m_slot != NO_SLOT && m_ids[i].m_packetID != packetID)
+    {
+      i = (i + 1) & mask;
+    }
+  return i;
+}
+
+uint32_t
+PacketQueue::FindSlot (uint32_t packetID) const
+{
+  return m_ids[FindBucket (packetID)].m_slot;
+}
+
+void
+PacketQueue::Rehash (uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << capacity);
+  std::vector<IdBucket> old;
+  old.swap (m_ids);
+  IdBucket empty = { 0, NO_SLOT };
+  m_ids.assign (capacity, empty);
+  for (std::vector<IdBucket>::const_iterator j = old.begin (); j != old.end (); ++j)
+    {
+      if (j->m_slot != NO_SLOT)
+        {
+          m_ids[FindBucket (j->m_packetID)] = *j;
+        }
+    }
+}
+
+void
+PacketQueue::EraseId (uint32_t packetID)
+{
+  // Backward shift deletion: later entries of the probe move into the
+  // hole, so that lookups need no tombstones
+  uint32_t mask = m_ids.size () - 1;
+  uint32_t hole = FindBucket (packetID);
+  m_ids[hole].m_slot = NO_SLOT;
+  for (uint32_t i = (hole + 1) & mask; m_ids[i].m_slot != NO_SLOT; i = (i + 1) & mask)
+    {
+      uint32_t h = m_ids[i].m_packetID * 2654435761u;
+      uint32_t home = (h ^ (h >> 16)) & mask;
+      // Move the entry unless its home lies cyclically in (hole, i]
+      if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+          m_ids[hole] = m_ids[i];
+          m_ids[i].m_slot = NO_SLOT;
+          hole = i;
+        }
+    }
+}
+
+void
+PacketQueue::SortIds ()
+{
+  m_sortedIds.clear ();
+  for (std::vector<IdBucket>::const_iterator i = m_ids.begin (); i != m_ids.end (); ++i)
+    {
+      if (i->m_slot != NO_SLOT)
+        {
+          m_sortedIds.push_back (i->m_packetID);
+        }
+    }
+  std::sort (m_sortedIds.begin (), m_sortedIds.end ());
 }
 
 uint32_t
 PacketQueue::GetSize () const
 {
-  return m_map.size ();
+  return m_size;
+}
+
+uint32_t
+PacketQueue::GetSize (uint8_t priority) const
+{
+  return priority < m_classSizes.size () ? m_classSizes[priority] : 0;
+}
+
+uint32_t
+PacketQueue::DropPriorityBelow (uint8_t priority)
+{
+  NS_LOG_FUNCTION (this << (uint32_t) priority);
+  uint32_t dropped = 0;
+  while (!m_classes.IsEmpty () && std::get<0> (m_classes.TopKey ()) < priority)
+    {
+      Drop (m_classes.Top (), DROP_LOW_PRIORITY);
+      ++dropped;
+    }
+  return dropped;
+}
+
+uint32_t
+PacketQueue::Shrink (uint32_t len)
+{
+  NS_LOG_FUNCTION (this << len);
+  m_maxLen = len;
+  uint32_t size = m_size;
+  PurgeExpired ();
+  while (m_size > len)
+    {
+      Drop (m_classes.Top (), DROP_SHRUNK);
+    }
+  return size - m_size;
+}
+
+bool
+PacketQueue::Remove (uint32_t packetID, DropReason reason)
+{
+  NS_LOG_FUNCTION (this << packetID << GetDropReasonName (reason));
+  uint32_t slot = FindSlot (packetID);
+  if (slot == NO_SLOT)
+    {
+      return false;
+    }
+  Drop (slot, reason);
+  return true;
 }
 
 bool
-PacketQueue::Enqueue (QueueEntry & entry)
+PacketQueue::SetEpidemicHeader (uint32_t packetID, const EpidemicHeader &header)
+{
+  NS_LOG_FUNCTION (this << packetID);
+  uint32_t slot = FindSlot (packetID);
+  if (slot == NO_SLOT)
+    {
+      return false;
+    }
+  // A custom eviction rank may depend on the header
+  QueueEntry &entry = m_slots[slot];
+  m_eviction.Erase (slot);
+  entry.SetEpidemicHeader (header);
+  m_eviction.Push (slot, GetEvictionKey (entry));
+  return true;
+}
+
+bool
+PacketQueue::Enqueue (QueueEntry && entry)
 {
   NS_LOG_FUNCTION (this << entry.GetPacketID ());
+  uint32_t packetID = entry.GetPacketID ();
   // Add or update the entry
-  m_map[entry.GetPacketID ()] = entry;
-  Purge (true);
-  return true;
+  uint32_t bucket = FindBucket (packetID);
+  uint32_t slot = m_ids[bucket].m_slot;
+  if (slot != NO_SLOT)
+    {
+      Unindex (slot);
+    }
+  else
+    {
+      if (!m_freeSlots.empty ())
+        {
+          slot = m_freeSlots.back ();
+          m_freeSlots.pop_back ();
+        }
+      else
+        {
+          slot = m_slots.size ();
+          m_slots.emplace_back ();
+        }
+      if ((m_size + 1) * 2 > m_ids.size ())
+        {
+          // Keep the load at most one half
+          Rehash (m_ids.size () * 2);
+          bucket = FindBucket (packetID);
+        }
+      m_ids[bucket].m_packetID = packetID;
+      m_ids[bucket].m_slot = slot;
+      ++m_size;
+    }
+  m_slots[slot] = std::move (entry);
+  Index (slot);
+  Purge ();
+  return FindSlot (packetID) != NO_SLOT;
 }
 
 bool
 PacketQueue::Dequeue (QueueEntry& entry)
 {
   NS_LOG_FUNCTION (this << entry.GetPacketID ());
-  if (m_map.size () > 0)
+  if (m_size == 0)
     {
-      PacketIdMap::iterator entry_map = m_map.begin ();
-      entry = entry_map->second;
-      m_map.erase (entry_map);
-      return true;
+      return false;
+    }
+  // The entry with the smallest packet ID
+  std::vector<IdBucket>::const_iterator first = m_ids.end ();
+  for (std::vector<IdBucket>::const_iterator i = m_ids.begin (); i != m_ids.end (); ++i)
+    {
+      if (i->m_slot != NO_SLOT && (first == m_ids.end () || i->m_packetID < first->m_packetID))
+        {
+          first = i;
+        }
     }
-  return false;
+  uint32_t slot = first->m_slot;
+  Unindex (slot);
+  EraseId (first->m_packetID);
+  --m_size;
+  entry = std::move (m_slots[slot]);
+  m_slots[slot] = QueueEntry ();
+  m_freeSlots.push_back (slot);
+  return true;
 }
 
 uint32_t
@@ -185,55 +442,170 @@ PacketQueue::SetMaxQueueLen (uint32_t len)
   m_maxLen = len;
 }
 
-QueueEntry
-PacketQueue::Find (uint32_t packetID)
+PacketQueue::DropPolicy
+PacketQueue::GetDropPolicy () const
+{
+  return m_dropPolicy;
+}
+
+void
+PacketQueue::SetDropPolicy (DropPolicy policy)
+{
+  NS_LOG_FUNCTION (this << policy);
+  EvictionRank rank = &OldestFirstEviction::Rank;
+  switch (policy)
+    {
+    case DROP_LOWEST_PRIORITY:
+      rank = &LowestPriorityEviction::Rank;
+      break;
+    case DROP_LARGEST:
+      rank = &LargestFirstEviction::Rank;
+      break;
+    case DROP_OLDEST:
+    default:
+      break;
+    }
+  m_dropPolicy = policy;
+  if (rank != m_evictionRank)
+    {
+      m_evictionRank = rank;
+      ReindexEviction ();
+    }
+}
+
+void
+PacketQueue::SetEvictionRank (EvictionRank rank)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (rank);
+  if (rank != m_evictionRank)
+    {
+      m_evictionRank = rank;
+      ReindexEviction ();
+    }
+}
+
+void
+PacketQueue::ReindexEviction ()
+{
+  m_eviction.Clear ();
+  for (std::vector<IdBucket>::const_iterator i = m_ids.begin (); i != m_ids.end (); ++i)
+    {
+      if (i->m_slot != NO_SLOT)
+        {
+          m_eviction.Push (i->m_slot, GetEvictionKey (m_slots[i->m_slot]));
+        }
+    }
+}
+
+void
+PacketQueue::SetDropCallback (DropCallback cb)
+{
+  NS_LOG_FUNCTION (this);
+  m_dropCallback = cb;
+}
+
+const char *
+PacketQueue::GetDropReasonName (DropReason reason)
+{
+  switch (reason)
+    {
+    case DROP_EXPIRED:
+      return "expired";
+    case DROP_EVICTED:
+      return "evicted";
+    case DROP_LOW_PRIORITY:
+      return "low-priority";
+    case DROP_SHRUNK:
+      return "shrunk";
+    case DROP_DELIVERED:
+      return "delivered";
+    case DROP_HANDED_OFF:
+      return "handed-off";
+    }
+  return "unknown";
+}
+
+const QueueEntry *
+PacketQueue::Find (uint32_t packetID) const
 {
   NS_LOG_FUNCTION (this << packetID);
-  PacketIdMap::iterator entry = m_map.find (packetID);
-  if (entry != m_map.end ())
+  uint32_t slot = FindSlot (packetID);
+  if (slot != NO_SLOT)
     {
-      return entry->second;
+      return &m_slots[slot];
     }
-  return QueueEntry ();
+  return 0;
 }
 
 
-// static
-bool
-PacketQueue::IsEarlier (const PacketIdMapPair & e1,
-                        const PacketIdMapPair & e2)
+PacketQueue::EvictionKey
+PacketQueue::GetEvictionKey (const QueueEntry & entry) const
 {
-  return (e1.second.GetExpireTime () < e2.second.GetExpireTime ());
+  return EvictionKey (m_evictionRank (entry), entry.GetExpireTime ().GetTimeStep (),
+                      entry.GetPacketID ());
 }
 
+void
+PacketQueue::Index (uint32_t slot)
+{
+  const QueueEntry &entry = m_slots[slot];
+  m_expiry.Push (slot, ExpiryKey (entry.GetExpireTime (), entry.GetPacketID ()));
+  m_eviction.Push (slot, GetEvictionKey (entry));
+  m_classes.Push (slot, ClassKey (entry.GetPriority (), entry.GetExpireTime (),
+                                  entry.GetPacketID ()));
+  if (entry.GetPriority () >= m_classSizes.size ())
+    {
+      m_classSizes.resize (entry.GetPriority () + 1, 0);
+    }
+  ++m_classSizes[entry.GetPriority ()];
+}
 
 void
-PacketQueue::Purge (bool outdated /* = false */)
+PacketQueue::Unindex (uint32_t slot)
 {
-  NS_LOG_FUNCTION (this << outdated);
-  if (outdated && m_map.size () > m_maxLen)
+  m_expiry.Erase (slot);
+  m_eviction.Erase (slot);
+  m_classes.Erase (slot);
+  --m_classSizes[m_slots[slot].GetPriority ()];
+}
+
+
+void
+PacketQueue::PurgeExpired ()
+{
+  Time now = Now ();
+  while (!m_expiry.IsEmpty () && m_expiry.TopKey ().first < now)
     {
-      Drop (std::min_element (m_map.begin (), m_map.end (), IsEarlier),
-            "Drop the oldest packet");
+      Drop (m_expiry.Top (), DROP_EXPIRED);
     }
-  else
+}
+
+void
+PacketQueue::Purge ()
+{
+  NS_LOG_FUNCTION (this);
+  PurgeExpired ();
+  while (m_size > m_maxLen)
     {
-      for (PacketIdMap::iterator i = m_map.begin ();
-           i != m_map.end (); ++i)
-        {
-          if (i->second.GetExpireTime () < Now ())
-            {
-              Drop (i, "Drop outdated packet ");
-            }
-        }
+      Drop (m_eviction.Top (), DROP_EVICTED);
     }
 }
 
 void
-PacketQueue::Drop (PacketIdMap::iterator en, std::string reason)
+PacketQueue::Drop (uint32_t slot, DropReason reason)
 {
-  NS_LOG_FUNCTION (this << en->second.GetPacketID () << reason);
-  m_map.erase (en->second.GetPacketID ());
+  NS_LOG_FUNCTION (this << m_slots[slot].GetPacketID () << GetDropReasonName (reason));
+  Unindex (slot);
+  if (!m_dropCallback.IsNull ())
+    {
+      m_dropCallback (m_slots[slot], reason);
+    }
+  EraseId (m_slots[slot].GetPacketID ());
+  --m_size;
+  // Release the packet and callbacks now, the slot itself is recycled
+  m_slots[slot] = QueueEntry ();
+  m_freeSlots.push_back (slot);
 }
 
 
@@ -242,26 +614,35 @@ SummaryVectorHeader
 PacketQueue::GetSummaryVector ()
 {
   NS_LOG_FUNCTION (this );
-  Purge (true);
-  SummaryVectorHeader sm (m_map.size ());
-  for (PacketIdMap::iterator i = m_map.begin (); i != m_map.end (); ++i)
+  Purge ();
+  SortIds ();
+  SummaryVectorHeader sm (m_sortedIds.size ());
+  for (std::vector<uint32_t>::const_iterator i = m_sortedIds.begin ();
+       i != m_sortedIds.end (); ++i)
     {
-      sm.Add (i->first);
+      sm.Add (*i);
     }
   return sm;
 }
 
 
 SummaryVectorHeader
-PacketQueue::FindDisjointPackets (SummaryVectorHeader list)
+PacketQueue::FindDisjointPackets (const SummaryVectorHeader &list)
 {
-  NS_LOG_FUNCTION (this << list);
-  SummaryVectorHeader sm (std::min (m_map.size (), list.Size ()));
-  for (PacketIdMap::iterator i = m_map.begin (); i != m_map.end (); ++i)
+  NS_LOG_FUNCTION (this << list.Size ());
+  SortIds ();
+  SummaryVectorHeader sm (m_sortedIds.size ());
+  SummaryVectorHeader::Iterator j = list.Begin ();
+  for (std::vector<uint32_t>::const_iterator i = m_sortedIds.begin ();
+       i != m_sortedIds.end (); ++i)
     {
-      if (!list.Contains (i->first))
+      while (j != list.End () && *j < *i)
         {
-          sm.Add (i->first);
+          ++j;
+        }
+      if (j == list.End () || *j != *i)
+        {
+          sm.Add (*i);
         }
     }
   return sm;
@@ -272,7 +653,13 @@ void
 PacketQueue::DropExpiredPackets ()
 {
   NS_LOG_FUNCTION (this );
-  Purge (true);
+  Purge ();
+}
+
+Time
+PacketQueue::GetNextExpireTime () const
+{
+  return m_expiry.IsEmpty () ? Time::Max () : m_expiry.TopKey ().first;
 }
 
 } //end namespace epidemic
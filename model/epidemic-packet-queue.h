@@ -2,9 +2,12 @@
 #define EPIDEMIC_PACKET_QUEUE_H
 
 
+#include <deque>
+#include <tuple>
 #include <vector>
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/simulator.h"
+#include "epidemic-packet.h"
 #include <string.h>
 #include <sstream>
 
@@ -21,6 +24,11 @@ namespace Epidemic {
 /**
  * \ingroup epidemic
  * \brief epidemic Queue Entry
+ *
+ * The packet is buffered without its EpidemicHeader, which is kept in
+ * the entry instead: relays rewrite the hop count and spray-and-wait
+ * splits the copies on the parsed header, and the payload itself is only
+ * ever shared, never copied, until it is sent.
  */
 class QueueEntry
 {
@@ -58,10 +66,21 @@ public:
   ErrorCallback GetErrorCallback () const;
   /// Set the ErrorCallback \param ucb associated with the queued packet
   void SetErrorCallback (ErrorCallback ecb);
-  /// \returns the queued packet
+  /// \returns the queued packet, without its EpidemicHeader
   Ptr<const Packet> GetPacket () const;
-  /// Set the packet pointer \param p
+  /// Set the packet pointer \param p, without its EpidemicHeader
   void SetPacket (Ptr<const Packet> p);
+  /// \returns the EpidemicHeader sent ahead of the queued packet
+  const EpidemicHeader & GetEpidemicHeader () const;
+  /// Set the EpidemicHeader \param header sent ahead of the queued packet
+  void SetEpidemicHeader (const EpidemicHeader &header);
+  /**
+   * \returns a shallow copy of the queued packet with the EpidemicHeader
+   *  prepended, ready to send
+   */
+  Ptr<Packet> GetPacketWithHeader () const;
+  /// \returns the size of the packet as sent, EpidemicHeader included
+  uint32_t GetSize () const;
   /// \returns the Ipv4Header associated with the queued packet
   Ipv4Header GetIpv4Header () const;
   /// Set the Ipv4Header associated with the queued packet
@@ -74,9 +93,21 @@ public:
   uint32_t GetPacketID () const;
   /// Set the PacketID \param id associated with the queued packet
   void SetPacketID (uint32_t id);
+  /// \returns the drop priority of the queued packet (higher is kept longer)
+  uint8_t GetPriority () const;
+  /// Set the drop priority \param priority of the queued packet
+  void SetPriority (uint8_t priority);
+  /// \returns the hop count in the EpidemicHeader of the queued packet
+  uint32_t GetHopCount () const;
+  /// Set the hop count \param hopCount in the EpidemicHeader
+  void SetHopCount (uint32_t hopCount);
+  /// \returns the origination time in the EpidemicHeader of the queued packet
+  Time GetTimeStamp () const;
+  /// Set the origination time \param timeStamp in the EpidemicHeader
+  void SetTimeStamp (Time timeStamp);
 
 private:
-  /// queued packet
+  /// queued packet, without its EpidemicHeader
   Ptr<const Packet> m_packet;
   /// IP header
   Ipv4Header m_header;
@@ -88,20 +119,111 @@ private:
   Time m_expire;
   /// Global packet ID
   uint32_t m_packetID;
+  /// Drop priority
+  uint8_t m_priority;
+  /// EpidemicHeader, prepended at each transmission
+  EpidemicHeader m_epidemicHeader;
 };
 
 
-// Forward declaration
-class SummaryVectorHeader;
+/**
+ * \ingroup epidemic
+ * \brief Binary min-heap of PacketQueue slots.
+ *
+ * Each slot is in the heap at most once, and the heap knows where, so
+ * that any slot is erased in logarithmic time.  The storage only grows
+ * with the slot pool of the queue: pushing and erasing do not allocate.
+ * \tparam Key the order of the slots, smallest on top
+ */
+template <class Key>
+class SlotHeap
+{
+public:
+  /**
+   * \brief Add a slot.
+   * \param slot a slot not in the heap
+   * \param key its key
+   */
+  void Push (uint32_t slot, const Key &key);
+  /**
+   * \brief Remove a slot.
+   * \param slot a slot of the heap
+   */
+  void Erase (uint32_t slot);
+  /// \returns true if the heap holds no slot
+  bool IsEmpty () const;
+  /// \returns the slot with the smallest key, the heap must not be empty
+  uint32_t Top () const;
+  /// \returns the smallest key, the heap must not be empty
+  const Key & TopKey () const;
+  /// Remove all slots, keeping the storage
+  void Clear ();
+
+private:
+  /// Position of a slot not in the heap
+  static const uint32_t NO_POSITION = 0xffffffff;
+  /// Key and slot of a heap node
+  typedef std::pair<Key, uint32_t> Node;
+  /// Move the node at \p i up to its place
+  void SiftUp (uint32_t i);
+  /// Move the node at \p i down to its place
+  void SiftDown (uint32_t i);
+  /// Store \p node at \p i
+  void Place (uint32_t i, const Node &node);
+  /// Heap nodes
+  std::vector<Node> m_nodes;
+  /// Position of each slot in m_nodes
+  std::vector<uint32_t> m_positions;
+};
 
 /**
  * \ingroup epidemic
  * \brief Epidemic queue
  * This queue contains Epidemic packets.
+ *
+ * Entries are indexed by packet ID and, in addition, kept ordered by
+ * expire time and by the configured DropPolicy, so that expiry and
+ * eviction only touch the entries they remove.  The queue is also
+ * partitioned by entry priority (the traffic class of the packet), so
+ * that whole classes can be counted and shed cheaply.
+ *
+ * The entries themselves live in a pool of slots that are recycled
+ * through a free list; the indexes only hold slot numbers.  Entries are
+ * moved in and never copied, and an entry keeps its address until it is
+ * removed from the queue.  Packet IDs map to slots through a flat open
+ * addressing table, and the orders are heaps of slots, so once the pool
+ * has grown to the queue length, enqueueing and dropping entries do not
+ * allocate.  The IDs are only sorted for summary vectors.
  */
 class PacketQueue
 {
 public:
+  /// Which entry is evicted when the queue is full
+  enum DropPolicy
+  {
+    DROP_OLDEST,          //!< Entry with the earliest expire time
+    DROP_LOWEST_PRIORITY, //!< Entry with the lowest priority, oldest first
+    DROP_LARGEST,         //!< Largest packet, oldest first
+  };
+
+  /// Why an entry left the queue other than by Dequeue
+  enum DropReason
+  {
+    DROP_EXPIRED,      //!< Its expire time passed
+    DROP_EVICTED,      //!< Selected by the drop policy, the queue was full
+    DROP_LOW_PRIORITY, //!< Removed by DropPriorityBelow
+    DROP_SHRUNK,       //!< Removed by Shrink
+    DROP_DELIVERED,    //!< Removed by Remove, the packet was delivered
+    DROP_HANDED_OFF,   //!< Removed by Remove, custody passed to a neighbor
+  };
+  /// Callback notified of each dropped entry, before it is released
+  typedef Callback<void, const QueueEntry &, DropReason> DropCallback;
+  /**
+   * Eviction rank of an entry: the lowest rank is evicted first, and
+   * entries of equal rank oldest first.  See epidemic-policy.h.
+   */
+  typedef int64_t (*EvictionRank) (const QueueEntry &entry);
+
   /**
    * \brief Constructor for PacketQueue
    * \param maxLen maximum length of the queue
@@ -110,18 +232,56 @@ public:
   /**
    * \brief Push entry in queue mapped with the its packet ID.
    *  If it already exists, update it.
-   * \param entry contains a packet ID
+   * \param entry contains a packet ID, moved into the queue
    * \returns true if the entry  is successfully added.
    */
-  bool Enqueue (QueueEntry & entry);
+  bool Enqueue (QueueEntry && entry);
   /**
    * \brief remove entry in queue mapped with the its packet ID.
-   * \param entry contains a packet ID
+   * \param entry receives the removed entry
    * \returns true if the entry  is successfully removed.
    */
   bool Dequeue (QueueEntry & entry);
   /// \returns number of entries
   uint32_t GetSize () const;
+  /**
+   * \param priority an entry priority
+   * \returns number of entries with priority \p priority
+   */
+  uint32_t GetSize (uint8_t priority) const;
+  /**
+   * \brief Drop all entries with a priority lower than \p priority,
+   *  oldest first.
+   * \param priority the lowest priority to keep
+   * \returns the number of dropped entries
+   */
+  uint32_t DropPriorityBelow (uint8_t priority);
+  /**
+   * \brief Set the maximum queue length and evict entries beyond it,
+   *  lowest priority first and oldest first within a priority, whatever
+   *  the drop policy.
+   * \param len the new maximum queue length
+   * \returns the number of dropped entries
+   */
+  uint32_t Shrink (uint32_t len);
+  /**
+   * \brief Drop the entry of a packet known to be delivered, or handed
+   *  to another node.
+   * \param packetID packet ID of the delivered packet
+   * \param reason DROP_DELIVERED or DROP_HANDED_OFF
+   * \returns true if the entry was in the queue
+   */
+  bool Remove (uint32_t packetID, DropReason reason = DROP_DELIVERED);
+  /**
+   * \brief Rewrite the EpidemicHeader of a buffered entry in place.
+   *
+   * Unlike Enqueue, nothing is purged or evicted, so references to the
+   * buffered entries stay valid.
+   * \param packetID packet ID of the entry
+   * \param header the new header
+   * \returns true if the entry was in the queue
+   */
+  bool SetEpidemicHeader (uint32_t packetID, const EpidemicHeader &header);
   /// \returns the maximum queue length
   uint32_t GetMaxQueueLen () const;
   /**
@@ -136,53 +296,248 @@ public:
    * \param t timeout
    */
   void SetQueueTimeout (Time t);
+  /// \returns the eviction policy applied when the queue is full
+  DropPolicy GetDropPolicy () const;
+  /**
+   * \brief Set the eviction policy applied when the queue is full.
+   * \param policy the drop policy.
+   */
+  void SetDropPolicy (DropPolicy policy);
+  /**
+   * \brief Evict by a custom rank rather than by a DropPolicy, until the
+   *  next SetDropPolicy.
+   * \param rank the eviction rank function
+   */
+  void SetEvictionRank (EvictionRank rank);
+  /**
+   * \brief Set the callback notified of each dropped entry.
+   *
+   * The callback must not modify the queue.
+   * \param cb the callback, or a null callback
+   */
+  void SetDropCallback (DropCallback cb);
+  /**
+   * \param reason a drop reason
+   * \returns the name of \p reason
+   */
+  static const char * GetDropReasonName (DropReason reason);
 
   /**
    * \brief Find a packet in the Epidemic queue based on the packetID.
-   *  If not found, return and empty QueueEntry
    * \param packetID packet ID for the target packet
-   * \returns the found QueueEntry
+   * \returns the found QueueEntry, valid until it leaves the queue,
+   *  or 0 if not found
    */
-  QueueEntry  Find (uint32_t packetID);
+  const QueueEntry * Find (uint32_t packetID) const;
   /// \returns the summary vector of a current node's buffer
   SummaryVectorHeader GetSummaryVector ();
   /**
    * \brief Returns a summary vector that contains
    *  the disjoint packets between the given list and current buffer
+   *
+   *  Both the buffer and \p list are ordered by packet ID, so this is a
+   *  single linear merge over the two sequences.
    * \param list a list of compared packet IDs
    * \returns the summary vector of the disjoint packets
    */
-  SummaryVectorHeader FindDisjointPackets (SummaryVectorHeader list);
+  SummaryVectorHeader FindDisjointPackets (const SummaryVectorHeader &list);
   /// Drop expired packet in the current node's buffer
   void DropExpiredPackets ();
+  /**
+   * \returns the earliest expire time of the buffered entries, or
+   *  Time::Max () if the queue is empty.  An entry is dropped once the
+   *  time is strictly past its expire time.
+   */
+  Time GetNextExpireTime () const;
 
 private:
-  ///  Type to connect a global Packet id to a QueueEntry
-  typedef std::map<uint32_t, QueueEntry> PacketIdMap;
-  /// Pair representing a global Packet Id and a QueueEntry
-  typedef PacketIdMap::value_type        PacketIdMapPair;
-  /// Map to store queue entries based on the packetID
-  PacketIdMap m_map;
-  /// Compare two QueueEntry's by expire time.
-  static bool IsEarlier (const PacketIdMapPair & e1,
-                         const PacketIdMapPair & e2);
+  /// Slot of an empty bucket of the packet ID table
+  static const uint32_t NO_SLOT = 0xffffffff;
+  /// Bucket of the packet ID table
+  struct IdBucket
+  {
+    uint32_t m_packetID;  ///< Global packet ID
+    uint32_t m_slot;      ///< Slot of its QueueEntry, NO_SLOT if empty
+  };
+  /// Expire time and global packet ID, ordered by expire time
+  typedef std::pair<Time, uint32_t>      ExpiryKey;
+  /// Policy rank, expire time and global packet ID, ordered for eviction
+  typedef std::tuple<int64_t, int64_t, uint32_t> EvictionKey;
+  /// Priority, expire time and global packet ID, ordered by priority
+  typedef std::tuple<uint8_t, Time, uint32_t> ClassKey;
+  /// Open addressing table (linear probing) of the entry slots, the size
+  /// is a power of two
+  std::vector<IdBucket> m_ids;
+  /// Number of buffered entries
+  uint32_t m_size;
+  /// Pool of queue entries; a deque keeps entries in place as it grows
+  std::deque<QueueEntry> m_slots;
+  /// Unused slots in m_slots
+  std::vector<uint32_t> m_freeSlots;
+  /// Queue entries ordered by expire time
+  SlotHeap<ExpiryKey> m_expiry;
+  /// Queue entries ordered by the drop policy, first to be evicted first
+  SlotHeap<EvictionKey> m_eviction;
+  /// Queue entries partitioned by priority, lowest first
+  SlotHeap<ClassKey> m_classes;
+  /// Number of queue entries of each priority
+  std::vector<uint32_t> m_classSizes;
+  /// Buffered packet IDs, sorted for summary vectors
+  std::vector<uint32_t> m_sortedIds;
+  /// \returns the bucket of \p packetID, or the empty bucket ending its probe
+  uint32_t FindBucket (uint32_t packetID) const;
+  /// \returns the slot of \p packetID, or NO_SLOT if it is not buffered
+  uint32_t FindSlot (uint32_t packetID) const;
+  /// Rebuild the packet ID table with \p capacity buckets
+  void Rehash (uint32_t capacity);
+  /// Remove \p packetID from the packet ID table
+  void EraseId (uint32_t packetID);
+  /// Fill m_sortedIds with the buffered packet IDs
+  void SortIds ();
+  /// \returns the eviction key of \p entry under the current eviction rank
+  EvictionKey GetEvictionKey (const QueueEntry & entry) const;
+  /// Rebuild the eviction index after an eviction rank change
+  void ReindexEviction ();
+  /// Add the entry of \p slot to the expiry, eviction and priority indexes
+  void Index (uint32_t slot);
+  /// Remove the entry of \p slot from the expiry, eviction and priority indexes
+  void Unindex (uint32_t slot);
+  /// Remove all expired entries
+  void PurgeExpired ();
   /**
-   * \brief Remove all expired entries.
-   * \param outdated if True, remove the outdated entries.
+   * \brief Remove all expired entries, then evict entries according to
+   *  the drop policy until the queue fits its maximum length.
    */
-  void Purge (bool outdated /* = false */);
+  void Purge ();
 
   /**
-   * \brief Drop a packet and log the reason.
-   * \param en the packet to be dropped.
+   * \brief Drop a packet, log and report the reason.
+   * \param slot the slot of the packet to be dropped.
    * \param reason the reason for dropping the packet.
    */
-  void Drop (PacketIdMap::iterator en, std::string reason);
+  void Drop (uint32_t slot, DropReason reason);
   /// The maximum number of packets that we allow a routing protocol to buffer.
   uint32_t m_maxLen;
+  /// Eviction policy when the queue is full
+  DropPolicy m_dropPolicy;
+  /// Rank of the entries for eviction, set by the drop policy
+  EvictionRank m_evictionRank;
+  /// Notified of each dropped entry
+  DropCallback m_dropCallback;
 
 
 };
+
+template <class Key>
+const uint32_t SlotHeap<Key>::NO_POSITION;
+
+template <class Key>
+void
+SlotHeap<Key>::Push (uint32_t slot, const Key &key)
+{
+  if (slot >= m_positions.size ())
+    {
+      m_positions.resize (slot + 1, NO_POSITION);
+    }
+  m_nodes.push_back (Node (key, slot));
+  m_positions[slot] = m_nodes.size () - 1;
+  SiftUp (m_nodes.size () - 1);
+}
+
+template <class Key>
+void
+SlotHeap<Key>::Erase (uint32_t slot)
+{
+  uint32_t i = m_positions[slot];
+  m_positions[slot] = NO_POSITION;
+  Node last = m_nodes.back ();
+  m_nodes.pop_back ();
+  if (i == m_nodes.size ())
+    {
+      return;
+    }
+  // The last node fills the hole, then moves up or down
+  Place (i, last);
+  SiftUp (i);
+  SiftDown (m_positions[last.second]);
+}
+
+template <class Key>
+bool
+SlotHeap<Key>::IsEmpty () const
+{
+  return m_nodes.empty ();
+}
+
+template <class Key>
+uint32_t
+SlotHeap<Key>::Top () const
+{
+  return m_nodes.front ().second;
+}
+
+template <class Key>
+const Key &
+SlotHeap<Key>::TopKey () const
+{
+  return m_nodes.front ().first;
+}
+
+template <class Key>
+void
+SlotHeap<Key>::Clear ()
+{
+  for (typename std::vector<Node>::const_iterator i = m_nodes.begin (); i != m_nodes.end (); ++i)
+    {
+      m_positions[i->second] = NO_POSITION;
+    }
+  m_nodes.clear ();
+}
+
+template <class Key>
+void
+SlotHeap<Key>::SiftUp (uint32_t i)
+{
+  Node node = m_nodes[i];
+  while (i > 0 && node.first < m_nodes[(i - 1) / 2].first)
+    {
+      Place (i, m_nodes[(i - 1) / 2]);
+      i = (i - 1) / 2;
+    }
+  Place (i, node);
+}
+
+template <class Key>
+void
+SlotHeap<Key>::SiftDown (uint32_t i)
+{
+  Node node = m_nodes[i];
+  uint32_t size = m_nodes.size ();
+  while (2 * i + 1 < size)
+    {
+      uint32_t child = 2 * i + 1;
+      if (child + 1 < size && m_nodes[child + 1].first < m_nodes[child].first)
+        {
+          ++child;
+        }
+      if (!(m_nodes[child].first < node.first))
+        {
+          break;
+        }
+      Place (i, m_nodes[child]);
+      i = child;
+    }
+  Place (i, node);
+}
+
+template <class Key>
+void
+SlotHeap<Key>::Place (uint32_t i, const Node &node)
+{
+  m_nodes[i] = node;
+  m_positions[node.second] = i;
+}
+
 } //end namespace epidemic
 } //end namespace ns3
 #endif
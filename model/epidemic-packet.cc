@@ -76,6 +76,9 @@ TypeHeader::Deserialize (Buffer::Iterator start)
     case BEACON:
     case REPLY:
     case REPLY_BACK:
+    case REPLY_COMPACT:
+    case REPLY_BACK_COMPACT:
+    case BUNDLE:
       {
         m_type = (MessageType) type;
         break;
@@ -109,6 +112,21 @@ TypeHeader::Print (std::ostream &os) const
         os << "REPLY_BACK";
         break;
       }
+    case REPLY_COMPACT:
+      {
+        os << "REPLY_COMPACT";
+        break;
+      }
+    case REPLY_BACK_COMPACT:
+      {
+        os << "REPLY_BACK_COMPACT";
+        break;
+      }
+    case BUNDLE:
+      {
+        os << "BUNDLE";
+        break;
+      }
     default:
       os << "UNKNOWN_TYPE";
       break;
@@ -134,6 +152,12 @@ TypeHeader::IsMessageType (const MessageType type) const
   return m_type == type;
 }
 
+bool
+TypeHeader::IsValid () const
+{
+  return m_valid;
+}
+
 std::ostream &
 operator<< (std::ostream & os, TypeHeader const & h)
 {
@@ -141,11 +165,63 @@ operator<< (std::ostream & os, TypeHeader const & h)
   return os;
 }
 
+/// \returns the number of bytes needed to varint-encode \p value
+static uint32_t
+VarintSize (uint32_t value)
+{
+  uint32_t size = 1;
+  while (value >= 0x80)
+    {
+      value >>= 7;
+      ++size;
+    }
+  return size;
+}
+
+/// Write \p value as a LEB128 varint
+static void
+WriteVarint (Buffer::Iterator &i, uint32_t value)
+{
+  while (value >= 0x80)
+    {
+      i.WriteU8 ((uint8_t)(value | 0x80));
+      value >>= 7;
+    }
+  i.WriteU8 ((uint8_t) value);
+}
+
+/**
+ * Read a LEB128 varint from \p i, without going past its end
+ * \param i the buffer iterator
+ * \param value the varint read
+ * \returns false if the buffer ends inside the varint
+ */
+static bool
+ReadVarint (Buffer::Iterator &i, uint32_t &value)
+{
+  value = 0;
+  uint32_t shift = 0;
+  uint8_t byte;
+  do
+    {
+      if (i.GetRemainingSize () == 0)
+        {
+          return false;
+        }
+      byte = i.ReadU8 ();
+      value |= (uint32_t)(byte & 0x7f) << shift;
+      shift += 7;
+    }
+  while ((byte & 0x80) && shift < 35);
+  return true;
+}
+
 NS_OBJECT_ENSURE_REGISTERED (SummaryVectorHeader);
 
-SummaryVectorHeader::SummaryVectorHeader (size_t size)
+SummaryVectorHeader::SummaryVectorHeader (size_t size, Encoding encoding)
+  : m_encoding (encoding)
 {
-  NS_LOG_FUNCTION (this << size);
+  NS_LOG_FUNCTION (this << size << encoding);
   m_packets.reserve (size);
 }
 
@@ -173,12 +249,58 @@ SummaryVectorHeader::GetInstanceTypeId () const
 uint32_t
 SummaryVectorHeader::GetSerializedSize () const
 {
-  return sizeof(uint32_t) + (uint32_t) m_packets.size () * sizeof (uint32_t);
+  if (m_encoding == PLAIN)
+    {
+      return sizeof(uint32_t) + (uint32_t) m_packets.size () * sizeof (uint32_t);
+    }
+  uint32_t size = 0;
+  uint32_t runs = 0;
+  uint32_t next = 0;
+  for (size_t j = 0; j < m_packets.size (); )
+    {
+      size_t k = j;
+      while (k + 1 < m_packets.size () && m_packets[k + 1] == m_packets[k] + 1)
+        {
+          ++k;
+        }
+      size += VarintSize (m_packets[j] - next) + VarintSize (k - j);
+      next = m_packets[k] + 1;
+      ++runs;
+      j = k + 1;
+    }
+  return VarintSize (runs) + size;
 }
 
 void
 SummaryVectorHeader::Serialize (Buffer::Iterator i) const
 {
+  if (m_encoding == COMPACT)
+    {
+      uint32_t runs = 0;
+      for (size_t j = 0; j < m_packets.size (); ++j)
+        {
+          if (j == 0 || m_packets[j] != m_packets[j - 1] + 1)
+            {
+              ++runs;
+            }
+        }
+      WriteVarint (i, runs);
+      uint32_t next = 0;
+      for (size_t j = 0; j < m_packets.size (); )
+        {
+          size_t k = j;
+          while (k + 1 < m_packets.size () && m_packets[k + 1] == m_packets[k] + 1)
+            {
+              ++k;
+            }
+          WriteVarint (i, m_packets[j] - next);
+          WriteVarint (i, k - j);
+          next = m_packets[k] + 1;
+          j = k + 1;
+        }
+      return;
+    }
+
   i.WriteHtonU32 (m_packets.size ());
 
   for (std::vector<uint32_t>::const_iterator j = m_packets.begin ();
@@ -193,7 +315,53 @@ uint32_t
 SummaryVectorHeader::Deserialize (Buffer::Iterator start)
 {
   Buffer::Iterator i = start;
+  if (m_encoding == COMPACT)
+    {
+      m_packets.clear ();
+      uint32_t runs = 0;
+      if (!ReadVarint (i, runs))
+        {
+          return i.GetDistanceFrom (start);
+        }
+      // Each run takes two bytes at least, whatever the peer claims
+      runs = std::min (runs, i.GetRemainingSize () / 2);
+      // Wider than an ID, so that a forged gap or length cannot wrap
+      // around and leave the IDs unsorted
+      uint64_t next = 0;
+      for (uint32_t r = 0; r < runs; ++r)
+        {
+          uint32_t gap;
+          uint32_t length;
+          if (!ReadVarint (i, gap) || !ReadVarint (i, length))
+            {
+              NS_LOG_WARN ("Truncated compact summary vector");
+              break;
+            }
+          uint64_t first = next + gap;
+          uint64_t end = std::min<uint64_t> (first + length + 1, (uint64_t) 1 << 32);
+          end = std::min<uint64_t> (end, first + MAX_EXPANDED_IDS - m_packets.size ());
+          if (first >= end)
+            {
+              break;
+            }
+          for (uint64_t id = first; id != end; ++id)
+            {
+              m_packets.push_back ((uint32_t) id);
+            }
+          next = end;
+        }
+      return i.GetDistanceFrom (start);
+    }
+
+  if (i.GetRemainingSize () < sizeof (uint32_t))
+    {
+      m_packets.clear ();
+      return 0;
+    }
   uint32_t sm_length = i.ReadNtohU32 ();
+  // No more IDs than the bytes left can hold
+  sm_length = std::min (sm_length, i.GetRemainingSize () / 4);
+  m_packets.clear ();
   m_packets.reserve (sm_length);
   for (uint32_t j = 0; j < sm_length; ++j)
     {
@@ -201,7 +369,15 @@ SummaryVectorHeader::Deserialize (Buffer::Iterator start)
       m_packets.push_back (tmp);
     }
   uint32_t dist = i.GetDistanceFrom (start);
-  NS_ASSERT (dist == GetSerializedSize ());
+  // Sort once here so that Contains () and the merge in
+  // PacketQueue::FindDisjointPackets () do not have to scan linearly.
+  if (!std::is_sorted (m_packets.begin (), m_packets.end ()))
+    {
+      std::sort (m_packets.begin (), m_packets.end ());
+    }
+  m_packets.erase (std::unique (m_packets.begin (), m_packets.end ()),
+                   m_packets.end ());
+  NS_ASSERT (dist == sizeof(uint32_t) + sm_length * sizeof (uint32_t));
 
   return dist;
 }
@@ -219,6 +395,7 @@ void
 SummaryVectorHeader::Print (std::ostream &os) const
 {
   os << " Summary_vector header with size: " << m_packets.size ()
+     << (m_encoding == COMPACT ? " (compact)" : "")
   << "\nGlobal IDs:\n" << "NodeID:PacketID\n";
   for (std::vector<uint32_t>::const_iterator j = m_packets.begin ();
        j != m_packets.end (); ++j)
@@ -236,7 +413,17 @@ void
 SummaryVectorHeader::Add (const uint32_t pkt_ID)
 {
   NS_LOG_FUNCTION (this << pkt_ID);
-  m_packets.push_back (pkt_ID);
+  if (m_packets.empty () || m_packets.back () < pkt_ID)
+    {
+      m_packets.push_back (pkt_ID);
+      return;
+    }
+  std::vector<uint32_t>::iterator pos =
+    std::lower_bound (m_packets.begin (), m_packets.end (), pkt_ID);
+  if (*pos != pkt_ID)
+    {
+      m_packets.insert (pos, pkt_ID);
+    }
 }
 
 size_t
@@ -249,18 +436,68 @@ SummaryVectorHeader::Size (void) const
 bool
 SummaryVectorHeader::Contains (const uint32_t pkt_ID) const
 {
-  bool contained = ( std::find (m_packets.begin (), m_packets.end (), pkt_ID)
-                     != m_packets.end () );
-  return contained;
+  return std::binary_search (m_packets.begin (), m_packets.end (), pkt_ID);
+}
+
+SummaryVectorHeader::Iterator
+SummaryVectorHeader::Begin (void) const
+{
+  return m_packets.begin ();
+}
+
+SummaryVectorHeader::Iterator
+SummaryVectorHeader::End (void) const
+{
+  return m_packets.end ();
+}
+
+void
+SummaryVectorHeader::SetEncoding (Encoding encoding)
+{
+  NS_LOG_FUNCTION (this << encoding);
+  m_encoding = encoding;
+}
+
+SummaryVectorHeader::Encoding
+SummaryVectorHeader::GetEncoding (void) const
+{
+  return m_encoding;
 }
 
 
 NS_OBJECT_ENSURE_REGISTERED (EpidemicHeader);
 
+EpidemicHeader::EpidemicHeader ()
+  : m_packetID (0),
+    m_hopCount (0),
+    m_timeStamp (Seconds (0)),
+    m_trafficClass (BULK),
+    m_copies (0),
+    m_codec (0),
+    m_custody (false)
+{
+}
+
 EpidemicHeader::~EpidemicHeader ()
 {
 }
 
+EpidemicHeader::TrafficClass
+EpidemicHeader::ClassifyDscp (Ipv4Header::DscpType dscp)
+{
+  switch (dscp)
+    {
+    case Ipv4Header::DSCP_CS6:
+    case Ipv4Header::DSCP_CS7:
+      return ALERT;
+    case Ipv4Header::DSCP_EF:
+    case Ipv4Header::DSCP_CS5:
+      return VOICE;
+    default:
+      return BULK;
+    }
+}
+
 
 void
 EpidemicHeader::SetPacketID (uint32_t pktID)
@@ -305,6 +542,62 @@ Time EpidemicHeader::GetTimeStamp () const
 }
 
 
+void
+EpidemicHeader::SetTrafficClass (TrafficClass trafficClass)
+{
+  NS_LOG_FUNCTION (this << trafficClass);
+  m_trafficClass = trafficClass;
+}
+
+EpidemicHeader::TrafficClass
+EpidemicHeader::GetTrafficClass () const
+{
+  return (TrafficClass) m_trafficClass;
+}
+
+
+void
+EpidemicHeader::SetCopies (uint16_t copies)
+{
+  NS_LOG_FUNCTION (this << copies);
+  m_copies = copies;
+}
+
+uint16_t
+EpidemicHeader::GetCopies () const
+{
+  return m_copies;
+}
+
+
+void
+EpidemicHeader::SetCodec (uint8_t codec)
+{
+  NS_LOG_FUNCTION (this << (uint32_t) codec);
+  m_codec = codec;
+}
+
+uint8_t
+EpidemicHeader::GetCodec () const
+{
+  return m_codec;
+}
+
+
+void
+EpidemicHeader::SetCustody (bool custody)
+{
+  NS_LOG_FUNCTION (this << custody);
+  m_custody = custody;
+}
+
+bool
+EpidemicHeader::IsCustody () const
+{
+  return m_custody;
+}
+
+
 TypeId
 EpidemicHeader::GetTypeId (void)
 {
@@ -325,7 +618,9 @@ uint32_t
 EpidemicHeader::GetSerializedSize () const
 {
 
-  return sizeof(m_packetID) + sizeof(m_hopCount) + sizeof(m_timeStamp);
+  return sizeof(m_packetID) + sizeof(m_hopCount) + sizeof(m_timeStamp)
+         + sizeof(m_trafficClass) + sizeof(m_copies)
+         + sizeof(m_codec);
 
 }
 
@@ -335,6 +630,10 @@ EpidemicHeader::Serialize (Buffer::Iterator i) const
   i.WriteHtonU32 (m_packetID);
   i.WriteHtonU32 (m_hopCount);
   i.WriteHtonU64 (m_timeStamp.GetNanoSeconds ());
+  // The custody mark shares the byte of the traffic class
+  i.WriteU8 (m_trafficClass | (m_custody ? CUSTODY_FLAG : 0));
+  i.WriteHtonU16 (m_copies);
+  i.WriteU8 (m_codec);
 
 }
 
@@ -344,7 +643,12 @@ EpidemicHeader::Deserialize (Buffer::Iterator start)
   Buffer::Iterator i = start;
   m_packetID = i.ReadNtohU32 ();
   m_hopCount = i.ReadNtohU32 ();
-  m_timeStamp = Time (i.ReadNtohU64 ());
+  m_timeStamp = NanoSeconds (i.ReadNtohU64 ());
+  uint8_t trafficClass = i.ReadU8 ();
+  m_trafficClass = trafficClass & ~CUSTODY_FLAG;
+  m_custody = (trafficClass & CUSTODY_FLAG) != 0;
+  m_copies = i.ReadNtohU16 ();
+  m_codec = i.ReadU8 ();
   uint32_t dist = i.GetDistanceFrom (start);
   NS_ASSERT (dist == GetSerializedSize ());
   return dist;
@@ -361,8 +665,169 @@ void
 EpidemicHeader::Print (std::ostream &os) const
 {
   os << " Packet ID: " << m_packetID << " Hop count: " << m_hopCount
-  << " TimeStamp: " << m_timeStamp;
+  << " TimeStamp: " << m_timeStamp << " Traffic class: " << (uint32_t) m_trafficClass
+  << " Copies: " << m_copies << " Codec: " << (uint32_t) m_codec
+  << " Custody: " << m_custody;
+
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (BundleItemHeader);
+
+BundleItemHeader::BundleItemHeader (const Ipv4Header &header, uint16_t length)
+  : m_source (header.GetSource ()),
+    m_destination (header.GetDestination ()),
+    m_protocol (header.GetProtocol ()),
+    m_ttl (header.GetTtl ()),
+    m_length (length)
+{
+}
+
+BundleItemHeader::~BundleItemHeader ()
+{
+}
+
+TypeId
+BundleItemHeader::GetTypeId (void)
+{
+  static TypeId tid =
+    TypeId ("ns3::Epidemic::BundleItemHeader")
+    .SetParent<Header> ()
+    .AddConstructor<BundleItemHeader> ();
+  return tid;
+}
+
+TypeId
+BundleItemHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+BundleItemHeader::GetSerializedSize () const
+{
+  return SERIALIZED_SIZE;
+}
+
+void
+BundleItemHeader::Serialize (Buffer::Iterator i) const
+{
+  WriteTo (i, m_source);
+  WriteTo (i, m_destination);
+  i.WriteU8 (m_protocol);
+  i.WriteU8 (m_ttl);
+  i.WriteHtonU16 (m_length);
+}
+
+uint32_t
+BundleItemHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  ReadFrom (i, m_source);
+  ReadFrom (i, m_destination);
+  m_protocol = i.ReadU8 ();
+  m_ttl = i.ReadU8 ();
+  m_length = i.ReadNtohU16 ();
+  uint32_t dist = i.GetDistanceFrom (start);
+  NS_ASSERT (dist == GetSerializedSize ());
+  return dist;
+}
+
+void
+BundleItemHeader::Print (std::ostream &os) const
+{
+  os << " Source: " << m_source << " Destination: " << m_destination
+     << " Protocol: " << (uint32_t) m_protocol << " TTL: " << (uint32_t) m_ttl
+     << " Length: " << m_length;
+}
+
+Ipv4Header
+BundleItemHeader::GetIpv4Header () const
+{
+  Ipv4Header header;
+  header.SetSource (m_source);
+  header.SetDestination (m_destination);
+  header.SetProtocol (m_protocol);
+  header.SetTtl (m_ttl);
+  header.SetPayloadSize (m_length);
+  return header;
+}
+
+uint16_t
+BundleItemHeader::GetLength () const
+{
+  return m_length;
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (BeaconInfoHeader);
+
+BeaconInfoHeader::BeaconInfoHeader (double energyRatio, uint32_t freeSpace)
+  : m_energy (static_cast<uint16_t> (std::min (std::max (energyRatio, 0.0), 1.0) * 65535 + 0.5)),
+    m_freeSpace (static_cast<uint16_t> (std::min<uint32_t> (freeSpace, 65535)))
+{
+}
+
+BeaconInfoHeader::~BeaconInfoHeader ()
+{
+}
+
+TypeId
+BeaconInfoHeader::GetTypeId (void)
+{
+  static TypeId tid =
+    TypeId ("ns3::Epidemic::BeaconInfoHeader")
+    .SetParent<Header> ()
+    .AddConstructor<BeaconInfoHeader> ();
+  return tid;
+}
+
+TypeId
+BeaconInfoHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
 
+uint32_t
+BeaconInfoHeader::GetSerializedSize () const
+{
+  return SERIALIZED_SIZE;
+}
+
+void
+BeaconInfoHeader::Serialize (Buffer::Iterator i) const
+{
+  i.WriteHtonU16 (m_energy);
+  i.WriteHtonU16 (m_freeSpace);
+}
+
+uint32_t
+BeaconInfoHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  m_energy = i.ReadNtohU16 ();
+  m_freeSpace = i.ReadNtohU16 ();
+  uint32_t dist = i.GetDistanceFrom (start);
+  NS_ASSERT (dist == GetSerializedSize ());
+  return dist;
+}
+
+void
+BeaconInfoHeader::Print (std::ostream &os) const
+{
+  os << " Energy ratio: " << GetEnergyRatio () << " Free space: " << m_freeSpace;
+}
+
+double
+BeaconInfoHeader::GetEnergyRatio () const
+{
+  return m_energy / 65535.0;
+}
+
+uint16_t
+BeaconInfoHeader::GetFreeSpace () const
+{
+  return m_freeSpace;
 }
 } //end namespace epidemic
 } //end namespace ns3
@@ -5,14 +5,18 @@
 #include <iostream>
 #include "ns3/header.h"
 #include "ns3/ipv4-address.h"
+#include "ns3/ipv4-header.h"
 #include "ns3/nstime.h"
-#include "algorithm"
+#include "ns3/packet.h"
+#include <algorithm>
+#include <vector>
 
 /**
  * \file
  * \ingroup epidemic
- * ns3::Epidemic::TypeHeader, ns3::Epidemic::SummaryVectorHeader
- * and ns3::Epidemic::EpidemicHeader declarations.
+ * ns3::Epidemic::TypeHeader, ns3::Epidemic::SummaryVectorHeader,
+ * ns3::Epidemic::EpidemicHeader and ns3::Epidemic::BundleItemHeader
+ * declarations.
  */
 
 namespace ns3 {
@@ -38,6 +42,16 @@ namespace Epidemic {
  *    packets the other node. After that, it sends a reply back packet
  *    containing a summary vector of all the packet IDs in its buffer
  *    so the other host sends the disjoint packets as well.
+ *
+ * REPLY_COMPACT and REPLY_BACK_COMPACT carry the same summary vector
+ * using SummaryVectorHeader::COMPACT encoding.  The initiator of a session
+ * picks the encoding of its reply, and the peer answers with a reply back
+ * in the same encoding; the encoding is not negotiated, so compact replies
+ * require every node of the network to parse the compact types.
+ *
+ * BUNDLE carries several buffered data packets, each preceded by a
+ * BundleItemHeader, so that the disjoint packets of a contact share a
+ * frame instead of contending for the medium one by one.
  *
   \verbatim
    0
@@ -56,7 +70,9 @@ public:
     BEACON,     //!< Advertise the presence of a node
     REPLY,      //!< Reply to a beacon, with the packet Id summary vector
     REPLY_BACK, //!< Response to a Reply packet, as list of disjoint packets.
-
+    REPLY_COMPACT,      //!< REPLY with a compact summary vector
+    REPLY_BACK_COMPACT, //!< REPLY_BACK with a compact summary vector
+    BUNDLE,             //!< Several buffered data packets in one frame
   };
 
   /**
@@ -149,16 +165,40 @@ std::ostream & operator<< (std::ostream & os, TypeHeader const & h);
   |                                                               |
   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
   \endverbatim
+*
+*  With COMPACT encoding the sorted IDs are grouped into runs of
+*  consecutive values and every field is a LEB128 varint: the number
+*  of runs, then for each run the gap from the end of the previous run
+*  and the run length minus one.  Since global IDs are a 16 bit sender
+*  address followed by a 16 bit counter, the packets of one source
+*  usually collapse into a single run of a few bytes.
+  \verbatim
+  +----------------+------------+-----------------+-----+
+  | varint n runs  | varint gap | varint len - 1  | ... |
+  +----------------+------------+-----------------+-----+
+  \endverbatim
 */
 
 
 class SummaryVectorHeader : public Header
 {
 public:
+  /// Wire encoding of the summary vector
+  enum Encoding
+  {
+    PLAIN,   //!< 32 bit length followed by one 32 bit ID per packet
+    COMPACT, //!< Varint delta-encoded runs of consecutive IDs
+  };
+
+  /// Most IDs a received compact summary vector expands to
+  static const uint32_t MAX_EXPANDED_IDS = 1 << 20;
+
   /**
   * \brief Constructor.
+  * \param size2 number of IDs to reserve room for.
+  * \param encoding the wire encoding.
   */
-  SummaryVectorHeader (size_t size2 = 0);
+  SummaryVectorHeader (size_t size2 = 0, Encoding encoding = PLAIN);
   /**
    * \brief Destructor.
    */
@@ -175,9 +215,15 @@ public:
   virtual void Print (std::ostream &os) const;
 
 
+  /// Const iterator over the (sorted) global packet IDs
+  typedef std::vector<uint32_t>::const_iterator Iterator;
+
   /**
    * Add a global packet id.
    *
+   * IDs are kept sorted and unique, so adding in ascending order
+   * (as PacketQueue::GetSummaryVector does) is O(1).
+   *
    * \param pkt_ID The global packet id to add.
    */
   void Add (const uint32_t pkt_ID);
@@ -194,12 +240,27 @@ public:
    * \return The number of global packet IDs in this header.
    */
   size_t Size (void) const;
+  /// \returns an iterator to the smallest global packet ID
+  Iterator Begin (void) const;
+  /// \returns an iterator past the largest global packet ID
+  Iterator End (void) const;
+  /**
+   * Set the wire encoding.  It must be set before Deserialize () is
+   * called, typically from the message type of the preceding TypeHeader.
+   * \param encoding the wire encoding.
+   */
+  void SetEncoding (Encoding encoding);
+  /// \returns the wire encoding
+  Encoding GetEncoding (void) const;
 
 private:
   /**
-   * A vector to store packet IDs.
+   * A vector to store packet IDs, sorted in ascending order
+   * without duplicates.
    */
   std::vector<uint32_t> m_packets;
+  /// Wire encoding
+  Encoding m_encoding;
 
   // RoutingProtocol::SendDisjointPackets
   // needs to iterate through the vector
@@ -226,7 +287,7 @@ std::ostream &operator<< (std::ostream& os,
  *  This packet header is added to a data packet in the source node once it is
  *  received from the transport layer. It is removed in the receiver node
  *  before it is delivered to the transport layer.
- *  The Epidemic Header consists of three fields:
+ *  The Epidemic Header consists of six fields:
  *
  *  1. Packet ID:  global packet ID
  *
@@ -246,6 +307,25 @@ std::ostream &operator<< (std::ostream& os,
  *     It show when the packet is generated.  This field is used
  *     to discard old packets with a time threshold limit set by the user.
  *
+ *  4. Traffic Class:
+ *
+ *     Set by the source from the DSCP of the packet and kept unchanged
+ *     along the path.  Nodes low on energy use it to spend their energy
+ *     on voice and alert traffic and to shed bulk data first.
+ *
+ *  5. Copies:
+ *
+ *     Number of copies of the packet the holder may still hand out in
+ *     spray-and-wait forwarding.  A holder with a single copy only
+ *     delivers it to the destination.  Zero means no limit, that is
+ *     plain epidemic forwarding.
+ *
+ *  6. Codec:
+ *
+ *     ID of the PayloadCodec the source compressed the payload with, 0
+ *     for an uncompressed payload.  The destination restores the payload
+ *     with the codec of the same ID.
+ *
  *  The complete header is formatted as follows:
   \verbatim
   0                   1                   2                   3
@@ -258,15 +338,60 @@ std::ostream &operator<< (std::ostream& os,
   |                     64 Bit Timestamp                          |
   |                                                               |
   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  | Traffic Class |            Copies             |     Codec     |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
   \endverbatim
  */
 class EpidemicHeader : public Header
 {
 public:
+  /// Traffic classes, in increasing order of importance
+  enum TrafficClass
+  {
+    BULK = 0,  //!< Best effort data
+    VOICE = 1, //!< Speech, marked EF or CS5
+    ALERT = 2, //!< Emergency alerts, marked CS6 or CS7
+  };
+
+  /**
+   * \brief Constructor.
+   */
+  EpidemicHeader ();
   /**
    * \brief Destructor.
    */
   virtual ~EpidemicHeader ();
+  /**
+   * \brief Map the DSCP of a packet to its traffic class.
+   * \param dscp the DSCP of the IPv4 header.
+   * \return the traffic class.
+   */
+  static TrafficClass ClassifyDscp (Ipv4Header::DscpType dscp);
+
+  /// Leading fields of a serialized EpidemicHeader
+  struct Fields
+  {
+    uint32_t m_packetID;  ///< Global packet ID
+    uint32_t m_hopCount;  ///< Remaining hops
+    Time m_timeStamp;     ///< Time at which the packet was originated
+    bool m_custody;       ///< Handed over in a custody transfer
+  };
+  /// Size of the leading fields in a serialized header
+  static const uint32_t FIELDS_SIZE = 17;
+  /// Bit of the traffic class byte marking a custody transfer
+  static const uint8_t CUSTODY_FLAG = 0x80;
+  /**
+   * \brief Read the packet ID, hop count, time stamp and custody flag of
+   *  the header at the start of \p packet, straight from the packet buffer.
+   *
+   * Unlike PeekHeader () this neither copies the packet nor goes through
+   * the virtual Header interface, which is what the duplicate and hop
+   * checks of a relay need before it decides to buffer a packet.
+   * \param packet the packet starting with an EpidemicHeader.
+   * \param fields receives the fields.
+   * \return false if the packet is too short to hold the fields.
+   */
+  static inline bool PeekFields (Ptr<const Packet> packet, Fields &fields);
   /**
    *  \brief Get the registered TypeId for this class.
    *  \return The object TypeId.
@@ -309,12 +434,63 @@ public:
    */
   Time GetTimeStamp () const;
 
+  /**
+   * \brief Set Traffic class for current packet
+   */
+  void SetTrafficClass (TrafficClass trafficClass);
+
+  /**
+   * \brief Get Traffic class for current packet
+   * \return traffic class
+   */
+  TrafficClass GetTrafficClass () const;
+
+  /**
+   * \brief Set the spray-and-wait copy budget for current packet
+   */
+  void SetCopies (uint16_t copies);
 
+  /**
+   * \brief Get the spray-and-wait copy budget for current packet
+   * \return number of copies, 0 for no limit
+   */
+  uint16_t GetCopies () const;
+
+  /**
+   * \brief Set the payload codec ID for current packet
+   */
+  void SetCodec (uint8_t codec);
+
+  /**
+   * \brief Get the payload codec ID for current packet
+   * \return codec ID, 0 for an uncompressed payload
+   */
+  uint8_t GetCodec () const;
+
+  /**
+   * \brief Mark the packet as handed over in a custody transfer
+   *
+   * The receiver of such a copy buffers it whatever its duplicate filter
+   * and forwarding policy say, and clears the mark.
+   * \param custody true if the packet is handed over
+   */
+  void SetCustody (bool custody);
+
+  /**
+   * \brief Get the custody transfer mark of current packet
+   * \return true if the sender handed the packet over and waits for the
+   *  receiver to list it in its summary vector
+   */
+  bool IsCustody () const;
 
 private:
   uint32_t m_packetID;      ///< global packet ID
   uint32_t m_hopCount;      ///< Count to keep track of number of traveled hops
   Time m_timeStamp;         ///< Time at which packet was originated
+  uint8_t m_trafficClass;   ///< Traffic class set by the source
+  uint16_t m_copies;        ///< Copies the holder may hand out, 0 for no limit
+  uint8_t m_codec;          ///< Payload codec ID, 0 for none
+  bool m_custody;           ///< Handed over in a custody transfer
 
 
 };
@@ -330,6 +506,144 @@ private:
 std::ostream &operator<< (std::ostream& os,
                           const EpidemicHeader & header);
 
+bool
+EpidemicHeader::PeekFields (Ptr<const Packet> packet, Fields &fields)
+{
+  uint8_t buffer[FIELDS_SIZE];
+  if (packet->CopyData (buffer, FIELDS_SIZE) < FIELDS_SIZE)
+    {
+      return false;
+    }
+  // Network byte order, as written by Serialize ()
+  fields.m_packetID = ((uint32_t) buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+  fields.m_hopCount = ((uint32_t) buffer[4] << 24) | (buffer[5] << 16) | (buffer[6] << 8) | buffer[7];
+  uint64_t timeStamp = 0;
+  for (uint32_t i = 8; i < 16; ++i)
+    {
+      timeStamp = (timeStamp << 8) | buffer[i];
+    }
+  fields.m_timeStamp = NanoSeconds (static_cast<int64_t> (timeStamp));
+  fields.m_custody = (buffer[16] & CUSTODY_FLAG) != 0;
+  return true;
+}
+
+
+/**
+* \ingroup epidemic
+* \brief    Epidemic Bundle Item Header
+*  Precedes each data packet carried in a BUNDLE frame.  It keeps the
+*  fields of the IPv4 header the receiver needs to buffer or deliver the
+*  packet, followed by the length of the packet (EpidemicHeader included).
+  \verbatim
+  0                   1                   2                   3
+  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                        Source Address                         |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                      Destination Address                      |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |    Protocol   |      TTL      |            Length             |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  \endverbatim
+ */
+class BundleItemHeader : public Header
+{
+public:
+  /**
+   * \brief Constructor.
+   * \param header IPv4 header of the carried packet.
+   * \param length size of the carried packet in bytes.
+   */
+  BundleItemHeader (const Ipv4Header &header = Ipv4Header (), uint16_t length = 0);
+  /**
+   * \brief Destructor.
+   */
+  virtual ~BundleItemHeader ();
+  /**
+   *  \brief Get the registered TypeId for this class.
+   *  \return The object TypeId.
+   */
+  static TypeId GetTypeId (void);
+  // Inherited
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize () const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+
+  /**
+   * \brief Rebuild the IPv4 header of the carried packet.
+   * \return IPv4 header with source, destination, protocol, TTL and
+   *  payload size set.
+   */
+  Ipv4Header GetIpv4Header () const;
+  /// \return size of the carried packet in bytes
+  uint16_t GetLength () const;
+
+  /// Size of a serialized bundle item header
+  static const uint32_t SERIALIZED_SIZE = 12;
+
+private:
+  Ipv4Address m_source;      ///< Source of the carried packet
+  Ipv4Address m_destination; ///< Destination of the carried packet
+  uint8_t m_protocol;        ///< Transport protocol number
+  uint8_t m_ttl;             ///< IP TTL of the carried packet
+  uint16_t m_length;         ///< Size of the carried packet
+};
+
+/**
+* \ingroup epidemic
+* \brief    Epidemic Beacon Info Header
+*  Follows the type header of each BEACON.  It advertises the energy and
+*  the buffer room of the sender, from which low energy neighbors pick the
+*  node to hand their buffered packets to.  The energy ratio is quantized
+*  to 1/65535.
+  \verbatim
+  0                   1                   2                   3
+  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |         Energy Ratio          |          Free Space           |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  \endverbatim
+ */
+class BeaconInfoHeader : public Header
+{
+public:
+  /**
+   * \brief Constructor.
+   * \param energyRatio remaining energy ratio of the sender, clamped to [0, 1].
+   * \param freeSpace packets the sender can still buffer, clamped to 65535.
+   */
+  BeaconInfoHeader (double energyRatio = 1.0, uint32_t freeSpace = 0);
+  /**
+   * \brief Destructor.
+   */
+  virtual ~BeaconInfoHeader ();
+  /**
+   *  \brief Get the registered TypeId for this class.
+   *  \return The object TypeId.
+   */
+  static TypeId GetTypeId (void);
+  // Inherited
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize () const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+
+  /// \return remaining energy ratio of the sender
+  double GetEnergyRatio () const;
+  /// \return packets the sender can still buffer
+  uint16_t GetFreeSpace () const;
+
+  /// Size of a serialized beacon info header
+  static const uint32_t SERIALIZED_SIZE = 4;
+
+private:
+  uint16_t m_energy;    ///< Quantized remaining energy ratio
+  uint16_t m_freeSpace; ///< Free buffer space in packets
+};
+
 } //end namespace epidemic
 } //end namespace ns3
 #endif
@@ -0,0 +1,407 @@
+#include "epidemic-payload-codec.h"
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+#include <algorithm>
+
+
+/**
+ * \file
+ * \ingroup epidemic
+ * ns3::Epidemic::PayloadCodec, ns3::Epidemic::LzPayloadCodec and
+ * ns3::Epidemic::DownsamplePayloadCodec implementations.
+ */
+
+
+namespace ns3 {
+NS_LOG_COMPONENT_DEFINE ("EpidemicPayloadCodec");
+
+namespace Epidemic {
+
+/// Largest payload a codec restores, the IPv4 limit
+static const uint32_t MAX_PAYLOAD_SIZE = 65535;
+/// Shortest LZ match
+static const uint32_t LZ_MIN_MATCH = 4;
+/// Farthest LZ match, the 16 bit offset limit
+static const uint32_t LZ_MAX_OFFSET = 65535;
+/// log2 of the number of LZ hash table entries
+static const uint32_t LZ_HASH_BITS = 12;
+
+
+/// Append \p value to \p out as 32 bit little-endian
+static void
+WriteLe32 (std::vector<uint8_t> &out, uint32_t value)
+{
+  for (uint32_t i = 0; i < 4; ++i)
+    {
+      out.push_back ((value >> (8 * i)) & 0xff);
+    }
+}
+
+/// \return the 32 bit little-endian value at \p in
+static uint32_t
+ReadLe32 (const uint8_t *in)
+{
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+/// Append the LZ4 extra length bytes of \p length (which excludes the 15 of the nibble)
+static void
+WriteLzLength (std::vector<uint8_t> &out, uint32_t length)
+{
+  while (length >= 255)
+    {
+      out.push_back (255);
+      length -= 255;
+    }
+  out.push_back (length);
+}
+
+/**
+ * \brief Read LZ4 extra length bytes.
+ * \param in the encoded bytes.
+ * \param size the encoded size.
+ * \param pos the read position, advanced past the length bytes.
+ * \param length the length to add the extra bytes to.
+ * \return false if the length bytes are truncated.
+ */
+static bool
+ReadLzLength (const uint8_t *in, uint32_t size, uint32_t &pos, uint32_t &length)
+{
+  uint8_t byte;
+  do
+    {
+      if (pos >= size)
+        {
+          return false;
+        }
+      byte = in[pos++];
+      length += byte;
+    }
+  while (byte == 255);
+  return true;
+}
+
+/// Append one LZ4 sequence to \p out; \p matchLength 0 ends the block
+static void
+WriteLzSequence (std::vector<uint8_t> &out, const uint8_t *literals, uint32_t literalCount,
+                 uint32_t offset, uint32_t matchLength)
+{
+  uint32_t matchCode = matchLength == 0 ? 0 : matchLength - LZ_MIN_MATCH;
+  out.push_back ((std::min (literalCount, 15u) << 4) | std::min (matchCode, 15u));
+  if (literalCount >= 15)
+    {
+      WriteLzLength (out, literalCount - 15);
+    }
+  out.insert (out.end (), literals, literals + literalCount);
+  if (matchLength == 0)
+    {
+      return;
+    }
+  out.push_back (offset & 0xff);
+  out.push_back (offset >> 8);
+  if (matchCode >= 15)
+    {
+      WriteLzLength (out, matchCode - 15);
+    }
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (PayloadCodec);
+
+TypeId
+PayloadCodec::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::Epidemic::PayloadCodec")
+    .SetParent<Object> ()
+    .SetGroupName ("Epidemic");
+  return tid;
+}
+
+PayloadCodec::PayloadCodec ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+PayloadCodec::~PayloadCodec ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<Packet>
+PayloadCodec::Compress (Ptr<const Packet> packet, uint32_t offset) const
+{
+  NS_LOG_FUNCTION (this << packet << offset);
+  if (packet->GetSize () <= offset)
+    {
+      return 0;
+    }
+  std::vector<uint8_t> in (packet->GetSize ());
+  packet->CopyData (in.data (), in.size ());
+  uint32_t size = in.size () - offset;
+  std::vector<uint8_t> out;
+  if (!Encode (in.data () + offset, size, out) || out.size () >= size)
+    {
+      return 0;
+    }
+  return Rebuild (packet, offset, out);
+}
+
+Ptr<Packet>
+PayloadCodec::Decompress (Ptr<const Packet> packet, uint32_t offset) const
+{
+  NS_LOG_FUNCTION (this << packet << offset);
+  if (packet->GetSize () < offset)
+    {
+      return 0;
+    }
+  std::vector<uint8_t> in (packet->GetSize ());
+  packet->CopyData (in.data (), in.size ());
+  std::vector<uint8_t> out;
+  if (!Decode (in.data () + offset, in.size () - offset, out))
+    {
+      return 0;
+    }
+  return Rebuild (packet, offset, out);
+}
+
+Ptr<Packet>
+PayloadCodec::Rebuild (Ptr<const Packet> packet, uint32_t offset,
+                       const std::vector<uint8_t> &body)
+{
+  // A fragment keeps the packet tags, which flow monitors and
+  // applications rely on at the destination
+  Ptr<Packet> rebuilt = packet->CreateFragment (0, offset);
+  if (!body.empty ())
+    {
+      rebuilt->AddAtEnd (Create<Packet> (body.data (), body.size ()));
+    }
+  return rebuilt;
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (LzPayloadCodec);
+
+TypeId
+LzPayloadCodec::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::Epidemic::LzPayloadCodec")
+    .SetParent<PayloadCodec> ()
+    .SetGroupName ("Epidemic")
+    .AddConstructor<LzPayloadCodec> ();
+  return tid;
+}
+
+LzPayloadCodec::LzPayloadCodec ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LzPayloadCodec::~LzPayloadCodec ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+uint8_t
+LzPayloadCodec::GetCodecId () const
+{
+  return CODEC_ID;
+}
+
+bool
+LzPayloadCodec::IsLossless () const
+{
+  return true;
+}
+
+bool
+LzPayloadCodec::Encode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const
+{
+  NS_LOG_FUNCTION (this << size);
+  out.clear ();
+  out.reserve (size + size / 255 + 16);
+  WriteLe32 (out, size);
+  // Most recent position of each hashed 4 byte prefix
+  std::vector<int32_t> table (1u << LZ_HASH_BITS, -1);
+  uint32_t anchor = 0;
+  uint32_t i = 0;
+  while (i + LZ_MIN_MATCH <= size)
+    {
+      uint32_t prefix = ReadLe32 (in + i);
+      uint32_t hash = (prefix * 2654435761u) >> (32 - LZ_HASH_BITS);
+      int32_t candidate = table[hash];
+      table[hash] = i;
+      if (candidate < 0 || i - candidate > LZ_MAX_OFFSET
+          || ReadLe32 (in + candidate) != prefix)
+        {
+          ++i;
+          continue;
+        }
+      uint32_t length = LZ_MIN_MATCH;
+      while (i + length < size && in[candidate + length] == in[i + length])
+        {
+          ++length;
+        }
+      WriteLzSequence (out, in + anchor, i - anchor, i - candidate, length);
+      i += length;
+      anchor = i;
+    }
+  WriteLzSequence (out, in + anchor, size - anchor, 0, 0);
+  return true;
+}
+
+bool
+LzPayloadCodec::Decode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const
+{
+  NS_LOG_FUNCTION (this << size);
+  out.clear ();
+  if (size < 4)
+    {
+      return false;
+    }
+  uint32_t original = ReadLe32 (in);
+  if (original > MAX_PAYLOAD_SIZE)
+    {
+      return false;
+    }
+  out.reserve (original);
+  uint32_t pos = 4;
+  while (pos < size)
+    {
+      uint8_t token = in[pos++];
+      uint32_t literalCount = token >> 4;
+      if (literalCount == 15 && !ReadLzLength (in, size, pos, literalCount))
+        {
+          return false;
+        }
+      if (size - pos < literalCount || out.size () + literalCount > original)
+        {
+          return false;
+        }
+      out.insert (out.end (), in + pos, in + pos + literalCount);
+      pos += literalCount;
+      if (pos == size)
+        {
+          // The last sequence has no match
+          break;
+        }
+      if (size - pos < 2)
+        {
+          return false;
+        }
+      uint32_t offset = in[pos] | (in[pos + 1] << 8);
+      pos += 2;
+      uint32_t length = token & 0x0f;
+      if (length == 15 && !ReadLzLength (in, size, pos, length))
+        {
+          return false;
+        }
+      length += LZ_MIN_MATCH;
+      if (offset == 0 || offset > out.size () || out.size () + length > original)
+        {
+          return false;
+        }
+      // Byte by byte, a match may overlap the bytes it produces
+      uint32_t start = out.size () - offset;
+      for (uint32_t k = 0; k < length; ++k)
+        {
+          out.push_back (out[start + k]);
+        }
+    }
+  return out.size () == original;
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (DownsamplePayloadCodec);
+
+TypeId
+DownsamplePayloadCodec::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::Epidemic::DownsamplePayloadCodec")
+    .SetParent<PayloadCodec> ()
+    .SetGroupName ("Epidemic")
+    .AddConstructor<DownsamplePayloadCodec> ()
+    .AddAttribute ("SampleSize", "Size in bytes of a PCM sample.",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&DownsamplePayloadCodec::m_sampleSize),
+                   MakeUintegerChecker<uint32_t> (1, 8))
+    .AddAttribute ("Factor", "One sample out of Factor is sent.",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&DownsamplePayloadCodec::m_factor),
+                   MakeUintegerChecker<uint32_t> (2, 16));
+  return tid;
+}
+
+DownsamplePayloadCodec::DownsamplePayloadCodec ()
+  : m_sampleSize (2),
+    m_factor (2)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+DownsamplePayloadCodec::~DownsamplePayloadCodec ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+uint8_t
+DownsamplePayloadCodec::GetCodecId () const
+{
+  return CODEC_ID;
+}
+
+bool
+DownsamplePayloadCodec::IsLossless () const
+{
+  return false;
+}
+
+bool
+DownsamplePayloadCodec::Encode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const
+{
+  NS_LOG_FUNCTION (this << size);
+  out.clear ();
+  uint32_t samples = size / m_sampleSize;
+  if (samples < m_factor)
+    {
+      return false;
+    }
+  out.reserve (4 + (samples / m_factor + 1) * m_sampleSize);
+  WriteLe32 (out, size);
+  for (uint32_t s = 0; s < samples; s += m_factor)
+    {
+      const uint8_t *sample = in + s * m_sampleSize;
+      out.insert (out.end (), sample, sample + m_sampleSize);
+    }
+  return true;
+}
+
+bool
+DownsamplePayloadCodec::Decode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const
+{
+  NS_LOG_FUNCTION (this << size);
+  out.clear ();
+  if (size < 4 || (size - 4) % m_sampleSize != 0)
+    {
+      return false;
+    }
+  uint32_t original = ReadLe32 (in);
+  if (original > MAX_PAYLOAD_SIZE)
+    {
+      return false;
+    }
+  out.reserve (original);
+  for (uint32_t pos = 4; pos < size; pos += m_sampleSize)
+    {
+      // Sample and hold
+      for (uint32_t k = 0; k < m_factor && out.size () + m_sampleSize <= original; ++k)
+        {
+          out.insert (out.end (), in + pos, in + pos + m_sampleSize);
+        }
+    }
+  // Bytes of a trailing partial sample are not recoverable
+  out.resize (original, 0);
+  return true;
+}
+
+} //end namespace epidemic
+} //end namespace ns3
@@ -0,0 +1,175 @@
+#ifndef EPIDEMIC_PAYLOAD_CODEC_H
+#define EPIDEMIC_PAYLOAD_CODEC_H
+
+
+#include <vector>
+#include "ns3/object.h"
+#include "ns3/packet.h"
+
+
+/**
+ * \file
+ * \ingroup epidemic
+ * ns3::Epidemic::PayloadCodec, ns3::Epidemic::LzPayloadCodec and
+ * ns3::Epidemic::DownsamplePayloadCodec declarations.
+ */
+
+namespace ns3 {
+namespace Epidemic {
+
+/**
+ * \ingroup epidemic
+ * \brief Payload compression stage applied by the source of a packet.
+ *
+ * A codec rewrites the bytes of a packet that follow a given offset (the
+ * transport header is left alone) and keeps the packet tags, so the
+ * compressed packet is what is buffered, relayed and costed.  The codec
+ * ID is carried in the EpidemicHeader so that the destination restores
+ * the payload with the codec of the same ID before delivering it.
+ *
+ * Subclasses implement Encode () and Decode () on plain byte buffers.
+ */
+class PayloadCodec : public Object
+{
+public:
+  /**
+   *  \brief Get the registered TypeId for this class.
+   *  \return The object TypeId.
+   */
+  static TypeId GetTypeId (void);
+  PayloadCodec ();
+  virtual ~PayloadCodec ();
+
+  /**
+   * \return the ID carried in the EpidemicHeader of packets encoded by
+   *  this codec, never 0, which marks an uncompressed payload.
+   */
+  virtual uint8_t GetCodecId () const = 0;
+  /// \return true if Decode () restores the exact original bytes
+  virtual bool IsLossless () const = 0;
+
+  /**
+   * \brief Compress the payload of \p packet beyond \p offset.
+   * \param packet the packet to compress.
+   * \param offset number of leading bytes kept as they are.
+   * \return the compressed packet, or 0 if the codec cannot make the
+   *  payload smaller.
+   */
+  Ptr<Packet> Compress (Ptr<const Packet> packet, uint32_t offset) const;
+  /**
+   * \brief Restore a payload compressed by Compress ().
+   * \param packet the compressed packet.
+   * \param offset number of leading bytes kept as they are.
+   * \return the restored packet, or 0 if the payload is malformed.
+   */
+  Ptr<Packet> Decompress (Ptr<const Packet> packet, uint32_t offset) const;
+
+protected:
+  /**
+   * \brief Encode a payload.
+   * \param in the payload bytes.
+   * \param size the payload size.
+   * \param out receives the encoded bytes.
+   * \return false if the payload cannot be encoded.
+   */
+  virtual bool Encode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const = 0;
+  /**
+   * \brief Decode a payload.
+   * \param in the encoded bytes.
+   * \param size the encoded size.
+   * \param out receives the payload bytes.
+   * \return false if the encoded bytes are malformed.
+   */
+  virtual bool Decode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const = 0;
+
+private:
+  /**
+   * \brief Replace the bytes of \p packet beyond \p offset.
+   * \param packet the original packet, whose tags are kept.
+   * \param offset number of leading bytes kept.
+   * \param body the new bytes.
+   * \return the new packet.
+   */
+  static Ptr<Packet> Rebuild (Ptr<const Packet> packet, uint32_t offset,
+                              const std::vector<uint8_t> &body);
+};
+
+
+/**
+ * \ingroup epidemic
+ * \brief Lossless LZ77 codec for data payloads.
+ *
+ * Uses the LZ4 block format: sequences of a token byte (literal count and
+ * match length minus 4 in its two nibbles, 15 meaning more length bytes
+ * follow), the literals, and a 16 bit little-endian match offset.  The last
+ * sequence only has literals.  Matches are found through a hash table of
+ * 4 byte prefixes, one probe per position, which is fast enough for the
+ * per-packet path of a battery powered node.  The encoded payload starts
+ * with the original size as a 32 bit value.
+ */
+class LzPayloadCodec : public PayloadCodec
+{
+public:
+  /**
+   *  \brief Get the registered TypeId for this class.
+   *  \return The object TypeId.
+   */
+  static TypeId GetTypeId (void);
+  LzPayloadCodec ();
+  virtual ~LzPayloadCodec ();
+
+  /// Codec ID in the EpidemicHeader
+  static const uint8_t CODEC_ID = 1;
+
+  // Inherited
+  virtual uint8_t GetCodecId () const override;
+  virtual bool IsLossless () const override;
+
+protected:
+  // Inherited
+  virtual bool Encode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const override;
+  virtual bool Decode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const override;
+};
+
+
+/**
+ * \ingroup epidemic
+ * \brief Lossy down-sampling codec for PCM voice payloads.
+ *
+ * Keeps one sample out of Factor, and the destination repeats each sample
+ * Factor times, which halves the voice bandwidth at the default settings
+ * for the loss of the upper half of the audio band.  The encoded payload
+ * starts with the original size as a 32 bit value, so the restored packet
+ * has its original length.
+ */
+class DownsamplePayloadCodec : public PayloadCodec
+{
+public:
+  /**
+   *  \brief Get the registered TypeId for this class.
+   *  \return The object TypeId.
+   */
+  static TypeId GetTypeId (void);
+  DownsamplePayloadCodec ();
+  virtual ~DownsamplePayloadCodec ();
+
+  /// Codec ID in the EpidemicHeader
+  static const uint8_t CODEC_ID = 2;
+
+  // Inherited
+  virtual uint8_t GetCodecId () const override;
+  virtual bool IsLossless () const override;
+
+protected:
+  // Inherited
+  virtual bool Encode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const override;
+  virtual bool Decode (const uint8_t *in, uint32_t size, std::vector<uint8_t> &out) const override;
+
+private:
+  uint32_t m_sampleSize; ///< Bytes per PCM sample
+  uint32_t m_factor;     ///< One sample out of m_factor is kept
+};
+
+} //end namespace epidemic
+} //end namespace ns3
+#endif
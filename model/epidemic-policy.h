@@ -0,0 +1,272 @@
+#ifndef EPIDEMIC_POLICY_H
+#define EPIDEMIC_POLICY_H
+
+
+#include <algorithm>
+#include "epidemic-packet-queue.h"
+#include "epidemic-packet.h"
+#include "ns3/random-variable-stream.h"
+
+
+/**
+ * \file
+ * \ingroup epidemic
+ * Forwarding, energy budget and eviction policies of the epidemic module.
+ */
+
+namespace ns3 {
+namespace Epidemic {
+
+/**
+ * \ingroup epidemic
+ * \brief Energy state of a node seen by the forwarding policies.
+ *
+ * Filled by the protocol once per forwarding decision from its cached
+ * energy ratio and attributes, so that policies read plain values.
+ */
+struct ForwardingContext
+{
+  double m_energyRatio;        //!< Effective remaining energy ratio
+  double m_thresholdLow;       //!< Low energy threshold ratio
+  double m_thresholdCritical;  //!< Critical energy threshold ratio
+  double m_floodingFactor;     //!< Forwarding probability at low energy
+  uint8_t m_criticalClass;     //!< Lowest traffic class kept at critical energy
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Default forwarding policy.
+ *
+ * Forwards everything at normal energy, with probability FloodingFactor
+ * at low energy, and only CriticalTrafficClass and above at critical
+ * energy.
+ */
+struct EnergyAwareForwarding
+{
+  /**
+   * \param ctx the energy state of the node
+   * \param header the epidemic header of the packet
+   * \param rng the forwarding random variable
+   * \returns true if the packet is forwarded
+   */
+  static bool ShouldForward (const ForwardingContext &ctx, const EpidemicHeader &header,
+                             UniformRandomVariable &rng)
+  {
+    if (ctx.m_energyRatio <= ctx.m_thresholdCritical)
+      {
+        return header.GetTrafficClass () >= ctx.m_criticalClass;
+      }
+    if (ctx.m_energyRatio <= ctx.m_thresholdLow)
+      {
+        return rng.GetValue () < ctx.m_floodingFactor;
+      }
+    return true;
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Plain epidemic forwarding, whatever the energy left.
+ */
+struct FloodForwarding
+{
+  /// \copydoc EnergyAwareForwarding::ShouldForward
+  static bool ShouldForward (const ForwardingContext &ctx, const EpidemicHeader &header,
+                             UniformRandomVariable &rng)
+  {
+    return true;
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Forwarding probability falling with the energy left.
+ *
+ * Forwards everything above the low threshold, then with a probability
+ * proportional to the energy ratio, down to 0 when empty.  The critical
+ * classes are always forwarded while energy is left.
+ */
+struct ProportionalForwarding
+{
+  /// \copydoc EnergyAwareForwarding::ShouldForward
+  static bool ShouldForward (const ForwardingContext &ctx, const EpidemicHeader &header,
+                             UniformRandomVariable &rng)
+  {
+    if (ctx.m_energyRatio > ctx.m_thresholdLow)
+      {
+        return true;
+      }
+    if (header.GetTrafficClass () >= ctx.m_criticalClass)
+      {
+        return ctx.m_energyRatio > 0;
+      }
+    return rng.GetValue () * ctx.m_thresholdLow < std::max (ctx.m_energyRatio, 0.0);
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Default energy budget: a transmission may cost up to a tenth of
+ *  the remaining energy.
+ */
+struct FractionEnergyBudget
+{
+  /**
+   * \param cost the energy of the transmission in J
+   * \param remaining the remaining energy in J
+   * \param initial the initial energy in J
+   * \returns true if the transmission is allowed
+   */
+  static bool Allows (double cost, double remaining, double initial)
+  {
+    return cost <= remaining * 0.1;
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Energy budget keeping a tenth of the initial energy in reserve.
+ */
+struct ReserveEnergyBudget
+{
+  /// \copydoc FractionEnergyBudget::Allows
+  static bool Allows (double cost, double remaining, double initial)
+  {
+    return remaining - cost >= initial * 0.1;
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief No energy budget: every transmission is allowed.
+ */
+struct UnlimitedEnergyBudget
+{
+  /// \copydoc FractionEnergyBudget::Allows
+  static bool Allows (double cost, double remaining, double initial)
+  {
+    return true;
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Eviction policy of PacketQueue::DROP_OLDEST.
+ *
+ * Entries of equal rank are evicted oldest first, so a constant rank
+ * leaves the expire time alone to decide.
+ */
+struct OldestFirstEviction
+{
+  /**
+   * \param entry a queue entry
+   * \returns the eviction rank of \p entry, lowest evicted first
+   */
+  static int64_t Rank (const QueueEntry &entry)
+  {
+    return 0;
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Eviction policy of PacketQueue::DROP_LOWEST_PRIORITY.
+ */
+struct LowestPriorityEviction
+{
+  /// \copydoc OldestFirstEviction::Rank
+  static int64_t Rank (const QueueEntry &entry)
+  {
+    return entry.GetPriority ();
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Eviction policy of PacketQueue::DROP_LARGEST.
+ */
+struct LargestFirstEviction
+{
+  /// \copydoc OldestFirstEviction::Rank
+  static int64_t Rank (const QueueEntry &entry)
+  {
+    return -(int64_t) entry.GetSize ();
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief Eviction policy sparing the packets that can still travel far.
+ *
+ * Evicts the packets with the fewest hops left first: they have already
+ * spread the most and have the least to gain from another copy.
+ */
+struct FewestHopsLeftEviction
+{
+  /// \copydoc OldestFirstEviction::Rank
+  static int64_t Rank (const QueueEntry &entry)
+  {
+    return entry.GetHopCount ();
+  }
+};
+
+/**
+ * \ingroup epidemic
+ * \brief The per-packet decisions of an EnergyAwareRoutingProtocol.
+ *
+ * Policies are types with static functions; a PolicySet binds one of each
+ * kind, normally through MakePolicySet, and is handed to the protocol at
+ * install time.  The protocol then calls the bound functions directly,
+ * without virtual dispatch or attribute lookups.  A default constructed
+ * set is the protocol's historical behavior.
+ */
+struct PolicySet
+{
+  /// Forwarding decision, see EnergyAwareForwarding::ShouldForward
+  typedef bool (*ForwardingFunction) (const ForwardingContext &, const EpidemicHeader &,
+                                      UniformRandomVariable &);
+  /// Energy budget decision, see FractionEnergyBudget::Allows
+  typedef bool (*EnergyBudgetFunction) (double, double, double);
+
+  ForwardingFunction m_forward = &EnergyAwareForwarding::ShouldForward; //!< Forwarding policy
+  EnergyBudgetFunction m_energyBudget = &FractionEnergyBudget::Allows;  //!< Energy budget
+  /// Eviction policy, or 0 to follow the DropPolicy attribute
+  PacketQueue::EvictionRank m_evictionRank = 0;
+};
+
+/**
+ * \ingroup epidemic
+ * \tparam Forwarding the forwarding policy, e.g. FloodForwarding
+ * \tparam EnergyBudget the energy budget policy, e.g. ReserveEnergyBudget
+ * \returns the policy set, evicting according to the DropPolicy attribute
+ */
+template <class Forwarding, class EnergyBudget>
+PolicySet
+MakePolicySet ()
+{
+  PolicySet policies;
+  policies.m_forward = &Forwarding::ShouldForward;
+  policies.m_energyBudget = &EnergyBudget::Allows;
+  return policies;
+}
+
+/**
+ * \ingroup epidemic
+ * \tparam Forwarding the forwarding policy, e.g. FloodForwarding
+ * \tparam EnergyBudget the energy budget policy, e.g. ReserveEnergyBudget
+ * \tparam Eviction the eviction policy, e.g. FewestHopsLeftEviction
+ * \returns the policy set
+ */
+template <class Forwarding, class EnergyBudget, class Eviction>
+PolicySet
+MakePolicySet ()
+{
+  PolicySet policies = MakePolicySet<Forwarding, EnergyBudget> ();
+  policies.m_evictionRank = &Eviction::Rank;
+  return policies;
+}
+
+} //end namespace epidemic
+} //end namespace ns3
+
+#endif /* EPIDEMIC_POLICY_H */
@@ -9,7 +9,12 @@
 
 #include "ns3/energy-aware-epidemic-routing.h"
 #include "ns3/energy-aware-epidemic-helper.h"
+#include "ns3/epidemic-contact-table.h"
+#include "ns3/epidemic-duplicate-filter.h"
+#include "ns3/epidemic-payload-codec.h"
+#include "ns3/epidemic-policy.h"
 #include <vector>
+#include <algorithm>
 #include "ns3/ptr.h"
 #include "ns3/boolean.h"
 #include "ns3/test.h"
@@ -27,6 +32,8 @@
 #include "ns3/energy-module.h"
 #include "ns3/socket.h"
 #include "ns3/log.h"
+#include "ns3/output-stream-wrapper.h"
+#include <sstream>
 
 using namespace ns3;
 using namespace Epidemic;
@@ -83,6 +90,95 @@ EnergyAwareRoutingTestCase::DoRun (void)
   
   bool shouldForward = protocol->ShouldForwardPacket (header);
   NS_TEST_ASSERT_MSG_EQ (shouldForward, true, "Should forward packets with full energy");
+
+  // At critical energy only voice and higher classes are forwarded
+  Ptr<EnergyAwareRoutingProtocol> critical = CreateObject<EnergyAwareRoutingProtocol> ();
+  critical->SetAttribute ("EnergyThresholdLow", DoubleValue (1.0));
+  critical->SetAttribute ("EnergyThresholdCritical", DoubleValue (1.0));
+  critical->SetEnergySource (energySource);
+  header.SetTrafficClass (EpidemicHeader::BULK);
+  NS_TEST_ASSERT_MSG_EQ (critical->ShouldForwardPacket (header), false,
+                         "Bulk data should not be forwarded at critical energy");
+  header.SetTrafficClass (EpidemicHeader::VOICE);
+  NS_TEST_ASSERT_MSG_EQ (critical->ShouldForwardPacket (header), true,
+                         "Voice should be forwarded at critical energy");
+
+  // Policies replace the energy-aware decisions
+  critical->SetPolicies (MakePolicySet<FloodForwarding, UnlimitedEnergyBudget> ());
+  header.SetTrafficClass (EpidemicHeader::BULK);
+  NS_TEST_ASSERT_MSG_EQ (critical->ShouldForwardPacket (header), true,
+                         "Flooding should forward bulk data at critical energy");
+  critical->SetPolicies (PolicySet ());
+  NS_TEST_ASSERT_MSG_EQ (critical->ShouldForwardPacket (header), false,
+                         "Default policies should be restored");
+
+  // The traffic class survives serialization
+  Ptr<Packet> packet = Create<Packet> ();
+  header.SetTrafficClass (EpidemicHeader::ALERT);
+  packet->AddHeader (header);
+  EpidemicHeader received;
+  packet->RemoveHeader (received);
+  NS_TEST_ASSERT_MSG_EQ (received.GetTrafficClass (), EpidemicHeader::ALERT,
+                         "Traffic class should be carried in the header");
+  NS_TEST_ASSERT_MSG_EQ (EpidemicHeader::ClassifyDscp (Ipv4Header::DSCP_EF),
+                         EpidemicHeader::VOICE, "EF should be classified as voice");
+
+  // Spray-and-wait copy budget
+  NS_TEST_ASSERT_MSG_EQ (received.GetCopies (), 0, "Epidemic packets should have no copy limit");
+  header.SetCopies (5);
+  packet->AddHeader (header);
+  packet->RemoveHeader (received);
+  NS_TEST_ASSERT_MSG_EQ (received.GetCopies (), 5, "Copies should be carried in the header");
+
+  // Fast-path peek of the leading fields
+  header.SetPacketID (0x0a000102);
+  header.SetHopCount (300);
+  header.SetTimeStamp (NanoSeconds (0x123456789aLL));
+  packet->AddHeader (header);
+  EpidemicHeader::Fields fields;
+  NS_TEST_ASSERT_MSG_EQ (EpidemicHeader::PeekFields (packet, fields), true, "Fields should be peeked");
+  NS_TEST_ASSERT_MSG_EQ (fields.m_packetID, 0x0a000102, "Peeked packet ID");
+  NS_TEST_ASSERT_MSG_EQ (fields.m_hopCount, 300, "Peeked hop count");
+  NS_TEST_ASSERT_MSG_EQ (fields.m_timeStamp, NanoSeconds (0x123456789aLL), "Peeked time stamp");
+  NS_TEST_ASSERT_MSG_EQ (packet->GetSize (), header.GetSerializedSize (), "Peeking leaves the packet alone");
+  NS_TEST_ASSERT_MSG_EQ (EpidemicHeader::PeekFields (Create<Packet> (EpidemicHeader::FIELDS_SIZE - 1), fields),
+                         false, "Short packets have no fields");
+  NS_TEST_ASSERT_MSG_EQ (fields.m_custody, false, "Copies carry no custody mark");
+  packet->RemoveHeader (received);
+
+  // The custody mark leaves the traffic class alone
+  header.SetCustody (true);
+  packet->AddHeader (header);
+  NS_TEST_ASSERT_MSG_EQ (EpidemicHeader::PeekFields (packet, fields), true, "Fields should be peeked");
+  NS_TEST_ASSERT_MSG_EQ (fields.m_custody, true, "Peeked custody mark");
+  packet->RemoveHeader (received);
+  NS_TEST_ASSERT_MSG_EQ (received.IsCustody (), true, "Custody should be carried in the header");
+  NS_TEST_ASSERT_MSG_EQ (received.GetTrafficClass (), EpidemicHeader::ALERT,
+                         "Traffic class should survive the custody mark");
+  header.SetCustody (false);
+  NS_TEST_ASSERT_MSG_EQ (protocol->GetInitialCopies (), 0, "Epidemic mode should not limit copies");
+  protocol->SetAttribute ("ForwardingMode", StringValue ("SprayAndWait"));
+  protocol->SetAttribute ("SprayCopies", UintegerValue (6));
+  NS_TEST_ASSERT_MSG_EQ (protocol->GetInitialCopies (), 6, "Full energy should get all copies");
+
+  // Without radio energy model and device: 0.0174 A at 3 V, 1 Mbps, 500 us per frame
+  NS_TEST_ASSERT_MSG_EQ_TOL (protocol->CalculateTransmissionCost (125), 3 * 0.0174 * 1.5e-3, 1e-9,
+                             "Cost should be the airtime of bytes and frame overhead");
+  NS_TEST_ASSERT_MSG_EQ_TOL (protocol->CalculateTransmissionCost (125, 0), 3 * 0.0174 * 1e-3, 1e-9,
+                             "Bytes in a bundle should not pay the frame overhead");
+
+  // Beacons advertise the energy and buffer room of their sender
+  packet->AddHeader (BeaconInfoHeader (0.5, 100000));
+  NS_TEST_ASSERT_MSG_EQ (packet->GetSize (), BeaconInfoHeader::SERIALIZED_SIZE, "Beacon info size");
+  BeaconInfoHeader info;
+  packet->RemoveHeader (info);
+  NS_TEST_ASSERT_MSG_EQ_TOL (info.GetEnergyRatio (), 0.5, 1e-4, "Energy ratio should be carried");
+  NS_TEST_ASSERT_MSG_EQ (info.GetFreeSpace (), 65535, "Free space should saturate");
+  NS_TEST_ASSERT_MSG_EQ (protocol->GetCustodySpace (Ipv4Address ("10.0.0.2")), 0,
+                         "Custody transfer should be off by default");
+
+  // Beacon jitter and forwarding decisions use their own streams
+  NS_TEST_ASSERT_MSG_EQ (protocol->AssignStreams (7), 2, "Two random streams should be assigned");
 }
 
 
@@ -146,8 +242,1193 @@ EnergyAwareHelperTestCase::DoRun (void)
   // Verify the protocol is properly configured
   double energyRatio = energyProtocol->GetRemainingEnergyRatio ();
   NS_TEST_ASSERT_MSG_EQ (energyRatio, 1.0, "Default energy ratio should be 1.0");
-  
+  DoubleValue threshold;
+  energyProtocol->GetAttribute ("EnergyThresholdLow", threshold);
+  NS_TEST_ASSERT_MSG_EQ_TOL (threshold.Get (), 0.25, 1e-9, "Factory should set the low threshold");
+
+  // Bulk install binds each node to its own source
+  NodeContainer batch;
+  batch.Create (3);
+  energy::EnergySourceContainer sources = helper.InstallWithEnergy (batch);
+  NS_TEST_ASSERT_MSG_EQ (sources.GetN (), 3, "One source per node");
+  for (uint32_t i = 0; i < batch.GetN (); ++i)
+    {
+      Ptr<EnergyAwareRoutingProtocol> agent = batch.Get (i)->GetObject<EnergyAwareRoutingProtocol> ();
+      NS_TEST_ASSERT_MSG_NE (agent, nullptr, "Protocol should be aggregated to the node");
+      NS_TEST_ASSERT_MSG_EQ (sources.Get (i)->GetNode (), batch.Get (i), "Source of another node");
+      agent->GetAttribute ("EnergyThresholdCritical", threshold);
+      NS_TEST_ASSERT_MSG_EQ_TOL (threshold.Get (), 0.1, 1e-9, "Factory should set the critical threshold");
+    }
+
+  // The internet stack installed afterwards routes with the same agents
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (helper);
+  internet.Install (batch);
+  for (uint32_t i = 0; i < batch.GetN (); ++i)
+    {
+      NS_TEST_ASSERT_MSG_EQ (batch.Get (i)->GetObject<Ipv4> ()->GetRoutingProtocol (),
+                             batch.Get (i)->GetObject<EnergyAwareRoutingProtocol> (),
+                             "Bulk installed agent should route for its node");
+    }
+
+  // Nodes with an internet stack get their agent as routing protocol at once
+  NodeContainer stacked;
+  stacked.Create (2);
+  InternetStackHelper plainInternet;
+  plainInternet.Install (stacked);
+  sources = helper.InstallWithEnergy (stacked);
+  for (uint32_t i = 0; i < stacked.GetN (); ++i)
+    {
+      Ptr<EnergyAwareRoutingProtocol> agent = stacked.Get (i)->GetObject<EnergyAwareRoutingProtocol> ();
+      NS_TEST_ASSERT_MSG_EQ (stacked.Get (i)->GetObject<Ipv4> ()->GetRoutingProtocol (), agent,
+                             "Agent should be the routing protocol of the node");
+      NS_TEST_ASSERT_MSG_EQ (agent->GetRemainingEnergyRatio (), 1.0, "Agent should be bound to its source");
+    }
+
   delete helperCopy;
+  Simulator::Destroy ();
+}
+
+
+
+class SummaryVectorTestCase : public TestCase
+{
+public:
+  SummaryVectorTestCase ();
+  virtual ~SummaryVectorTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SummaryVectorTestCase::SummaryVectorTestCase ()
+  : TestCase ("Verifying summary vector ordering and disjoint packet lookup")
+{
+}
+
+SummaryVectorTestCase::~SummaryVectorTestCase ()
+{
+}
+
+void
+SummaryVectorTestCase::DoRun (void)
+{
+  // Out-of-order and duplicate IDs are kept sorted and unique
+  SummaryVectorHeader sv;
+  sv.Add (30);
+  sv.Add (10);
+  sv.Add (20);
+  sv.Add (10);
+  NS_TEST_ASSERT_MSG_EQ (sv.Size (), 3, "Duplicate IDs should be ignored");
+  NS_TEST_ASSERT_MSG_EQ (*sv.Begin (), 10, "IDs should be sorted");
+  NS_TEST_ASSERT_MSG_EQ (sv.Contains (20), true, "ID 20 should be found");
+  NS_TEST_ASSERT_MSG_EQ (sv.Contains (25), false, "ID 25 should not be found");
+
+  // Serialization round trip
+  Ptr<Packet> p = Create<Packet> ();
+  p->AddHeader (sv);
+  SummaryVectorHeader received;
+  p->RemoveHeader (received);
+  NS_TEST_ASSERT_MSG_EQ (received.Size (), 3, "Size should survive serialization");
+  NS_TEST_ASSERT_MSG_EQ (received.Contains (30), true, "ID 30 should survive serialization");
+
+  // Compact encoding collapses consecutive IDs into runs
+  SummaryVectorHeader run (0, SummaryVectorHeader::COMPACT);
+  for (uint32_t id = 0x0a010000; id < 0x0a010040; ++id)
+    {
+      run.Add (id);
+    }
+  run.Add (0x0a020005);
+  NS_TEST_ASSERT_MSG_LT (run.GetSerializedSize (), 16, "Two runs should fit in a few bytes");
+  Ptr<Packet> compact = Create<Packet> ();
+  compact->AddHeader (run);
+  SummaryVectorHeader decoded (0, SummaryVectorHeader::COMPACT);
+  compact->RemoveHeader (decoded);
+  NS_TEST_ASSERT_MSG_EQ (decoded.Size (), 65, "Compact size should survive serialization");
+  NS_TEST_ASSERT_MSG_EQ (decoded.Contains (0x0a01003f), true, "End of run should survive serialization");
+  NS_TEST_ASSERT_MSG_EQ (decoded.Contains (0x0a020005), true, "Single ID should survive serialization");
+  NS_TEST_ASSERT_MSG_EQ (decoded.Contains (0x0a020004), false, "Gap should survive serialization");
+
+  // Lengths and run counts from the wire are capped by the bytes received
+  const uint8_t plainBytes[] = { 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 1, 0, 0, 0, 2 };
+  Ptr<Packet> forged = Create<Packet> (plainBytes, sizeof (plainBytes));
+  forged->RemoveHeader (received);
+  NS_TEST_ASSERT_MSG_EQ (received.Size (), 2, "Plain length should be capped by the packet size");
+  const uint8_t compactBytes[] = { 0xff, 0xff, 0xff, 0xff, 0x0f, 0, 0xff, 0xff, 0xff, 0xff, 0x07 };
+  forged = Create<Packet> (compactBytes, sizeof (compactBytes));
+  forged->RemoveHeader (decoded);
+  NS_TEST_ASSERT_MSG_EQ (decoded.Size (), SummaryVectorHeader::MAX_EXPANDED_IDS,
+                         "Runs should expand to a bounded number of IDs");
+  forged = Create<Packet> ();
+  forged->RemoveHeader (decoded);
+  NS_TEST_ASSERT_MSG_EQ (decoded.Size (), 0, "An empty compact body should decode to no IDs");
+  // The second run ends inside its length varint
+  const uint8_t truncatedBytes[] = { 0x03, 0x05, 0x01, 0x01, 0x80, 0x80 };
+  forged = Create<Packet> (truncatedBytes, sizeof (truncatedBytes));
+  forged->RemoveHeader (decoded);
+  NS_TEST_ASSERT_MSG_EQ (decoded.Size (), 2, "Only the complete run should be decoded");
+  NS_TEST_ASSERT_MSG_EQ (decoded.Contains (6), true, "ID 6 is in the complete run");
+  // A run ending at the last ID, then a gap past it
+  const uint8_t wrappingBytes[] = { 0x02, 0xff, 0xff, 0xff, 0xff, 0x0f, 0x00, 0x05, 0x00 };
+  forged = Create<Packet> (wrappingBytes, sizeof (wrappingBytes));
+  forged->RemoveHeader (decoded);
+  NS_TEST_ASSERT_MSG_EQ (decoded.Size (), 1, "IDs should not wrap around");
+  NS_TEST_ASSERT_MSG_EQ (decoded.Contains (0xffffffff), true, "The last ID should be decoded");
+  NS_TEST_ASSERT_MSG_EQ (decoded.Contains (4), false, "No ID past the last one");
+
+  // Disjoint packets between a buffer and a received summary vector
+  PacketQueue queue (10);
+  for (uint32_t id = 5; id <= 35; id += 5)
+    {
+      QueueEntry entry (Create<Packet> (10), Ipv4Header (),
+                        QueueEntry::UnicastForwardCallback (),
+                        QueueEntry::ErrorCallback (),
+                        Simulator::Now () + Seconds (10), id);
+      queue.Enqueue (std::move (entry));
+    }
+  SummaryVectorHeader disjoint = queue.FindDisjointPackets (received);
+  NS_TEST_ASSERT_MSG_EQ (disjoint.Size (), 4, "IDs 5, 15, 25 and 35 are missing at the peer");
+  NS_TEST_ASSERT_MSG_EQ (disjoint.Contains (10), false, "ID 10 is known to the peer");
+  NS_TEST_ASSERT_MSG_EQ (disjoint.Contains (35), true, "ID 35 is unknown to the peer");
+}
+
+
+
+class PacketQueueTestCase : public TestCase
+{
+public:
+  PacketQueueTestCase ();
+  virtual ~PacketQueueTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Enqueue a packet of \p size bytes expiring after \p lifetime
+  bool Add (PacketQueue &queue, uint32_t id, uint32_t size, Time lifetime,
+            uint8_t priority = 0);
+  /// Drop callback of the queue under test
+  void Dropped (const QueueEntry &entry, PacketQueue::DropReason reason);
+  /// Drop reasons reported, in order
+  std::vector<PacketQueue::DropReason> m_drops;
+};
+
+PacketQueueTestCase::PacketQueueTestCase ()
+  : TestCase ("Verifying packet queue expiry and drop policies")
+{
+}
+
+PacketQueueTestCase::~PacketQueueTestCase ()
+{
+}
+
+bool
+PacketQueueTestCase::Add (PacketQueue &queue, uint32_t id, uint32_t size,
+                          Time lifetime, uint8_t priority)
+{
+  QueueEntry entry (Create<Packet> (size), Ipv4Header (),
+                    QueueEntry::UnicastForwardCallback (),
+                    QueueEntry::ErrorCallback (),
+                    Simulator::Now () + lifetime, id);
+  entry.SetPriority (priority);
+  return queue.Enqueue (std::move (entry));
+}
+
+void
+PacketQueueTestCase::Dropped (const QueueEntry &entry, PacketQueue::DropReason reason)
+{
+  m_drops.push_back (reason);
+}
+
+void
+PacketQueueTestCase::DoRun (void)
+{
+  // Oldest entry is evicted first
+  PacketQueue oldest (2);
+  Add (oldest, 1, 10, Seconds (30));
+  Add (oldest, 2, 10, Seconds (10));
+  Add (oldest, 3, 10, Seconds (20));
+  NS_TEST_ASSERT_MSG_EQ (oldest.GetSize (), 2, "Queue should be bounded");
+  NS_TEST_ASSERT_MSG_EQ (oldest.Find (2) == 0, true, "Earliest expiring entry should be evicted");
+
+  // Expired entries are removed before anything else
+  NS_TEST_ASSERT_MSG_EQ (Add (oldest, 4, 10, Seconds (-1)), false, "Expired entry should not be kept");
+  NS_TEST_ASSERT_MSG_EQ (oldest.GetSize (), 2, "Expired entry should be dropped");
+  NS_TEST_ASSERT_MSG_EQ (oldest.GetNextExpireTime (), Seconds (20), "Earliest expire time");
+  NS_TEST_ASSERT_MSG_EQ (PacketQueue ().GetNextExpireTime (), Time::Max (),
+                         "Empty queue should never expire");
+
+  // Entries hold the payload and the parsed EpidemicHeader apart
+  EpidemicHeader epidemic;
+  epidemic.SetPacketID (7);
+  epidemic.SetHopCount (3);
+  QueueEntry stored (Create<Packet> (100), Ipv4Header (), QueueEntry::UnicastForwardCallback (),
+                     QueueEntry::ErrorCallback (), Seconds (10), 7);
+  stored.SetEpidemicHeader (epidemic);
+  stored.SetHopCount (2);
+  Ptr<Packet> sent = stored.GetPacketWithHeader ();
+  NS_TEST_ASSERT_MSG_EQ (sent->GetSize (), stored.GetSize (), "Sent size should include the header");
+  NS_TEST_ASSERT_MSG_EQ (stored.GetPacket ()->GetSize (), 100, "Buffered payload should be unchanged");
+  EpidemicHeader::Fields sentFields;
+  EpidemicHeader::PeekFields (sent, sentFields);
+  NS_TEST_ASSERT_MSG_EQ (sentFields.m_packetID, 7, "Header should be prepended");
+  NS_TEST_ASSERT_MSG_EQ (sentFields.m_hopCount, 2, "Rewritten hop count should be sent");
+
+  // Lowest priority entry is evicted first, whatever its age
+  PacketQueue priority (2);
+  priority.SetDropPolicy (PacketQueue::DROP_LOWEST_PRIORITY);
+  Add (priority, 1, 10, Seconds (10), 2);
+  Add (priority, 2, 10, Seconds (30), 0);
+  Add (priority, 3, 10, Seconds (20), 1);
+  NS_TEST_ASSERT_MSG_EQ (priority.Find (2) == 0, true, "Lowest priority entry should be evicted");
+  NS_TEST_ASSERT_MSG_EQ (priority.Find (1) != 0, true, "Highest priority entry should be kept");
+
+  // Largest entry is evicted first
+  PacketQueue largest (2);
+  largest.SetDropPolicy (PacketQueue::DROP_LARGEST);
+  Add (largest, 1, 100, Seconds (10));
+  Add (largest, 2, 1000, Seconds (30));
+  Add (largest, 3, 10, Seconds (20));
+  NS_TEST_ASSERT_MSG_EQ (largest.Find (2) == 0, true, "Largest entry should be evicted");
+  NS_TEST_ASSERT_MSG_EQ (largest.GetSize (), 2, "Queue should be bounded");
+
+  // A custom eviction policy reorders the buffered entries
+  largest.SetEvictionRank (&OldestFirstEviction::Rank);
+  Add (largest, 4, 10, Seconds (40));
+  NS_TEST_ASSERT_MSG_EQ (largest.Find (1) == 0, true, "Oldest entry should be evicted");
+  NS_TEST_ASSERT_MSG_EQ (largest.Find (3) != 0, true, "Younger entry should be kept");
+
+  // Entries are partitioned by priority and lower classes can be shed
+  PacketQueue classes (10);
+  Add (classes, 1, 10, Seconds (10), 0);
+  Add (classes, 2, 10, Seconds (10), 1);
+  Add (classes, 3, 10, Seconds (10), 0);
+  Add (classes, 4, 10, Seconds (10), 2);
+  NS_TEST_ASSERT_MSG_EQ (classes.GetSize (0), 2, "Two entries of priority 0");
+  NS_TEST_ASSERT_MSG_EQ (classes.DropPriorityBelow (1), 2, "Priority 0 entries should be dropped");
+  NS_TEST_ASSERT_MSG_EQ (classes.GetSize (0), 0, "No entry of priority 0 left");
+  NS_TEST_ASSERT_MSG_EQ (classes.GetSize (), 2, "Higher priorities should be kept");
+
+  // Shrinking evicts the lowest priority, oldest entries first
+  PacketQueue shrink (4);
+  Add (shrink, 1, 10, Seconds (30), 1);
+  Add (shrink, 2, 10, Seconds (20), 0);
+  Add (shrink, 3, 10, Seconds (10), 1);
+  Add (shrink, 4, 10, Seconds (10), 2);
+  shrink.SetDropCallback (MakeCallback (&PacketQueueTestCase::Dropped, this));
+  NS_TEST_ASSERT_MSG_EQ (shrink.Shrink (2), 2, "Two entries should be evicted");
+  NS_TEST_ASSERT_MSG_EQ (shrink.Find (2) == 0, true, "Lowest priority entry should be evicted");
+  NS_TEST_ASSERT_MSG_EQ (shrink.Find (3) == 0, true, "Oldest entry of the next priority should be evicted");
+  NS_TEST_ASSERT_MSG_EQ (shrink.GetMaxQueueLen (), 2, "Capacity should be reduced");
+
+  // Delivered packets are removed by ID
+  NS_TEST_ASSERT_MSG_EQ (shrink.Remove (1), true, "Buffered entry should be removed");
+  NS_TEST_ASSERT_MSG_EQ (shrink.Remove (1), false, "Removed entry should be gone");
+  NS_TEST_ASSERT_MSG_EQ (shrink.GetSize (1), 0, "Class sizes should follow removals");
+
+  // Each drop is reported once with its reason
+  NS_TEST_ASSERT_MSG_EQ (m_drops.size (), 3, "Three drops should be reported");
+  NS_TEST_ASSERT_MSG_EQ (m_drops[0], PacketQueue::DROP_SHRUNK, "Shrinking drops first");
+  NS_TEST_ASSERT_MSG_EQ (m_drops[1], PacketQueue::DROP_SHRUNK, "Shrinking drops second");
+  NS_TEST_ASSERT_MSG_EQ (m_drops[2], PacketQueue::DROP_DELIVERED, "Delivered packet drop last");
+
+  // Packets handed over to a custodian are dropped with their own reason
+  NS_TEST_ASSERT_MSG_EQ (shrink.Remove (4, PacketQueue::DROP_HANDED_OFF), true,
+                         "Handed off entry should be removed");
+  NS_TEST_ASSERT_MSG_EQ (m_drops.back (), PacketQueue::DROP_HANDED_OFF, "Handoff drop reason");
+  NS_TEST_ASSERT_MSG_EQ (shrink.GetSize (), 0, "Buffer should be empty");
+
+  // Spraying rewrites the header of a full queue in place
+  PacketQueue spray (2);
+  Add (spray, 1, 10, Seconds (10), 0);
+  Add (spray, 2, 10, Seconds (20), 0);
+  const QueueEntry *sprayed = spray.Find (1);
+  EpidemicHeader header = sprayed->GetEpidemicHeader ();
+  header.SetCopies (4);
+  NS_TEST_ASSERT_MSG_EQ (spray.SetEpidemicHeader (1, header), true, "Buffered header should be rewritten");
+  NS_TEST_ASSERT_MSG_EQ (spray.Find (1) == sprayed, true, "Entry should stay in its slot");
+  NS_TEST_ASSERT_MSG_EQ (sprayed->GetEpidemicHeader ().GetCopies (), 4, "Rewritten copy budget");
+  NS_TEST_ASSERT_MSG_EQ (spray.GetSize (), 2, "Nothing should be evicted");
+  NS_TEST_ASSERT_MSG_EQ (spray.SetEpidemicHeader (3, header), false, "Unknown ID");
+
+  // The packet ID table grows and keeps every probe chain across removals
+  PacketQueue table (200);
+  for (uint32_t i = 0; i < 100; ++i)
+    {
+      Add (table, ((i % 8) << 16) | (i / 8), 10, Seconds (100 - i % 50), i % 4);
+    }
+  for (uint32_t i = 0; i < 100; i += 2)
+    {
+      table.Remove (((i % 8) << 16) | (i / 8));
+    }
+  uint32_t found = 0;
+  for (uint32_t i = 0; i < 100; ++i)
+    {
+      found += table.Find (((i % 8) << 16) | (i / 8)) != 0;
+    }
+  NS_TEST_ASSERT_MSG_EQ (found, 50, "Only the removed IDs should be gone");
+  SummaryVectorHeader ids = table.GetSummaryVector ();
+  NS_TEST_ASSERT_MSG_EQ (ids.Size (), 50, "Summary vector of the remaining IDs");
+  NS_TEST_ASSERT_MSG_EQ (ids.Contains (1 << 16), true, "Odd IDs should be listed");
+  NS_TEST_ASSERT_MSG_EQ (ids.Contains (0), false, "Removed IDs should not be listed");
+  NS_TEST_ASSERT_MSG_EQ (table.Shrink (10), 40, "Shrinking should evict down to the new length");
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (3), 10, "Highest priority entries should be kept");
+}
+
+
+
+class EnergyStateTestCase : public TestCase
+{
+public:
+  EnergyStateTestCase ();
+  virtual ~EnergyStateTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// EnergyStateChanged trace sink
+  void StateChanged (EnergyAwareRoutingProtocol::EnergyState oldState,
+                     EnergyAwareRoutingProtocol::EnergyState newState, double ratio);
+  /// Energy states reported by the trace, in order
+  std::vector<EnergyAwareRoutingProtocol::EnergyState> m_states;
+};
+
+EnergyStateTestCase::EnergyStateTestCase ()
+  : TestCase ("Verifying cached energy ratio and energy state notifications")
+{
+}
+
+EnergyStateTestCase::~EnergyStateTestCase ()
+{
+}
+
+void
+EnergyStateTestCase::StateChanged (EnergyAwareRoutingProtocol::EnergyState oldState,
+                                   EnergyAwareRoutingProtocol::EnergyState newState,
+                                   double ratio)
+{
+  m_states.push_back (newState);
+}
+
+void
+EnergyStateTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<energy::BasicEnergySource> energySource = CreateObject<energy::BasicEnergySource> ();
+  energySource->SetNode (node);
+  energySource->SetSupplyVoltage (1.0);
+  energySource->SetInitialEnergy (10.0);
+  energySource->Initialize ();
+
+  // Drain 1 J per second
+  Ptr<energy::SimpleDeviceEnergyModel> model = CreateObject<energy::SimpleDeviceEnergyModel> ();
+  model->SetNode (node);
+  model->SetEnergySource (energySource);
+  energySource->AppendDeviceEnergyModel (model);
+  model->SetCurrentA (1.0);
+
+  Ptr<EnergyAwareRoutingProtocol> protocol = CreateObject<EnergyAwareRoutingProtocol> ();
+  protocol->SetAttribute ("EnergyThresholdLow", DoubleValue (0.3));
+  protocol->SetAttribute ("EnergyThresholdCritical", DoubleValue (0.15));
+  protocol->SetEnergySource (energySource);
+  protocol->TraceConnectWithoutContext ("EnergyStateChanged",
+                                        MakeCallback (&EnergyStateTestCase::StateChanged, this));
+
+  Simulator::Stop (Seconds (9.5));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_states.size (), 2, "Both thresholds should be reported once");
+  NS_TEST_ASSERT_MSG_EQ (m_states[0], EnergyAwareRoutingProtocol::ENERGY_LOW, "Low threshold first");
+  NS_TEST_ASSERT_MSG_EQ (m_states[1], EnergyAwareRoutingProtocol::ENERGY_CRITICAL, "Critical threshold next");
+  NS_TEST_ASSERT_MSG_EQ (protocol->GetEnergyState (), EnergyAwareRoutingProtocol::ENERGY_CRITICAL,
+                         "State should follow the energy source");
+  // The ratio is the one of the last energy source update, at 9 s
+  NS_TEST_ASSERT_MSG_EQ_TOL (protocol->GetRemainingEnergyRatio (), 0.1, 1e-6,
+                             "Ratio should be cached from the last energy update");
+
+  // One-line snapshots of the same state
+  std::ostringstream csv;
+  protocol->SetAttribute ("RoutingTableFormat", StringValue ("Csv"));
+  protocol->PrintRoutingTable (Create<OutputStreamWrapper> (&csv), Time::S);
+  NS_TEST_ASSERT_MSG_EQ (csv.str ().compare (0, 8, "R,9.5,0,"), 0, "Snapshot should start with time and node");
+  NS_TEST_ASSERT_MSG_NE (csv.str ().find (",1,0.1000,0.1000,2,"), std::string::npos,
+                         "Snapshot should carry energy and state");
+  NS_TEST_ASSERT_MSG_EQ (csv.str ().find ('\n'), csv.str ().size () - 1, "Snapshot should be one line");
+  std::ostringstream json;
+  protocol->SetAttribute ("RoutingTableFormat", StringValue ("Json"));
+  protocol->PrintRoutingTable (Create<OutputStreamWrapper> (&json), Time::S);
+  NS_TEST_ASSERT_MSG_EQ (json.str ().compare (0, 12, "{\"time\":9.5,"), 0, "JSON snapshot should start with time");
+  NS_TEST_ASSERT_MSG_NE (json.str ().find ("\"energy_ratio\":0.1000,"), std::string::npos,
+                         "JSON snapshot should carry the energy ratio");
+
+  Simulator::Destroy ();
+}
+
+
+
+class EnergyHarvestingTestCase : public TestCase
+{
+public:
+  EnergyHarvestingTestCase ();
+  virtual ~EnergyHarvestingTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Stop the drain and connect a harvester to \p source
+  void StartHarvesting (Ptr<energy::EnergySource> source, Ptr<energy::SimpleDeviceEnergyModel> model);
+  /// EnergyDepleted trace sink
+  void Depleted ();
+  /// EnergyRecharged trace sink
+  void Recharged ();
+  uint32_t m_depletions; ///< Depletions reported
+  uint32_t m_recharges;  ///< Recharges reported
+};
+
+EnergyHarvestingTestCase::EnergyHarvestingTestCase ()
+  : TestCase ("Verifying depletion, recharge and harvest-credited energy ratio"),
+    m_depletions (0),
+    m_recharges (0)
+{
+}
+
+EnergyHarvestingTestCase::~EnergyHarvestingTestCase ()
+{
+}
+
+void
+EnergyHarvestingTestCase::StartHarvesting (Ptr<energy::EnergySource> source,
+                                           Ptr<energy::SimpleDeviceEnergyModel> model)
+{
+  model->SetCurrentA (0.0);
+  BasicEnergyHarvesterHelper harvesterHelper;
+  harvesterHelper.Set ("PeriodicHarvestedPowerUpdateInterval", TimeValue (Seconds (1)));
+  harvesterHelper.Set ("HarvestablePower", StringValue ("ns3::ConstantRandomVariable[Constant=1.5]"));
+  energy::EnergyHarvesterContainer harvesters = harvesterHelper.Install (source);
+  harvesters.Get (0)->Initialize ();
+}
+
+void
+EnergyHarvestingTestCase::Depleted ()
+{
+  ++m_depletions;
+}
+
+void
+EnergyHarvestingTestCase::Recharged ()
+{
+  ++m_recharges;
+}
+
+void
+EnergyHarvestingTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<energy::BasicEnergySource> energySource = CreateObject<energy::BasicEnergySource> ();
+  energySource->SetNode (node);
+  energySource->SetSupplyVoltage (1.0);
+  energySource->SetInitialEnergy (10.0);
+  energySource->Initialize ();
+
+  // Drain 1 J per second down to 0.5 J, then harvest 1.5 W
+  Ptr<energy::SimpleDeviceEnergyModel> model = CreateObject<energy::SimpleDeviceEnergyModel> ();
+  model->SetNode (node);
+  model->SetEnergySource (energySource);
+  energySource->AppendDeviceEnergyModel (model);
+  model->SetCurrentA (1.0);
+  Simulator::Schedule (Seconds (9.5), &EnergyHarvestingTestCase::StartHarvesting, this,
+                       energySource, model);
+
+  Ptr<EnergyAwareRoutingProtocol> protocol = CreateObject<EnergyAwareRoutingProtocol> ();
+  protocol->SetEnergySource (energySource);
+  protocol->TraceConnectWithoutContext ("EnergyDepleted",
+                                        MakeCallback (&EnergyHarvestingTestCase::Depleted, this));
+  protocol->TraceConnectWithoutContext ("EnergyRecharged",
+                                        MakeCallback (&EnergyHarvestingTestCase::Recharged, this));
+
+  Simulator::Stop (Seconds (9.75));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (protocol->IsEnergyDepleted (), true,
+                         "Depleted at the low battery threshold of the source");
+  NS_TEST_ASSERT_MSG_LT (protocol->GetNetHarvestPower (), 0.0, "Draining node has a negative net power");
+  NS_TEST_ASSERT_MSG_EQ_TOL (protocol->GetEffectiveEnergyRatio (), protocol->GetRemainingEnergyRatio (),
+                             1e-9, "No harvest credit while draining");
+
+  Simulator::Stop (Seconds (6));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_depletions, 1, "One depletion reported");
+  NS_TEST_ASSERT_MSG_EQ (m_recharges, 1, "One recharge reported");
+  NS_TEST_ASSERT_MSG_EQ (protocol->IsEnergyDepleted (), false,
+                         "Recharged above the high battery threshold of the source");
+  NS_TEST_ASSERT_MSG_GT (protocol->GetNetHarvestPower (), 0.0, "Harvesting node has a positive net power");
+  NS_TEST_ASSERT_MSG_GT (protocol->GetEffectiveEnergyRatio (), protocol->GetRemainingEnergyRatio (),
+                         "Harvesting is credited to the energy ratio");
+
+  Simulator::Destroy ();
+}
+
+
+class BeaconDepletionTestCase : public TestCase
+{
+public:
+  BeaconDepletionTestCase ();
+  virtual ~BeaconDepletionTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// BeaconSent trace sink, settling the energy drawn so far
+  void BeaconSent (Ptr<const Packet> packet);
+  /// Stop the drain and harvest 1.5 W
+  void StartHarvesting ();
+  Ptr<EnergyAwareRoutingProtocol> m_protocol;         ///< Protocol under test
+  Ptr<energy::EnergySource> m_source;                 ///< Its energy source
+  Ptr<energy::SimpleDeviceEnergyModel> m_model;       ///< The drain
+  uint32_t m_beacons;          ///< Beacons sent
+  uint32_t m_depletedBeacons;  ///< Beacons sent while depleted
+};
+
+BeaconDepletionTestCase::BeaconDepletionTestCase ()
+  : TestCase ("Verifying beacons stop at depletion found while beaconing"),
+    m_beacons (0),
+    m_depletedBeacons (0)
+{
+}
+
+BeaconDepletionTestCase::~BeaconDepletionTestCase ()
+{
+}
+
+void
+BeaconDepletionTestCase::BeaconSent (Ptr<const Packet> packet)
+{
+  ++m_beacons;
+  if (m_protocol->IsEnergyDepleted ())
+    {
+      ++m_depletedBeacons;
+    }
+  // As a radio switching to TX would: depletion is found inside SendBeacons
+  m_source->UpdateEnergySource ();
+}
+
+void
+BeaconDepletionTestCase::StartHarvesting ()
+{
+  m_model->SetCurrentA (0.0);
+  BasicEnergyHarvesterHelper harvesterHelper;
+  harvesterHelper.Set ("PeriodicHarvestedPowerUpdateInterval", TimeValue (Seconds (1)));
+  harvesterHelper.Set ("HarvestablePower", StringValue ("ns3::ConstantRandomVariable[Constant=1.5]"));
+  energy::EnergyHarvesterContainer harvesters = harvesterHelper.Install (m_source);
+  harvesters.Get (0)->Initialize ();
+}
+
+void
+BeaconDepletionTestCase::DoRun (void)
+{
+  NodeContainer nodes;
+  nodes.Create (1);
+  SimpleNetDeviceHelper devices;
+  NetDeviceContainer device = devices.Install (nodes);
+
+  // 10 J at 1 V, only settled by the beacons
+  BasicEnergySourceHelper sourceHelper;
+  sourceHelper.Set ("BasicEnergySourceInitialEnergyJ", DoubleValue (10.0));
+  sourceHelper.Set ("BasicEnergySupplyVoltageV", DoubleValue (1.0));
+  sourceHelper.Set ("PeriodicEnergyUpdateInterval", TimeValue (Seconds (1000)));
+  energy::EnergySourceContainer sources = sourceHelper.Install (nodes);
+  m_source = sources.Get (0);
+  m_model = CreateObject<energy::SimpleDeviceEnergyModel> ();
+  m_model->SetNode (nodes.Get (0));
+  m_model->SetEnergySource (m_source);
+  m_source->AppendDeviceEnergyModel (m_model);
+  m_model->SetCurrentA (1.0);
+
+  EnergyAwareEpidemicHelper helper;
+  helper.Set ("MaxBeaconInterval", TimeValue (Seconds (2)));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (helper);
+  internet.Install (nodes);
+  Ipv4AddressHelper addresses;
+  addresses.SetBase ("10.1.1.0", "255.255.255.0");
+  addresses.Assign (device);
+  m_protocol = nodes.Get (0)->GetObject<EnergyAwareRoutingProtocol> ();
+  m_protocol->TraceConnectWithoutContext ("BeaconSent",
+                                          MakeCallback (&BeaconDepletionTestCase::BeaconSent, this));
+
+  // The low battery threshold, 1 J, is crossed after 9 s
+  Simulator::Schedule (Seconds (15), &BeaconDepletionTestCase::StartHarvesting, this);
+  Simulator::Stop (Seconds (14.9));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_protocol->IsEnergyDepleted (), true, "Depleted by 15 s");
+  NS_TEST_ASSERT_MSG_GT (m_beacons, 2, "Beacons sent until depletion");
+  NS_TEST_ASSERT_MSG_EQ (m_depletedBeacons, 0, "No beacon sent while depleted");
+
+  // Recharged above 1.5 J a second or two into the harvest
+  uint32_t beacons = m_beacons;
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_protocol->IsEnergyDepleted (), false, "Recharged by 25 s");
+  NS_TEST_ASSERT_MSG_GT (m_beacons, beacons, "Beacons restarted at recharge");
+  NS_TEST_ASSERT_MSG_EQ (m_depletedBeacons, 0, "Still no beacon sent while depleted");
+
+  m_protocol = 0;
+  m_source = 0;
+  m_model = 0;
+  Simulator::Destroy ();
+}
+
+class EpidemicExchangeTestCase : public TestCase
+{
+public:
+  /// \param bundleMtu the BundleMtu attribute of both nodes, 0 for none
+  EpidemicExchangeTestCase (uint32_t bundleMtu);
+  virtual ~EpidemicExchangeTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Send a 100 byte UDP datagram from \p socket to \p destination
+  void Send (Ptr<Socket> socket, Ipv4Address destination);
+  /// Receive callback of the sink socket
+  void Receive (Ptr<Socket> socket);
+  /// SummaryVectorSent trace sink
+  void SummaryVectorSent (Ptr<const Packet> packet);
+  /// DataSent trace sink
+  void DataSent (Ptr<const Packet> packet, Ipv4Address neighbor);
+  uint32_t m_bundleMtu;       ///< BundleMtu of the nodes
+  uint32_t m_received;        ///< Datagrams received by the sink
+  uint32_t m_summaryVectors;  ///< REPLY and REPLY_BACK packets sent
+  uint32_t m_dataSent;        ///< Buffered packets handed to a neighbor
+};
+
+EpidemicExchangeTestCase::EpidemicExchangeTestCase (uint32_t bundleMtu)
+  : TestCase (bundleMtu ? "Verifying delivery through the anti-entropy handshake, bundled"
+              : "Verifying delivery through the anti-entropy handshake"),
+    m_bundleMtu (bundleMtu),
+    m_received (0),
+    m_summaryVectors (0),
+    m_dataSent (0)
+{
+}
+
+EpidemicExchangeTestCase::~EpidemicExchangeTestCase ()
+{
+}
+
+void
+EpidemicExchangeTestCase::Send (Ptr<Socket> socket, Ipv4Address destination)
+{
+  socket->SendTo (Create<Packet> (100), 0, InetSocketAddress (destination, 9));
+}
+
+void
+EpidemicExchangeTestCase::Receive (Ptr<Socket> socket)
+{
+  while (socket->Recv ())
+    {
+      ++m_received;
+    }
+}
+
+void
+EpidemicExchangeTestCase::SummaryVectorSent (Ptr<const Packet> packet)
+{
+  ++m_summaryVectors;
+}
+
+void
+EpidemicExchangeTestCase::DataSent (Ptr<const Packet> packet, Ipv4Address neighbor)
+{
+  ++m_dataSent;
+}
+
+void
+EpidemicExchangeTestCase::DoRun (void)
+{
+  // A source and a sink on one channel, in range of each other
+  NodeContainer nodes;
+  nodes.Create (2);
+  SimpleNetDeviceHelper devices;
+  NetDeviceContainer device = devices.Install (nodes);
+  EnergyAwareEpidemicHelper helper;
+  helper.Set ("BundleMtu", UintegerValue (m_bundleMtu));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (helper);
+  internet.Install (nodes);
+  Ipv4AddressHelper addresses;
+  addresses.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = addresses.Assign (device);
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      Ptr<EnergyAwareRoutingProtocol> protocol = nodes.Get (i)->GetObject<EnergyAwareRoutingProtocol> ();
+      protocol->TraceConnectWithoutContext ("SummaryVectorSent",
+                                            MakeCallback (&EpidemicExchangeTestCase::SummaryVectorSent, this));
+      protocol->TraceConnectWithoutContext ("DataSent",
+                                            MakeCallback (&EpidemicExchangeTestCase::DataSent, this));
+    }
+
+  Ptr<Socket> sink = Socket::CreateSocket (nodes.Get (1), UdpSocketFactory::GetTypeId ());
+  sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 9));
+  sink->SetRecvCallback (MakeCallback (&EpidemicExchangeTestCase::Receive, this));
+  Ptr<Socket> source = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+  // Buffered before the first beacon, so only the handshake carries them
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      Simulator::Schedule (MilliSeconds (100 + i), &EpidemicExchangeTestCase::Send, this,
+                           source, interfaces.GetAddress (1));
+    }
+
+  Simulator::Stop (Seconds (5));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_received, 3, "Sink should receive every datagram once");
+  NS_TEST_ASSERT_MSG_GT_OR_EQ (m_summaryVectors, 2, "Both a REPLY and a REPLY_BACK should be sent");
+  NS_TEST_ASSERT_MSG_EQ (m_dataSent, 3, "Each datagram should be handed over once");
+  Ptr<EnergyAwareRoutingProtocol> sinkProtocol = nodes.Get (1)->GetObject<EnergyAwareRoutingProtocol> ();
+  NS_TEST_ASSERT_MSG_EQ (sinkProtocol->GetQueue ().GetSize (), 0, "Delivered packets should not be buffered");
+
+  sink->Close ();
+  source->Close ();
+  Simulator::Destroy ();
+}
+
+class DeliveredPacketTestCase : public TestCase
+{
+public:
+  DeliveredPacketTestCase ();
+  virtual ~DeliveredPacketTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Send a 100 byte UDP datagram from \p socket to \p destination
+  void Send (Ptr<Socket> socket, Ipv4Address destination);
+  /// Receive callback of the sink socket
+  void Receive (Ptr<Socket> socket);
+  /// DataSent trace sink of the destination
+  void DataSent (Ptr<const Packet> packet, Ipv4Address neighbor);
+  uint32_t m_received;  ///< Datagrams received by the sink
+  uint32_t m_dataSent;  ///< Buffered packets the destination sent
+};
+
+DeliveredPacketTestCase::DeliveredPacketTestCase ()
+  : TestCase ("Verifying the destination does not send delivered packets on"),
+    m_received (0),
+    m_dataSent (0)
+{
+}
+
+DeliveredPacketTestCase::~DeliveredPacketTestCase ()
+{
+}
+
+void
+DeliveredPacketTestCase::Send (Ptr<Socket> socket, Ipv4Address destination)
+{
+  socket->SendTo (Create<Packet> (100), 0, InetSocketAddress (destination, 9));
+}
+
+void
+DeliveredPacketTestCase::Receive (Ptr<Socket> socket)
+{
+  while (socket->Recv ())
+    {
+      ++m_received;
+    }
+}
+
+void
+DeliveredPacketTestCase::DataSent (Ptr<const Packet> packet, Ipv4Address neighbor)
+{
+  ++m_dataSent;
+}
+
+void
+DeliveredPacketTestCase::DoRun (void)
+{
+  // Without an immunity list, the destination keeps delivered packets in
+  // its buffer, and its summary vector, for the source to stop sending them
+  NodeContainer nodes;
+  nodes.Create (3);
+  SimpleNetDeviceHelper devices;
+  NetDeviceContainer device = devices.Install (nodes);
+  EnergyAwareEpidemicHelper helper;
+  helper.Set ("ImmunityListSize", UintegerValue (0));
+  helper.Set ("HostRecentPeriod", TimeValue (Seconds (1)));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (helper);
+  internet.Install (nodes);
+  Ipv4AddressHelper addresses;
+  addresses.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = addresses.Assign (device);
+  Ptr<EnergyAwareRoutingProtocol> destination = nodes.Get (1)->GetObject<EnergyAwareRoutingProtocol> ();
+  destination->TraceConnectWithoutContext ("DataSent",
+                                           MakeCallback (&DeliveredPacketTestCase::DataSent, this));
+  // A third node refuses every copy, so its summary vector never lists them
+  Ptr<EnergyAwareRoutingProtocol> bystander = nodes.Get (2)->GetObject<EnergyAwareRoutingProtocol> ();
+  bystander->SetAttribute ("EnergyThresholdLow", DoubleValue (1.0));
+  bystander->SetAttribute ("EnergyAwareFloodingFactor", DoubleValue (0.0));
+
+  Ptr<Socket> sink = Socket::CreateSocket (nodes.Get (1), UdpSocketFactory::GetTypeId ());
+  sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 9));
+  sink->SetRecvCallback (MakeCallback (&DeliveredPacketTestCase::Receive, this));
+  Ptr<Socket> source = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      Simulator::Schedule (MilliSeconds (100 + i), &DeliveredPacketTestCase::Send, this,
+                           source, interfaces.GetAddress (1));
+    }
+
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_received, 3, "Sink should receive every datagram once");
+  NS_TEST_ASSERT_MSG_EQ (destination->GetQueue ().GetSize (), 3,
+                         "Delivered packets should stay in the summary vector");
+  NS_TEST_ASSERT_MSG_EQ (m_dataSent, 0, "The destination should not send delivered packets");
+
+  sink->Close ();
+  source->Close ();
+  Simulator::Destroy ();
+}
+
+class CustodyTransferTestCase : public TestCase
+{
+public:
+  /// \param bundleMtu the BundleMtu attribute of both nodes, 0 for none
+  CustodyTransferTestCase (uint32_t bundleMtu);
+  virtual ~CustodyTransferTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Send a 100 byte UDP datagram from \p socket to \p destination
+  void Send (Ptr<Socket> socket, Ipv4Address destination);
+  /// DataSent trace sink
+  void DataSent (Ptr<const Packet> packet, Ipv4Address neighbor);
+  /// CustodyTransfer trace sink
+  void CustodyTransfer (Ipv4Address neighbor, uint32_t packets);
+  uint32_t m_bundleMtu;  ///< BundleMtu of the nodes
+  uint32_t m_dataSent;   ///< Buffered packets sent to a neighbor
+  uint32_t m_handedOff;  ///< Packets reported by the CustodyTransfer trace
+};
+
+CustodyTransferTestCase::CustodyTransferTestCase (uint32_t bundleMtu)
+  : TestCase (bundleMtu ? "Verifying custody transfer to a richer neighbor, bundled"
+              : "Verifying custody transfer to a richer neighbor"),
+    m_bundleMtu (bundleMtu),
+    m_dataSent (0),
+    m_handedOff (0)
+{
+}
+
+CustodyTransferTestCase::~CustodyTransferTestCase ()
+{
+}
+
+void
+CustodyTransferTestCase::Send (Ptr<Socket> socket, Ipv4Address destination)
+{
+  socket->SendTo (Create<Packet> (100), 0, InetSocketAddress (destination, 9));
+}
+
+void
+CustodyTransferTestCase::DataSent (Ptr<const Packet> packet, Ipv4Address neighbor)
+{
+  ++m_dataSent;
+}
+
+void
+CustodyTransferTestCase::CustodyTransfer (Ipv4Address neighbor, uint32_t packets)
+{
+  m_handedOff += packets;
+}
+
+void
+CustodyTransferTestCase::DoRun (void)
+{
+  NodeContainer nodes;
+  nodes.Create (2);
+  SimpleNetDeviceHelper devices;
+  NetDeviceContainer device = devices.Install (nodes);
+
+  // Only the sender runs on a battery: 100 J at 1 V
+  BasicEnergySourceHelper sourceHelper;
+  sourceHelper.Set ("BasicEnergySourceInitialEnergyJ", DoubleValue (100.0));
+  sourceHelper.Set ("BasicEnergySupplyVoltageV", DoubleValue (1.0));
+  energy::EnergySourceContainer sources = sourceHelper.Install (NodeContainer (nodes.Get (0)));
+  Ptr<energy::SimpleDeviceEnergyModel> model = CreateObject<energy::SimpleDeviceEnergyModel> ();
+  model->SetNode (nodes.Get (0));
+  model->SetEnergySource (sources.Get (0));
+  sources.Get (0)->AppendDeviceEnergyModel (model);
+
+  EnergyAwareEpidemicHelper helper;
+  helper.Set ("CustodyTransfer", BooleanValue (true));
+  helper.Set ("HostRecentPeriod", TimeValue (Seconds (1)));
+  helper.Set ("BundleMtu", UintegerValue (m_bundleMtu));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (helper);
+  internet.Install (nodes);
+  Ipv4AddressHelper addresses;
+  addresses.SetBase ("10.1.1.0", "255.255.255.0");
+  addresses.Assign (device);
+
+  Ptr<EnergyAwareRoutingProtocol> sender = nodes.Get (0)->GetObject<EnergyAwareRoutingProtocol> ();
+  sender->SetAttribute ("EnergyThresholdLow", DoubleValue (0.5));
+  sender->SetAttribute ("EnergyThresholdCritical", DoubleValue (0.1));
+  sender->TraceConnectWithoutContext ("DataSent",
+                                      MakeCallback (&CustodyTransferTestCase::DataSent, this));
+  sender->TraceConnectWithoutContext ("CustodyTransfer",
+                                      MakeCallback (&CustodyTransferTestCase::CustodyTransfer, this));
+  // The receiver refuses every copy, which puts its ID in its duplicate filter
+  Ptr<EnergyAwareRoutingProtocol> receiver = nodes.Get (1)->GetObject<EnergyAwareRoutingProtocol> ();
+  receiver->SetAttribute ("EnergyThresholdLow", DoubleValue (1.0));
+  receiver->SetAttribute ("EnergyAwareFloodingFactor", DoubleValue (0.0));
+
+  // For a host out of range, so both nodes can only relay them
+  Ptr<Socket> source = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      Simulator::Schedule (MilliSeconds (100 + i), &CustodyTransferTestCase::Send, this,
+                           source, Ipv4Address ("10.1.1.99"));
+    }
+  // 60 J drawn from 4 s to 5 s leave the sender at ratio 0.4
+  Simulator::Schedule (Seconds (4), &energy::SimpleDeviceEnergyModel::SetCurrentA, model, 60.0);
+  Simulator::Schedule (Seconds (5), &energy::SimpleDeviceEnergyModel::SetCurrentA, model, 0.0);
+
+  Simulator::Stop (Seconds (3.9));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_GT (m_dataSent, 0, "Copies should be offered at full energy");
+  NS_TEST_ASSERT_MSG_EQ (receiver->GetQueue ().GetSize (), 0, "Copies should be refused");
+  NS_TEST_ASSERT_MSG_EQ (sender->GetQueue ().GetSize (), 3, "Copies should not leave the sender");
+  NS_TEST_ASSERT_MSG_EQ (m_handedOff, 0, "No custody at full energy");
+
+  Simulator::Stop (Seconds (16.1));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_LT (sender->GetEffectiveEnergyRatio (), 0.5, "Sender should be low on energy");
+  NS_TEST_ASSERT_MSG_EQ (receiver->GetQueue ().GetSize (), 3,
+                         "Custody should override the duplicate filter and the policy");
+  NS_TEST_ASSERT_MSG_EQ (sender->GetQueue ().GetSize (), 0,
+                         "Packets should be dropped once the custodian lists them");
+  NS_TEST_ASSERT_MSG_EQ (m_handedOff, 3, "Each packet should be handed off once");
+
+  source->Close ();
+  Simulator::Destroy ();
+}
+
+class HostContactTableTestCase : public TestCase
+{
+public:
+  HostContactTableTestCase ();
+  virtual ~HostContactTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Record contacts with \p n hosts starting at \p first
+  void Contact (uint32_t first, uint32_t n);
+  /// Check the table once the first contacts have aged
+  void CheckAged ();
+  /// Table under test
+  HostContactTable m_table;
+  /// Capacity reached by the first contacts
+  uint32_t m_capacity;
+};
+
+HostContactTableTestCase::HostContactTableTestCase ()
+  : TestCase ("Verifying host contact table lookups and aging"),
+    m_table (Seconds (10)),
+    m_capacity (0)
+{
+}
+
+HostContactTableTestCase::~HostContactTableTestCase ()
+{
+}
+
+void
+HostContactTableTestCase::Contact (uint32_t first, uint32_t n)
+{
+  for (uint32_t i = first; i < first + n; ++i)
+    {
+      m_table.Update (Ipv4Address (0x0a000000 + i));
+    }
+}
+
+void
+HostContactTableTestCase::CheckAged ()
+{
+  NS_TEST_ASSERT_MSG_EQ (m_table.IsRecent (Ipv4Address (0x0a000001)), false,
+                         "Contact should expire after the period");
+  NS_TEST_ASSERT_MSG_EQ (m_table.GetSize (), 0, "All contacts should have expired");
+  // A new population reuses the slots of the expired one
+  Contact (1000, 100);
+  NS_TEST_ASSERT_MSG_EQ (m_table.GetSize (), 100, "New contacts should be recorded");
+  NS_TEST_ASSERT_MSG_EQ (m_table.GetCapacity (), m_capacity, "Table should not grow");
+}
+
+void
+HostContactTableTestCase::DoRun (void)
+{
+  Contact (1, 100);
+  NS_TEST_ASSERT_MSG_EQ (m_table.GetSize (), 100, "Contacts should be recorded");
+  NS_TEST_ASSERT_MSG_EQ (m_table.IsRecent (Ipv4Address (0x0a000032)), true, "Contact should be recent");
+  NS_TEST_ASSERT_MSG_EQ (m_table.IsRecent (Ipv4Address (0x0a0000c8)), false, "Unknown host");
+  m_capacity = m_table.GetCapacity ();
+  NS_TEST_ASSERT_MSG_GT (m_table.GetMemoryUsage (), m_capacity, "Memory usage should cover the slots");
+
+  Simulator::Schedule (Seconds (20), &HostContactTableTestCase::CheckAged, this);
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+
+
+class DuplicateFilterTestCase : public TestCase
+{
+public:
+  DuplicateFilterTestCase ();
+  virtual ~DuplicateFilterTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// \return how many of the \p n IDs of \p source from 0 the filter holds
+  uint32_t CountContained (uint32_t source, uint32_t n) const;
+  /// Check that a new generation keeps the first IDs
+  void CheckRotated ();
+  /// Check that the first IDs are forgotten after two periods
+  void CheckForgotten ();
+  /// Filter under test
+  DuplicateFilter m_filter;
+};
+
+DuplicateFilterTestCase::DuplicateFilterTestCase ()
+  : TestCase ("Verifying duplicate filter lookups and rotation"),
+    m_filter (8192, Seconds (10))
+{
+}
+
+DuplicateFilterTestCase::~DuplicateFilterTestCase ()
+{
+}
+
+uint32_t
+DuplicateFilterTestCase::CountContained (uint32_t source, uint32_t n) const
+{
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      count += m_filter.Contains ((source << 16) | i);
+    }
+  return count;
+}
+
+void
+DuplicateFilterTestCase::CheckRotated ()
+{
+  m_filter.Insert (0x0a000003u << 16);
+  NS_TEST_ASSERT_MSG_EQ (m_filter.GetCount (), 1, "A period old generation should be replaced");
+  NS_TEST_ASSERT_MSG_EQ (CountContained (0x0a000001, 500), 500,
+                         "The previous generation should still be looked up");
+}
+
+void
+DuplicateFilterTestCase::CheckForgotten ()
+{
+  NS_TEST_ASSERT_MSG_LT (CountContained (0x0a000001, 500), 10,
+                         "IDs should be forgotten after two periods");
+  NS_TEST_ASSERT_MSG_EQ (m_filter.Contains (0x0a000003u << 16), true,
+                         "IDs of the current generation should be kept");
+}
+
+void
+DuplicateFilterTestCase::DoRun (void)
+{
+  for (uint32_t i = 0; i < 500; ++i)
+    {
+      m_filter.Insert ((0x0a000001u << 16) | i);
+    }
+  NS_TEST_ASSERT_MSG_EQ (CountContained (0x0a000001, 500), 500, "No false negatives");
+  NS_TEST_ASSERT_MSG_LT (CountContained (0x0a000002, 10000), 100, "False positives should be rare");
+  NS_TEST_ASSERT_MSG_EQ (DuplicateFilter ().Contains (1), false, "An empty filter holds nothing");
+
+  // A full generation is replaced before its period
+  DuplicateFilter small (1024, Seconds (10));
+  for (uint32_t i = 0; i < 65; ++i)
+    {
+      small.Insert (i);
+    }
+  NS_TEST_ASSERT_MSG_EQ (small.GetCount (), 1, "A full generation should be replaced");
+  NS_TEST_ASSERT_MSG_EQ (small.Contains (0), true, "The full generation should still be looked up");
+
+  Simulator::Schedule (Seconds (15), &DuplicateFilterTestCase::CheckRotated, this);
+  Simulator::Schedule (Seconds (30), &DuplicateFilterTestCase::CheckForgotten, this);
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+
+
+class PayloadCodecTestCase : public TestCase
+{
+public:
+  PayloadCodecTestCase ();
+  virtual ~PayloadCodecTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// \return the bytes of \p packet
+  std::vector<uint8_t> GetBytes (Ptr<const Packet> packet) const;
+};
+
+PayloadCodecTestCase::PayloadCodecTestCase ()
+  : TestCase ("Verifying payload compression codecs")
+{
+}
+
+PayloadCodecTestCase::~PayloadCodecTestCase ()
+{
+}
+
+std::vector<uint8_t>
+PayloadCodecTestCase::GetBytes (Ptr<const Packet> packet) const
+{
+  std::vector<uint8_t> bytes (packet->GetSize ());
+  packet->CopyData (bytes.data (), bytes.size ());
+  return bytes;
+}
+
+void
+PayloadCodecTestCase::DoRun (void)
+{
+  // An 8 byte transport header followed by a repetitive payload
+  std::vector<uint8_t> data (512);
+  for (uint32_t i = 0; i < data.size (); ++i)
+    {
+      data[i] = i < 8 ? 0xa0 + i : "GPS 52.52N 13.40E ok "[(i - 8) % 21];
+    }
+  Ptr<Packet> packet = Create<Packet> (data.data (), data.size ());
+  packet->AddPacketTag (ControlTag (ControlTag::CONTROL));
+
+  Ptr<LzPayloadCodec> lz = CreateObject<LzPayloadCodec> ();
+  Ptr<Packet> compressed = lz->Compress (packet, 8);
+  NS_TEST_ASSERT_MSG_NE (compressed, nullptr, "Repetitive payload should compress");
+  NS_TEST_ASSERT_MSG_LT (compressed->GetSize (), 100, "Repetitive payload should shrink a lot");
+  ControlTag tag;
+  NS_TEST_ASSERT_MSG_EQ (compressed->PeekPacketTag (tag), true, "Packet tags should be kept");
+  Ptr<Packet> restored = lz->Decompress (compressed, 8);
+  NS_TEST_ASSERT_MSG_NE (restored, nullptr, "Compressed payload should decode");
+  NS_TEST_ASSERT_MSG_EQ ((GetBytes (restored) == data), true, "LZ codec should be lossless");
+
+  // Noise does not compress
+  uint32_t state = 12345;
+  for (uint32_t i = 0; i < data.size (); ++i)
+    {
+      state = state * 1103515245 + 12345;
+      data[i] = state >> 24;
+    }
+  Ptr<Packet> noise = Create<Packet> (data.data (), data.size ());
+  NS_TEST_ASSERT_MSG_EQ (lz->Compress (noise, 8), nullptr, "Noise should not be compressed");
+
+  // Down-sampling halves the voice samples and restores the length
+  Ptr<DownsamplePayloadCodec> downsample = CreateObject<DownsamplePayloadCodec> ();
+  compressed = downsample->Compress (noise, 8);
+  NS_TEST_ASSERT_MSG_NE (compressed, nullptr, "Voice payload should be down-sampled");
+  NS_TEST_ASSERT_MSG_EQ (compressed->GetSize (), 8 + 4 + 252, "One sample out of two should be kept");
+  restored = downsample->Decompress (compressed, 8);
+  NS_TEST_ASSERT_MSG_EQ (restored->GetSize (), 512, "Restored payload should have its length");
+  std::vector<uint8_t> bytes = GetBytes (restored);
+  NS_TEST_ASSERT_MSG_EQ (std::equal (bytes.begin (), bytes.begin () + 10, data.begin ()), true,
+                         "Transport header and first sample should be kept");
 }
 
 
@@ -163,6 +1444,19 @@ EnergyAwareEpidemicTestSuite::EnergyAwareEpidemicTestSuite ()
 {
   AddTestCase (new EnergyAwareRoutingTestCase, Duration::QUICK);
   AddTestCase (new EnergyAwareHelperTestCase, Duration::QUICK);
+  AddTestCase (new SummaryVectorTestCase, Duration::QUICK);
+  AddTestCase (new PacketQueueTestCase, Duration::QUICK);
+  AddTestCase (new EnergyStateTestCase, Duration::QUICK);
+  AddTestCase (new EnergyHarvestingTestCase, Duration::QUICK);
+  AddTestCase (new BeaconDepletionTestCase, Duration::QUICK);
+  AddTestCase (new EpidemicExchangeTestCase (0), Duration::QUICK);
+  AddTestCase (new EpidemicExchangeTestCase (1400), Duration::QUICK);
+  AddTestCase (new DeliveredPacketTestCase, Duration::QUICK);
+  AddTestCase (new CustodyTransferTestCase (0), Duration::QUICK);
+  AddTestCase (new CustodyTransferTestCase (1400), Duration::QUICK);
+  AddTestCase (new HostContactTableTestCase, Duration::QUICK);
+  AddTestCase (new DuplicateFilterTestCase, Duration::QUICK);
+  AddTestCase (new PayloadCodecTestCase, Duration::QUICK);
 }
 
 static EnergyAwareEpidemicTestSuite energyAwareEpidemicTestSuite;